@@ -20,29 +20,62 @@
 /* $Id: AT26F004.c 1112 2008-05-06 09:54:21Z jaguarondi $ */
 
 #include <avr/io.h>
+#include <avr/pgmspace.h>
 #include "AT26F004.h"
 #include "hardware.h"
 #include "spi.h"
 
 static void unprotect_sectors(void);
+
+#if (OPT_FLASH_DETECT)
 /**
  * \ingroup at26f004
- * \brief initialize a table with the sector adresses values
+ * \brief Geometry of a serial flash, found from its JEDEC ID.
  */
-static uint8_t sector_adress[11][3] = {
-    {SECTOR0},
-    {SECTOR1},
-    {SECTOR2},
-    {SECTOR3},
-    {SECTOR4},
-    {SECTOR5},
-    {SECTOR6},
-    {SECTOR7},
-    {SECTOR8},
-    {SECTOR9},
-    {SECTOR10}
+struct flash_chip
+{
+    /** Manufacturer, memory type and capacity, as read with READ_MANUFACT. */
+    uint8_t id[3];
+    /** High byte of the last address. */
+    uint8_t top;
+    /** FLASH_SEQUENTIAL and FLASH_SECTORS */
+    uint8_t flags;
 };
 
+/**
+ * \ingroup at26f004
+ * \brief Parts that can replace the AT26F004. They all have the 4kB block
+ * erase, the byte program and the status register of the AT26F004.
+ */
+static struct flash_chip const flash_chips[] PROGMEM = {
+    {{0x1F, 0x04, 0x00}, 0x07, FLASH_SEQUENTIAL | FLASH_SECTORS}, /* AT26F004 */
+    {{0x1F, 0x44, 0x01}, 0x07, 0},      /* Atmel AT25DF041A */
+    {{0x1F, 0x45, 0x01}, 0x0F, 0},      /* Atmel AT26DF081A */
+    {{0x1F, 0x46, 0x01}, 0x1F, 0},      /* Atmel AT26DF161A */
+    {{0x1F, 0x47, 0x01}, 0x3F, 0},      /* Atmel AT25DF321A */
+    {{0xEF, 0x30, 0x13}, 0x07, 0},      /* Winbond W25X40 */
+    {{0xEF, 0x40, 0x14}, 0x0F, 0},      /* Winbond W25Q80 */
+    {{0xEF, 0x40, 0x15}, 0x1F, 0},      /* Winbond W25Q16 */
+    {{0xEF, 0x40, 0x16}, 0x3F, 0},      /* Winbond W25Q32 */
+    {{0xEF, 0x40, 0x17}, 0x7F, 0},      /* Winbond W25Q64 */
+    {{0xC2, 0x20, 0x13}, 0x07, 0},      /* Macronix MX25L4006E */
+    {{0xC2, 0x20, 0x14}, 0x0F, 0},      /* Macronix MX25L8006E */
+    {{0xC2, 0x20, 0x15}, 0x1F, 0},      /* Macronix MX25L1606E */
+    {{0xC2, 0x20, 0x16}, 0x3F, 0},      /* Macronix MX25L3206E */
+    {{0xBF, 0x25, 0x8D}, 0x07, 0},      /* SST SST25VF040B */
+    {{0xBF, 0x25, 0x8E}, 0x0F, 0},      /* SST SST25VF080B */
+    {{0xBF, 0x25, 0x41}, 0x1F, 0},      /* SST SST25VF016B */
+    {{0xBF, 0x25, 0x4A}, 0x3F, 0},      /* SST SST25VF032B */
+    {{0x20, 0x71, 0x15}, 0x1F, 0},      /* Micron M25PX16 */
+    {{0x20, 0x71, 0x16}, 0x3F, 0},      /* Micron M25PX32 */
+};
+
+uint8_t flash_top = TOP_A2;
+uint8_t flash_flags = FLASH_SEQUENTIAL | FLASH_SECTORS;
+/** Address of the next byte to program in sequ_program(). */
+static uint32_t sequ_address;
+#endif
+
 /**
  * \ingroup at26f004
 
@@ -130,13 +163,75 @@ void erase_flash(void)
 static void unprotect_sectors(void)
 {
     uint8_t i;
+    /* Other parts need the write enable before the status is written, this
+     * clears all their protection bits. */
+    write_enable();
     write_status(0x00); /* Disable sector protection register */
+    if (!(flash_flags & FLASH_SECTORS))
+        return;
+    /* Sectors 0 to 7 start at each 64kB, the smaller sectors 8 to 10 are
+     * 8kB apart at the top, see SECTOR0 to SECTOR10. */
     for (i=0; i<=10; i++)
     {
         write_enable(); /* Enable the writing */
-        unprotect_sector(sector_adress[i][0], sector_adress[i][1],sector_adress[i][2]);
+        if (i < 8)
+            unprotect_sector(i, 0x00, 0x00);
+        else
+            unprotect_sector(0x07, 0x80 + ((i - 8) << 5), 0x00);
     }
 }
+
+/**
+ * \ingroup at26f004
+
+   \brief Read the JEDEC ID of the flash and set its geometry.
+
+   flash_top and flash_flags are left to the AT26F004 ones if the part isn't
+   known.
+   */
+#if (OPT_FLASH_DETECT)
+void flash_detect(void)
+{
+    uint8_t id[3];
+    uint8_t i, j;
+
+    flash_select();
+    spiSend(READ_MANUFACT);
+    for (i = 0; i < 3; i++)
+        id[i] = spiSend(NOP);
+    flash_unselect();
+
+    for (i = 0; i < sizeof flash_chips / sizeof flash_chips[0]; i++)
+    {
+        for (j = 0; j < 3; j++)
+            if (pgm_read_byte(&flash_chips[i].id[j]) != id[j])
+                break;
+        if (j == 3)
+        {
+            flash_top = pgm_read_byte(&flash_chips[i].top);
+            if (flash_top > FLASH_TOP_MAX)
+                flash_top = FLASH_TOP_MAX;
+            flash_flags = pgm_read_byte(&flash_chips[i].flags);
+            return;
+        }
+    }
+}
+#endif
+/**
+ * \ingroup at26f004
+
+   \brief This function wait until the flash memory isn't busy.
+
+   The status register is read continuously in a single transaction.
+   */
+void wait_ready(void)
+{
+    flash_select();
+    spiSend(READ_STATUS_REG); /* Send Read Status Command */
+    while (spiSend(NOP) & BUSY) ;
+    flash_unselect();
+}
+
 /**
  * \ingroup at26f004
    \param ad2 high address part
@@ -161,6 +256,80 @@ void program_flash(uint8_t const ad2, uint8_t const ad1, uint8_t const ad0,
     flash_unselect();
 }
 
+/**
+ * \ingroup at26f004
+   \param ad2 high address part
+   \param ad1 medium adress part
+   \param ad0 lower adress part
+   \param data First byte to write
+
+   \brief Start programming bytes one after the other.
+
+   The next bytes are written with sequ_program() and the sequence is ended
+   with sequ_program_end(). The sequential program mode is used if the part
+   has it, otherwise each byte is written with its address.
+   */
+void sequ_program_start(uint8_t const ad2, uint8_t const ad1,
+                        uint8_t const ad0, uint8_t const data)
+{
+    write_enable();
+    flash_select();
+    if (flash_flags & FLASH_SEQUENTIAL)
+        spiSend(SEQU_PROGRAM);
+    else
+        spiSend(BYTE_PROGRAM);
+    spiSend(ad2);
+    spiSend(ad1);
+    spiSend(ad0);
+    spiSend(data);
+    flash_unselect();
+#if (OPT_FLASH_DETECT)
+    sequ_address = (((uint32_t)ad2 << 16) | ((uint16_t)ad1 << 8) | ad0) + 1;
+#endif
+}
+
+/**
+ * \ingroup at26f004
+   \param data Byte to write
+
+   \brief Write the next byte of a sequence, once the previous one is
+   programmed.
+   */
+void sequ_program(uint8_t const data)
+{
+    wait_ready();
+#if (OPT_FLASH_DETECT)
+    if (!(flash_flags & FLASH_SEQUENTIAL))
+    {
+        write_enable();
+        flash_select();
+        spiSend(BYTE_PROGRAM);
+        spiSend(sequ_address >> 16);
+        spiSend(sequ_address >> 8);
+        spiSend(sequ_address);
+        sequ_address ++;
+    }
+    else
+#endif
+    {
+        flash_select();
+        spiSend(SEQU_PROGRAM);
+    }
+    spiSend(data);
+    flash_unselect();
+}
+
+/**
+ * \ingroup at26f004
+
+   \brief End a sequence of bytes once the last one is programmed.
+   */
+void sequ_program_end(void)
+{
+    wait_ready();
+    write_disable();
+}
+
 /**
  * \ingroup at26f004
    \param ad2 high address part
@@ -185,37 +354,26 @@ uint8_t read_data(uint8_t const ad2, uint8_t const ad1, uint8_t const ad0)
     return data1;
 }
 
+#if (OPT_ERASE_USED || OPT_SOUND_DELETE || OPT_FLASH_IMAGE)
 /**
  * \ingroup at26f004
-   \param first_block The first block to erase
-   \param last_block The last block to erase
-   \brief This function erase a specified area in the memory. The memory will be erased by 4kB's blocks.
+   \param block The block to erase
+   \brief This function start erasing a 4kB block, the flash is busy until
+   it's done. See erase() to erase several blocks in the background.
    */
-void blockErase(uint8_t first_block, uint8_t last_block)
+void block_erase_start(uint16_t block)
 {
-    uint8_t diff, ad0, ad1;
-
     // unprotect all sectors
     unprotect_sectors();
 
-    // diff is the number of block to erase
-    diff = last_block - first_block + 1;
-    while(diff)
-    {
-        // Erase a 4kB block
-        write_enable();
-        flash_select();
-        ad0 = (last_block >> 4);
-        ad1 = (last_block << 4);
-        spiSend(BLOCK_ERASE_4K); /* Send Erase Bulk command */
-        spiSend(ad0);
-        spiSend(ad1);
-        spiSend(0x00);
-        flash_unselect();
-
-        diff --;
-        last_block --;
-        while (read_status() & BUSY);
-    }
+    // Erase a 4kB block
+    write_enable();
+    flash_select();
+    spiSend(BLOCK_ERASE_4K); /* Send Erase Bulk command */
+    spiSend(block >> 4);
+    spiSend(block << 4);
+    spiSend(0x00);
+    flash_unselect();
 }
+#endif
 
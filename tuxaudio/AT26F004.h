@@ -23,6 +23,13 @@
     \ingroup at26f004
 
     This module contains all specific definitions and functions to access the flash memory.
+
+    Other serial flashes can be fitted instead of the AT26F004. Their JEDEC ID
+    is read at boot by flash_detect() and looked up in a table giving their
+    size and how they're programmed. Parts without the sequential program
+    mode of the AT26F004 are programmed one byte at a time with BYTE_PROGRAM,
+    which sequ_program() hides. Unknown parts are taken as an AT26F004.
+    This is only built with OPT_FLASH_DETECT, see features.h.
     */
 
 /** \file AT26F004.h
@@ -34,6 +41,7 @@
 #define AT26F004_H
 
 #include "hardware.h"
+#include "features.h"
 
 /** \file AT26F004.c
     \ingroup at26f004
@@ -127,9 +135,33 @@
 #define TOP_A0 0xFF
 /*! @} */
 
+/** \name Detected flash
+ * flash_top is the high byte of the last address of the detected part,
+ * TOP_A2 for an AT26F004. The TOC keeps 2 bits of this byte for flags, see
+ * TOC_ADDR_MK, so only the first 4MB of a larger part are used.
+ * @{ */
+#define FLASH_TOP_MAX       0x3F
+/** The part has the sequential program mode, SEQU_PROGRAM. */
+#define FLASH_SEQUENTIAL    0x01
+/** The sectors are unprotected one by one, with UNPROTECT_SECTOR. */
+#define FLASH_SECTORS       0x02
+/** Number of 4kB blocks of the detected part. */
+#define flash_blocks()      (((uint16_t)flash_top + 1) << 4)
+
+#if (OPT_FLASH_DETECT)
+extern uint8_t flash_top;
+extern uint8_t flash_flags;
+#else
+/* Only the AT26F004 is supported. */
+#define flash_top           TOP_A2
+#define flash_flags         (FLASH_SEQUENTIAL | FLASH_SECTORS)
+#endif
+/*! @} */
+
 /** \name Status access functions 
  * @{ */
 extern uint8_t read_status(void);
+extern void wait_ready(void);
 extern void write_status(uint8_t const status);
 /* @} */
 /** \name Writing functions 
@@ -138,6 +170,10 @@ extern void write_enable(void);
 extern void write_disable(void);
 extern void program_flash(uint8_t const ad2, uint8_t const ad1, uint8_t const ad0,
                           uint8_t const data);
+extern void sequ_program_start(uint8_t const ad2, uint8_t const ad1,
+                               uint8_t const ad0, uint8_t const data);
+extern void sequ_program(uint8_t const data);
+extern void sequ_program_end(void);
 /* @} */
 /** \name Reading function 
  * @{ */
@@ -145,8 +181,11 @@ extern uint8_t read_data(uint8_t const ad2, uint8_t const ad1, uint8_t const ad0
 /* @} */
 /** \name Misc. functions 
  * @{ */
+#if (OPT_FLASH_DETECT)
+extern void flash_detect(void);
+#endif
 extern void erase_flash(void);
-extern void blockErase(uint8_t first_block, uint8_t last_block);
+extern void block_erase_start(uint16_t block);
 extern void unprotect_sector(uint8_t const ad2, uint8_t const ad1,
                              uint8_t const ad0);
 /* @} */
@@ -0,0 +1,103 @@
+/*
+ * TUXAUDIO - Firmware for the 'audio' CPU of tuxdroid
+ * Copyright (C) 2007 C2ME S.A. <tuxdroid@c2me.be>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* $Id$ */
+
+#include <avr/pgmspace.h>
+#include "adpcm.h"
+#include "features.h"
+
+/** Quantizer step sizes. */
+static const uint16_t step_table[89] PROGMEM = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41,
+    45, 50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190,
+    209, 230, 253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796,
+    876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499,
+    2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845,
+    8630, 9493, 10442, 11487, 12635, 13899, 15289, 16818, 18500, 20350,
+    22385, 24623, 27086, 29794, 32767
+};
+
+/** Step index adjustment, indexed by the code magnitude. */
+static const int8_t index_table[8] = {-1, -1, -1, -1, 2, 4, 6, 8};
+
+#if (OPT_SOUND_ADPCM)
+/**
+ * \ingroup adpcm
+ * \brief Reset the decoder state at the beginning of a sound.
+ */
+void adpcm_init(struct adpcm_state *state)
+{
+    state->predictor = 0;
+    state->index = 0;
+}
+#endif
+
+#if (OPT_SPK_ADPCM)
+/**
+ * \ingroup adpcm
+ * \brief Restart the decoder from a given state, used by the streams which
+ * carry it.
+ * \param state Decoder state.
+ * \param sample Last sample, unsigned 8-bit.
+ * \param index Step index, limited to the table.
+ */
+void adpcm_set(struct adpcm_state *state, uint8_t sample, uint8_t index)
+{
+    state->predictor = (int16_t)(sample - 0x80) << 8;
+    state->index = index > 88 ? 88 : index;
+}
+#endif
+
+/**
+ * \ingroup adpcm
+ * \param state Decoder state.
+ * \param code 4-bit code, the upper nibble is ignored.
+ * \return Decoded sample, unsigned 8-bit.
+ */
+uint8_t adpcm_decode(struct adpcm_state *state, uint8_t code)
+{
+    uint16_t step = pgm_read_word(&step_table[state->index]);
+    uint16_t diff = step >> 3;
+    int32_t predictor = state->predictor;
+
+    if (code & 0x04)
+        diff += step;
+    if (code & 0x02)
+        diff += step >> 1;
+    if (code & 0x01)
+        diff += step >> 2;
+    if (code & 0x08)
+        predictor -= diff;
+    else
+        predictor += diff;
+    if (predictor > 32767)
+        predictor = 32767;
+    else if (predictor < -32768)
+        predictor = -32768;
+    state->predictor = predictor;
+
+    state->index += index_table[code & 0x07];
+    if (state->index < 0)
+        state->index = 0;
+    else if (state->index > 88)
+        state->index = 88;
+
+    return (uint8_t)((state->predictor >> 8) + 0x80);
+}
@@ -0,0 +1,59 @@
+/*
+ * TUXAUDIO - Firmware for the 'audio' CPU of tuxdroid
+ * Copyright (C) 2007 C2ME S.A. <tuxdroid@c2me.be>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* $Id$ */
+
+/** \defgroup adpcm IMA-ADPCM decoder
+    \ingroup adpcm
+
+    Decoder of 4-bit IMA-ADPCM sounds.
+
+    A byte holds 2 codes, the low nibble being the first sample. There's no
+    block header, the decoder starts with a null predictor and step index at
+    the beginning of each sound. The decoded samples are unsigned 8-bit like
+    the raw sounds.
+*/
+
+/** \file adpcm.h
+    \ingroup adpcm
+*/
+/** \file adpcm.c
+    \ingroup adpcm
+*/
+
+#ifndef ADPCM_H
+#define ADPCM_H
+
+#include <stdint.h>
+
+/** Decoder state. */
+struct adpcm_state
+{
+    /** Last decoded sample, signed 16-bit. */
+    int16_t predictor;
+    /** Index in the step table. */
+    int8_t index;
+};
+
+extern void adpcm_init(struct adpcm_state *state);
+extern void adpcm_set(struct adpcm_state *state, uint8_t sample,
+                      uint8_t index);
+extern uint8_t adpcm_decode(struct adpcm_state *state, uint8_t code);
+
+#endif
@@ -24,8 +24,8 @@
 
 uint8_t AudioInIdx = 0;
 uint8_t AudioOutIdx = 0;
-uint8_t AudioFifoSize = 128;
-uint8_t AudioBuffer[128];
+uint8_t AudioBuffer[AudioFifoSize];
+uint8_t AudioHalfRate = 0;
 
 /* Empty the buffer by clearing the indexes. */
 void AudioFifoClear(void)
@@ -41,7 +41,7 @@ void AudioFifoClear(void)
  */
 int8_t AudioFifoPut(uint8_t const data)
 {
-    if (AudioFifoLength() == AudioFifoSize)
+    if (AudioFifoLength() == AudioFifoCapacity)
         return A_FIFO_FULL;
     AudioBuffer[AudioInIdx++ & (AudioFifoSize-1)] = data;
     return A_FIFO_OK;
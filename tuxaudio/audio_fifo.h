@@ -22,6 +22,17 @@
 #ifndef _AUDIO_FIFO_H_
 #define _AUDIO_FIFO_H_
 
+/** Size of the fifo, a power of 2 up to 256. It's a constant so the sampling
+ * interrupt doesn't have to load it.
+ *
+ * The indexes are 8-bit so they are read and written atomically by the
+ * sampling interrupt and the main loop. With 256 bytes, they wrap by
+ * themselves and the fifo holds 255 samples (16ms at 16kHz) as a full fifo
+ * can't be told from an empty one. */
+#define AudioFifoSize 256
+/** Number of samples the fifo can hold. */
+#define AudioFifoCapacity (AudioFifoSize < 256 ? AudioFifoSize : 255)
+
 #define AudioFifoLength() (uint8_t)(AudioInIdx - AudioOutIdx)
 
 enum AUDIO_FIFO_STATUS {A_FIFO_OK = 0, A_FIFO_FULL, A_FIFO_EMPTY};
@@ -32,13 +43,16 @@ int8_t AudioFifoGet(uint8_t *data);
 
 extern uint8_t AudioInIdx;
 extern uint8_t AudioOutIdx;
-extern uint8_t AudioFifoSize;
 extern uint8_t AudioBuffer[];
+/** Set when the fifo holds 8kHz samples, the sampling interrupt then
+ * interpolates them to 16kHz. The RF stream is 16kHz, the flash sounds
+ * 8kHz. */
+extern uint8_t AudioHalfRate;
 
 
 static inline void AudioFifoPut_inl(uint8_t const data)
 {
-    if (AudioFifoLength() == AudioFifoSize)
+    if (AudioFifoLength() == AudioFifoCapacity)
 	return;
     AudioBuffer[AudioInIdx++ & (AudioFifoSize - 1)] = data;
 }
@@ -0,0 +1,181 @@
+/*
+ * TUXAUDIO - Firmware for the 'audio' CPU of tuxdroid
+ * Copyright (C) 2007 C2ME S.A. <tuxdroid@c2me.be>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* $Id$ */
+
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+#include "varis.h"
+#include "communication.h"
+#include "hardware.h"
+#include "spi.h"
+#include "AT26F004.h"
+#include "flash.h"
+#include "toc.h"
+#include "checksum.h"
+#include "common/api.h"
+
+/** CRC-32 of each nibble, reflected polynomial 0xEDB88320. */
+static uint32_t const crc32_nibble[16] PROGMEM = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC,
+    0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C,
+    0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C,
+};
+
+/** Next address to read and end of the bytes. */
+static uint32_t checksum_address, checksum_end;
+/** CRC of the bytes read, not inverted yet. */
+static uint32_t checksum_crc;
+
+/**
+ * \ingroup checksum
+   \brief Add a byte to a CRC-32.
+ */
+static inline uint32_t crc32_update(uint32_t crc, uint8_t data)
+{
+    crc ^= data;
+    crc = (crc >> 4) ^ pgm_read_dword(&crc32_nibble[crc & 0x0F]);
+    crc = (crc >> 4) ^ pgm_read_dword(&crc32_nibble[crc & 0x0F]);
+    return crc;
+}
+
+/**
+ * \ingroup checksum
+   \brief Return the address of a TOC entry, without the codec flags.
+ */
+static uint32_t entry_address(uint8_t const *entry)
+{
+    return ((uint32_t)(entry[0] & TOC_ADDR_MK) << 16) |
+        ((uint16_t)entry[1] << 8) | entry[2];
+}
+
+/**
+ * \ingroup checksum
+   \brief Find the bytes of the sound or of the blocks requested.
+
+   Nothing is read if they don't exist, checksum_address is then left at
+   checksum_end.
+ */
+static void checksum_bytes(void)
+{
+    uint8_t entry[3];
+
+    checksum_address = checksum_end = 0;
+    if (checksumFlag == CHECKSUM_SOUND_FLAG)
+    {
+        if (!checksum_first || checksum_first > numSound)
+            return;
+        /* Sounds start at the block following the previous one, the first
+         * one at entry 0. */
+        toc_entry(checksum_first - 1, entry);
+        checksum_address = entry_address(entry);
+        if (checksum_first > 1)
+            checksum_address = ((checksum_address >> 12) + 1) << 12;
+        toc_entry(checksum_first, entry);
+        checksum_end = entry_address(entry);
+    }
+    else
+    {
+        checksum_address = (uint32_t)checksum_first << 12;
+        checksum_end = checksum_address +
+            ((uint32_t)checksum_blocks << 12);
+    }
+    /* Don't read outside the flash. */
+    if (checksum_end > checksum_address &&
+        ((checksum_end - 1) >> 16) > flash_top)
+        checksum_end = checksum_address;
+}
+
+/**
+ * \ingroup checksum
+   \brief Compute the CRC of a sound or of blocks of the flash, see
+   CRC_SOUND_CMD.
+
+   This function contain 3 states :
+
+   CHECKSUM_START : Find the bytes to read, CRC_NONE is sent if there are
+   none.
+
+   CHECKSUM_READ : Read the bytes until the RF needs the SPI.
+
+   CHECKSUM_END : Send the CRC with STATUS_FLASH_CRC_CMD.
+*/
+void checksum(void)
+{
+    uint8_t static checksum_state = CHECKSUM_START;
+
+    if (checksum_state == CHECKSUM_START)
+    {
+        /* Wait for a sound stopped by the command. */
+        playWait();
+        checksum_bytes();
+        if (checksum_address >= checksum_end)
+        {
+            queue_rf_cmd_p(STATUS_FLASH_CRC_CMD, CRC_NONE, 0, 0);
+            checksumFlag = 0;
+            return;
+        }
+        checksum_crc = 0xFFFFFFFF;
+        checksum_state ++;
+    }
+    else if (checksum_state == CHECKSUM_READ)
+    {
+        uint32_t crc = checksum_crc;
+        uint16_t len, left;
+
+        /* A block may still be erased or a byte programmed. */
+        if (read_status() & BUSY)
+            return;
+        if (checksum_end - checksum_address > 0xFFFF)
+            len = 0xFFFF;
+        else
+            len = checksum_end - checksum_address;
+        left = len;
+
+        SPSR |= _BV(SPI2X);
+        flash_select();
+        spiSend(READ_ARRAY_LOW_F);
+        spiSend(checksum_address >> 16);
+        spiSend(checksum_address >> 8);
+        spiSend(checksum_address);
+        while (!rf_txe && left)
+        {
+            crc = crc32_update(crc, spiSend(NOP));
+            left --;
+        }
+        flash_unselect();
+        SPSR &= ~_BV(SPI2X);
+
+        checksum_crc = crc;
+        checksum_address += len - left;
+        if (checksum_address == checksum_end)
+            checksum_state ++;
+    }
+    else if (checksum_state == CHECKSUM_END)
+    {
+        checksum_crc = ~checksum_crc;
+        queue_rf_cmd_p(STATUS_FLASH_CRC_CMD, CRC_HIGH, checksum_crc >> 24,
+                       checksum_crc >> 16);
+        queue_rf_cmd_p(STATUS_FLASH_CRC_CMD, CRC_LOW, checksum_crc >> 8,
+                       checksum_crc);
+        checksum_state = CHECKSUM_START;
+        checksumFlag = 0;
+    }
+}
@@ -0,0 +1,65 @@
+/*
+ * TUXAUDIO - Firmware for the 'audio' CPU of tuxdroid
+ * Copyright (C) 2007 C2ME S.A. <tuxdroid@c2me.be>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* $Id$ */
+
+/** \defgroup checksum CRC of the flash
+    \ingroup checksum
+
+    CRC_SOUND_CMD and CRC_RANGE_CMD compute the CRC-32 of a stored sound or
+    of 4kB blocks so the computer only writes again the sounds that changed,
+    see tools/bank_sync.
+
+    checksum() is called from the main loop while the RF isn't exchanging a
+    frame. The bytes are read in a single transaction at the doubled SPI
+    clock until the RF needs the SPI, the next call goes on from the
+    following byte. The CRC is computed with a table of 16 entries in the
+    program memory, a byte table wouldn't fit.
+*/
+
+/** \file checksum.h
+    \ingroup checksum
+*/
+/** \file checksum.c
+    \ingroup checksum
+*/
+
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+/** \name Checksum flags
+ * Values of checksumFlag, what checksum_first and checksum_blocks give.
+ * @{ */
+#define CHECKSUM_SOUND_FLAG 1   /**< The sound checksum_first */
+#define CHECKSUM_RANGE_FLAG 2   /**< checksum_blocks from block
+                                  checksum_first */
+/* @} */
+
+/** \name Checksum states
+  @{ */
+enum {
+    CHECKSUM_START = 0,
+    CHECKSUM_READ,
+    CHECKSUM_END,
+};
+/* @} */
+
+extern void checksum(void);
+
+#endif /* CHECKSUM_H */
@@ -287,13 +287,84 @@ typedef enum
 #define AUDIO_MIC_SIZE 17
 
 /* Bits of the config byte */
-#define CFG_CRCOK_MK _BV(0)
+#define CFG_CRCOK_MK _BV(0) /* Set by the RF when the CRC of the radio frame\
+                               was correct. */
 #define CFG_DATA_MK _BV(1)
 #define CFG_AUDIO_MK _BV(2)
 #define CFG_SECBUF_MK _BV(3) /* Inidicates whether the second buffer (previous\
                                 audio) is valid or not. */
 #define CFG_ACK_MK _BV(4)
 #define CFG_WAKEUP_MK _BV(5)
+#define CFG_ADPCM_MK _BV(6) /* Speaker audio is IMA-ADPCM. Set by tuxaudio to\
+                               tell it supports it. */
+#define CFG_BULK_MK _BV(7) /* Bulk frame of a sound to store, see below. */
+
+/** Compressed speaker audio (CFG_ADPCM_MK)
+ *
+ * The audio area starts with the decoder state: the predictor as an unsigned
+ * 8-bit sample and the step index. The encoder should restart from this
+ * rounded state on each frame so a lost frame doesn't desynchronize the
+ * decoder. The following bytes hold 2 codes each, low nibble first, at
+ * 16kHz. Only built with OPT_SPK_ADPCM, see features.h of tuxaudio. */
+#define AUDIO_ADPCM_HDR_SIZE 2
+#define AUDIO_SPK_ADPCM_SAMPLES ((AUDIO_SPK_SIZE - AUDIO_ADPCM_HDR_SIZE) * 2)
+
+/** Bulk frames (CFG_BULK_MK)
+ *
+ * A sound stored with the bulk parameter of STORE_SOUND_CMD is sent with
+ * BULK_SIZE bytes in each frame, everything after the config byte, so no
+ * command can be sent at the same time. The frame index is the sequence
+ * number of the frame, starting at BULK_FIRST_IDX. A frame is only stored if
+ * it follows the last one stored and if there's room for it.
+ *
+ * While storing, the frames of tuxaudio have CFG_BULK_MK set and carry in
+ * the audio area the index of the last bulk frame stored, then the number of
+ * frames that can be sent after it. The frames which are not acked are sent
+ * again, starting at the first one not stored. */
+#define BULK_SIZE (SPI_SIZE - SPI_DATA_OFFSET)
+#define BULK_FIRST_IDX 0
+#define BULK_ACK_OFFSET SPI_AUDIO_OFFSET
+#define BULK_CREDIT_OFFSET (SPI_AUDIO_OFFSET + 1)
+
+/** Packed commands (PACKED_CMDS_CMD)
+ *
+ * Once enabled, the command of a frame is the first of a group flagged and
+ * acked as a whole with CFG_DATA_MK and CFG_ACK_MK. A byte gives the number
+ * of commands following the first one, which are stored right after it.
+ *
+ * The frames of the dongle only carry more commands when CFG_AUDIO_MK and
+ * CFG_BULK_MK are clear, in the audio area at CMD_PACK_IN_OFFSET, so a group
+ * of several commands must be flagged and sent again in frames without audio
+ * until it's acked. tuxaudio acks it once all its commands are taken, the
+ * ones for tuxcore waiting for room in its stack.
+ *
+ * The frames of tuxaudio carry the group after the microphone samples at
+ * CMD_PACK_OUT_OFFSET, with or without audio, so it's sent again as is until
+ * it's acked. */
+#define CMD_PACK_IN_OFFSET SPI_AUDIO_OFFSET
+#define CMD_PACK_IN_MAX ((SPI_SIZE - CMD_PACK_IN_OFFSET - 1) / CMD_SIZE)
+#define CMD_PACK_OUT_OFFSET (SPI_AUDIO_OFFSET + AUDIO_MIC_SIZE)
+#define CMD_PACK_OUT_MAX ((SPI_SIZE - CMD_PACK_OUT_OFFSET - 1) / CMD_SIZE)
+
+/** Windowed commands (WINDOWED_CMDS_CMD)
+ *
+ * Once enabled, the frame index holds 2 sequence numbers. The high nibble is
+ * the number of the command carried when CFG_DATA_MK is set, the commands
+ * packed after it being numbered in a row. The low nibble is the number of
+ * the next command expected from the other side, which acks all the commands
+ * before it. Bulk frames keep their index and carry neither.
+ *
+ * Up to CMD_WINDOW commands can be sent before the oldest one is acked. A
+ * command which doesn't follow the last one taken is dropped, so the sender
+ * goes back to the oldest command not acked once its window is full or it
+ * has nothing new to send.
+ *
+ * CFG_ACK_MK is toggled once by each side when it switches and keeps its
+ * value afterwards, so tuxaudio ignores the frames the dongle sent before
+ * switching. */
+#define CMD_SEQ_MK 0x0F
+#define CMD_SEQ_SHIFT 4
+#define CMD_WINDOW 8
 
 /*! @} */
 
@@ -31,6 +31,10 @@
 #include "varis.h"
 #include "audio_fifo.h"
 #include "micro_fifo.h"
+#include "adpcm.h"
+#include "mixer.h"
+#include "flash.h"
+#include "config.h"
 
 /* I2C write message (out) */
 static uint8_t out_buf[CMD_SIZE];
@@ -45,6 +49,10 @@ static uint8_t *received_cmd = 0;
 #define CORE_OUT_BUF_SIZE    16
 /** Size of the stack buffer to tuxrf */
 #define RF_BUF_SIZE   32
+#if (OPT_CMD_URGENT)
+/** Size of the stack buffer of the urgent commands to tuxrf */
+#define RF_URGENT_SIZE   16
+#endif
 
 FIFO_INSTANCE(core_cmdout_buf, CORE_OUT_BUF_SIZE);
 /** Stack for commands to be sent to tuxcore */
@@ -54,9 +62,53 @@ FIFO_INSTANCE(rf_cmdout_buf_s, RF_BUF_SIZE);
 /** Stack for commands to be sent to rf */
 fifo_t *rf_cmdout_buf = FifoPointer(rf_cmdout_buf_s);
 
-FIFO_INSTANCE(rf_cmdin_buf_s, RF_BUF_SIZE);
-/** Stack for commands received from the rf */
-fifo_t *rf_cmdin_buf = FifoPointer(rf_cmdin_buf_s);
+#if (OPT_CMD_URGENT)
+FIFO_INSTANCE(rf_cmdout_urgent_s, RF_URGENT_SIZE);
+/** Stack for the commands to be sent to rf before the routine status */
+fifo_t *rf_cmdout_urgent = FifoPointer(rf_cmdout_urgent_s);
+#endif
+
+#if (OPT_CMD_WINDOW)
+/* Set by WINDOWED_CMDS_CMD to number the commands, with CFG_ACK_MK in the
+ * frames of the dongle before it switched. */
+static bool cmd_window;
+static uint8_t win_mark;
+/* Number of the next command expected. */
+static uint8_t win_in_next;
+/* Number of the oldest command not acked, the commands sent from it which
+ * are kept at the head of the stacks, and the next one to send. */
+static uint8_t win_out_base, win_out_sent, win_out_pos;
+#if (OPT_CMD_URGENT)
+/* Commands sent which came from rf_cmdout_urgent, bit 0 for the oldest. */
+static uint8_t win_out_urgent;
+#endif
+#else
+/* Each command is acked with the alternating bit. */
+#define cmd_window false
+#endif
+#if (OPT_LINK_STATS)
+/* Counters of the RF link, see STATUS_LINK_CMD, and the ones left to
+ * send. */
+static uint16_t link_stats[LINK_COUNTERS];
+static uint8_t link_stats_left;
+#define link_count(counter, n) (link_stats[counter] += (n))
+/* Frames the last ack took to arrive. The frame at which each command of the
+ * window, or the group in slot 0 with the alternating bit, was first sent,
+ * with its bit set in ack_pending until the ack is timed and in ack_late once
+ * it's counted as sent again. */
+static uint8_t ack_frames = 0xFF;
+#if (OPT_CMD_WINDOW)
+static uint8_t ack_sent_at[CMD_WINDOW];
+#else
+static uint8_t ack_sent_at[1];
+#endif
+static uint8_t ack_pending, ack_late;
+#else
+#define link_count(counter, n)
+#define link_sent(slot)
+#define link_acked(slot)
+#define link_resent(slot, n)
+#endif
 
 
 /**
@@ -94,9 +146,19 @@ static int8_t send_core_cmds(void)
  */
 static void get_core_cmd(void)
 {
-    /* First check if the stack is not full */
+    /* First check if the stacks are not full, the command can go in
+     * both. */
     if (FifoLength(rf_cmdout_buf) > RF_BUF_SIZE - CMD_SIZE)
         return;
+#if (OPT_CMD_URGENT)
+    if (FifoLength(rf_cmdout_urgent) > RF_URGENT_SIZE - CMD_SIZE)
+        return;
+#elif (OPT_CMD_WINDOW)
+    /* Keep room for a reply, the status sent in the window can't be
+     * dropped by drop_status(). */
+    if (cmd_window && FifoLength(rf_cmdout_buf) > RF_BUF_SIZE - 2 * CMD_SIZE)
+        return;
+#endif
 
     if (i2c_get_status() != I2C_BUSY)
     {
@@ -138,14 +200,43 @@ int8_t queue_core_cmd_p(uint8_t cmd, uint8_t param1, uint8_t param2, \
     return queue_core_cmd(c);
 }
 
+#if (OPT_CMD_URGENT)
+/**
+ * \brief Return true for the status sent regularly, the other commands to
+ * the rf are replies or events which go before them.
+ */
+static bool rf_cmd_routine(uint8_t cmd)
+{
+    switch (cmd)
+    {
+    case STATUS_PORTS_CMD:
+    case STATUS_SENSORS1_CMD:
+    case STATUS_LIGHT_CMD:
+    case STATUS_POSITION1_CMD:
+    case STATUS_POSITION2_CMD:
+    case STATUS_BATTERY_CMD:
+    case STATUS_LED_CMD:
+    case STATUS_LINK_CMD:
+        return true;
+    default:
+        return false;
+    }
+}
+#endif
+
 /**
  * \brief Add a command on the stack for the rf
  * \return 0 if the stack is full, 1 if the command has been added
  * successfully.
+ *
+ * The routine status and the other commands have their own stack with
+ * OPT_CMD_URGENT, a command dropped because its stack is full is counted in
+ * the link statistics.
  */
 int8_t queue_rf_cmd(uint8_t const *cmd)
 {
     uint8_t i;
+    fifo_t *fifo = rf_cmdout_buf;
 
     /* Drop command if RF is disconnected, except SLEEP_CMD. */
     if (!(RF_ONLINE_PIN & RF_ONLINE_MK) && cmd[0] != SLEEP_CMD)
@@ -153,14 +244,24 @@ int8_t queue_rf_cmd(uint8_t const *cmd)
         return 0;
     }
 
-    if (FifoLength(rf_cmdout_buf) > RF_BUF_SIZE - CMD_SIZE)
+#if (OPT_CMD_URGENT)
+    if (!rf_cmd_routine(cmd[0]))
+        fifo = rf_cmdout_urgent;
+#endif
+    if (FifoLength(fifo) > FifoSize(fifo) - CMD_SIZE)
+    {
+        if (fifo == rf_cmdout_buf)
+            link_count(LINK_DROPPED, 1);
+        else
+            link_count(LINK_URGENT_DROPPED, 1);
         return 0;
+    }
 
     uint8_t sreg;
     sreg = SREG;
     cli();
     for (i = 0; i < CMD_SIZE; i++)
-        FifoPut(rf_cmdout_buf, cmd[i]);
+        FifoPut(fifo, cmd[i]);
     SREG = sreg;
     return 1;
 }
@@ -201,29 +302,131 @@ void i2c_master_receive_service(struct i2c_msg *msg)
 }
 
 /*
- * Get a set of status commands from the rf_cmdout_buf buffer. The command
- * length will always be CMD_SIZE. Returns '1' if there's nothing to
- * get, '0' otherwise.
+ * Get the next command to send to the RF, the urgent ones first. The command
+ * length will always be CMD_SIZE. Returns '1' if there's nothing to get, '0'
+ * otherwise.
  */
-uint8_t popStatus(uint8_t *command)
+static uint8_t popStatus(uint8_t *command)
 {
+    fifo_t *fifo = rf_cmdout_buf;
     uint8_t i;
 
-    if (!FifoLength(rf_cmdout_buf))
+#if (OPT_CMD_URGENT)
+    if (FifoLength(rf_cmdout_urgent) >= CMD_SIZE)
+        fifo = rf_cmdout_urgent;
+#endif
+    if (FifoLength(fifo) < CMD_SIZE)
         return 1;               /* nothing to do */
 
     cli();                      /* XXX try to disable I2C interrupts instead */
     for (i = 0; i < CMD_SIZE; i++)
-        if (FifoGet(rf_cmdout_buf, &command[i]))
-        {
-            sei();
-            return 1; /* fifo corrupted so drop data XXX add some debug
-                         feedback on this instead of dropping data */
-        }
+        FifoGet(fifo, &command[i]);
     sei();
     return 0;
 }
 
+#if (!OPT_CMD_URGENT)
+/**
+ * \brief Drop a status to the RF to make room for a reply, they share
+ * rf_cmdout_buf.
+ *
+ * The oldest status is dropped, or the last one queued when the window is
+ * used as the first ones may be sent already.
+ */
+void drop_status(void)
+{
+    uint8_t status[CMD_SIZE];
+
+#if (OPT_CMD_WINDOW)
+    if (cmd_window)
+    {
+        cli();
+        if (FifoLength(rf_cmdout_buf) > win_out_sent * CMD_SIZE)
+            FifoKeep_inl(rf_cmdout_buf,
+                         FifoLength(rf_cmdout_buf) - CMD_SIZE);
+        sei();
+        return;
+    }
+#endif
+    popStatus(status);
+}
+#endif
+
+/*
+ * Number of commands waiting to be sent to the RF or to be acked.
+ */
+static uint8_t rf_cmds_queued(void)
+{
+#if (OPT_CMD_URGENT)
+    return (FifoLength(rf_cmdout_urgent) + FifoLength(rf_cmdout_buf)) /
+        CMD_SIZE;
+#else
+    return FifoLength(rf_cmdout_buf) / CMD_SIZE;
+#endif
+}
+
+#if (OPT_CMD_WINDOW && OPT_CMD_URGENT)
+/*
+ * Number of commands of the window which came from rf_cmdout_urgent, among
+ * the first ones sent.
+ */
+static uint8_t win_urgent_before(uint8_t count)
+{
+    uint8_t mask = win_out_urgent;
+    uint8_t urgent = 0;
+
+    while (count--)
+    {
+        urgent += mask & 1;
+        mask >>= 1;
+    }
+    return urgent;
+}
+#elif (OPT_CMD_WINDOW)
+/* All the commands come from rf_cmdout_buf. */
+#define win_urgent_before(count) 0
+#endif
+
+#if (OPT_LINK_STATS)
+/*
+ * Time a command sent for the first time with the frames counted by
+ * LINK_FRAMES, the low byte is enough.
+ */
+static void link_sent(uint8_t slot)
+{
+    ack_sent_at[slot] = link_stats[LINK_FRAMES];
+    ack_pending |= _BV(slot);
+    ack_late &= ~_BV(slot);
+}
+
+/*
+ * Keep the frames taken by the ack of a command since it was first sent, a
+ * command sent again before as many frames went by was only waiting for it.
+ */
+static void link_acked(uint8_t slot)
+{
+    if (ack_pending & _BV(slot))
+    {
+        ack_frames = link_stats[LINK_FRAMES] - ack_sent_at[slot];
+        ack_pending &= ~_BV(slot);
+    }
+}
+
+/*
+ * Count the commands sent again once their ack is late, a frame later than
+ * the previous one to allow for the jitter of the frames.
+ */
+static void link_resent(uint8_t slot, uint8_t n)
+{
+    if (!(ack_late & _BV(slot)) &&
+        (uint8_t)(link_stats[LINK_FRAMES] - ack_sent_at[slot]) > ack_frames)
+    {
+        link_stats[LINK_CMDS_RESENT] += n;
+        ack_late |= _BV(slot);
+    }
+}
+#endif
+
 /**
  * \brief Initialize the I2C communication and the in and out buffers.
  */
@@ -243,18 +446,62 @@ void communication_init(void)
 
 static uint8_t frame_in_idx, frame_out_idx;
 static uint8_t spi_in[52], spi_out[52], spi_idx;
+static uint8_t config_out;
 static bool rf_spi_request;
 static bool rf_cmdout_sent;
+#if (OPT_SPK_ADPCM)
+/* Decoder of the compressed speaker stream. */
+static struct adpcm_state spk_adpcm;
+#endif
+#if (OPT_BULK)
+/* Set while bulk frames are stored, with the index of the last one. */
+static bool bulk_on;
+static uint8_t bulk_idx;
+#else
+#define bulk_on false
+#endif
+#if (OPT_CMD_PACK)
+/* Set by PACKED_CMDS_CMD to send and receive groups of commands. */
+static bool cmd_pack;
+#else
+/* A single command in each frame. */
+#define cmd_pack false
+#endif
+#if (OPT_LINK_STATS)
+/* Index of the last frame received, and CFG_BULK_MK if it was a bulk frame or
+ * LINK_IDX_NONE if it wasn't numbered. */
+#define LINK_IDX_NONE 0xFF
+static uint8_t link_in_idx, link_in_kind = LINK_IDX_NONE;
+#endif
+/* Commands of the group received already taken, it's acked once all are. */
+static uint8_t cmd_in_done;
 
 /*
  * Initialize (clear) the communication buffers
  */
 void initCommunicationBuffers(void)
 {
+#if (OPT_CMD_WINDOW)
+    uint8_t urgent = win_urgent_before(win_out_sent);
+
     FifoClear(core_cmdout);
+    /* The commands of the window have their numbers already. */
+#if (OPT_CMD_URGENT)
+    FifoKeep_inl(rf_cmdout_urgent, urgent * CMD_SIZE);
+#endif
+    FifoKeep_inl(rf_cmdout_buf, (win_out_sent - urgent) * CMD_SIZE);
+#else
+    FifoClear(core_cmdout);
+#if (OPT_CMD_URGENT)
+    FifoClear(rf_cmdout_urgent);
+#endif
     FifoClear(rf_cmdout_buf);
+#endif
     /* Necessary to clear the outgoing command, especially after sleep. */
     spi_out[SPI_DATA_OFFSET] = 0;
+#if (OPT_CMD_PACK)
+    spi_out[CMD_PACK_OUT_OFFSET] = 0;
+#endif
 }
 
 /* INT1 (PD3) Interrupt on TXE signal. */
@@ -272,6 +519,9 @@ void start_rf_spi(void)
         //PORTB |= 0x80; // XXX DEBUG
     spi_idx = 0;
 
+    /* The flash is put on hold in the middle of a sound, wait for the byte
+     * being read. */
+    playWait();
     flash_onhold();
     rf_select();
     SPDR = spi_out[spi_idx];
@@ -311,16 +561,153 @@ ISR(INT0_vect) /* Mise 
     //PORTB &= ~0x80; // XXX DEBUG
 }
 
+/**
+ * \brief Return a speaker sample of the RF stream to push in the audio fifo.
+ *
+ * The stream is mixed with the flash sound, except when it's a sound to store
+ * in the flash.
+ */
+static inline uint8_t spk_sample(uint8_t sample)
+{
+    if (programmingFlash)
+        return sample;
+    return mixer_rf(sample);
+}
+
+#if (OPT_MIC_VAD)
+/**
+ * \brief Voice activity detection of the microphone.
+ * \param samples Microphone samples of the frame.
+ * \return True if the samples should be sent.
+ *
+ * The activity is the mean absolute difference between consecutive samples,
+ * which isn't sensitive to the offset of the microphone. The audio is still
+ * sent for vad_hangover frames once the activity dropped below the threshold
+ * to avoid cutting the end of the words.
+ */
+static bool mic_activity(uint8_t const *samples)
+{
+    static uint8_t prev;
+    static uint8_t hangover;
+    uint16_t activity = 0;
+    uint8_t i;
+
+    if (!tuxaudio_config.vad_threshold)
+        return true;
+
+    for (i=0; i<AUDIO_MIC_SIZE; i++)
+    {
+        uint8_t s = samples[i];
+        activity += (s > prev) ? s - prev : prev - s;
+        prev = s;
+    }
+    if ((activity >> 4) >= tuxaudio_config.vad_threshold)
+    {
+        hangover = tuxaudio_config.vad_hangover;
+        return true;
+    }
+    if (hangover)
+    {
+        hangover--;
+        return true;
+    }
+    return false;
+}
+#else
+#define mic_activity(samples) true
+#endif
+
+/**
+ * \name Speaker rate controller
+ *
+ * The speaker sampling rate follows the rate of the RF stream with a
+ * proportional-integral controller on the length of the audio fifo, measured
+ * each time a frame is received. The output is the TOP of timer0 (OCR0A) in
+ * 1/256 units, its fraction is dithered over the frames.
+ *
+ * The slope based controller used previously can still be built with
+ * AUDIO_RATE_LEGACY defined, for comparison in the simulation.
+ * @{ */
+/** Fifo length targeted before the samples of a frame are added, half of the
+ * fifo to ride through lost frames. */
+#define RATE_TARGET (AudioFifoCapacity / 2)
+/** Proportional gain, in 1/256 of OCR0A per sample of error. */
+#define RATE_KP 20
+/** Integral gain as a right shift of the sum of the errors. */
+#define RATE_KI_SHIFT 3
+/** Nominal TOP of timer0, 8MHz/2/(249+1) is 16kHz. */
+#define RATE_TOP_NOMINAL 249
+/** Limits of the TOP to avoid oscillations when a lot of frames are dropped
+ * and to prevent jumping over 255. */
+#define RATE_TOP_MIN 240
+#define RATE_TOP_MAX 254
+/*! @} */
+
+#if (OPT_RATE_REQ)
+/** Fifo length measured at the last frame. */
+static uint8_t rate_fill;
+#endif
+/** Sum of the fifo length errors. */
+static int16_t rate_integ;
+
+#ifndef AUDIO_RATE_LEGACY
+/** Accumulated fraction of the TOP. */
+static uint8_t rate_dither;
+
+/**
+ * \brief Adapt the audio output rate to keep the fifo at the target level.
+ */
+static void adapt_audio_rate(void)
+{
+    uint8_t fill = AudioFifoLength();
+    int16_t error;
+    int16_t corr;
+    uint16_t top;
+    uint8_t frac;
+
+#if (OPT_RATE_REQ)
+    rate_fill = fill;
+#endif
+    error = fill - RATE_TARGET;
+    rate_integ += error;
+    corr = error * RATE_KP + (rate_integ >> RATE_KI_SHIFT);
+
+    /* Stop integrating when the output saturates. */
+    if (corr > (RATE_TOP_NOMINAL - RATE_TOP_MIN) << 8)
+    {
+        corr = (RATE_TOP_NOMINAL - RATE_TOP_MIN) << 8;
+        if (error > 0)
+            rate_integ -= error;
+    }
+    else if (corr < -((RATE_TOP_MAX - RATE_TOP_NOMINAL) << 8))
+    {
+        corr = -((RATE_TOP_MAX - RATE_TOP_NOMINAL) << 8);
+        if (error < 0)
+            rate_integ -= error;
+    }
+
+    /* A fuller fifo needs a faster rate, thus a lower TOP. */
+    top = (RATE_TOP_NOMINAL << 8) - corr;
+    frac = top;
+    OCR0A = top >> 8;
+    if ((uint8_t)(rate_dither + frac) < rate_dither)
+        OCR0A++;
+    rate_dither += frac;
+}
+#else
 /**
  * \brief Adapt the audio output rate to keep the stack at a mean level.
  */
-void adapt_audio_rate(void)
+static void adapt_audio_rate(void)
 {
     static uint8_t prescaler = 0;
     uint8_t static prev_stack_length = 0;
     uint8_t stack_length = AudioFifoLength();
     bool slope = 0;
 
+#if (OPT_RATE_REQ)
+    rate_fill = stack_length;
+#endif
     if (++prescaler == 0)
     {
         prescaler = 127;
@@ -333,19 +720,306 @@ void adapt_audio_rate(void)
         if (!slope && stack_length < 70)
             OCR0A++;
 
-        /* Limits to avoid oscillations when a lot of frames are
-         * dropped and to prevent jumping over 255. */
-        if (OCR0A > 254)
-            OCR0A = 254;
-        if (OCR0A < 240)
-            OCR0A = 240;
+        if (OCR0A > RATE_TOP_MAX)
+            OCR0A = RATE_TOP_MAX;
+        if (OCR0A < RATE_TOP_MIN)
+            OCR0A = RATE_TOP_MIN;
     }
 }
+#endif
+
+#if (OPT_RATE_REQ)
+/**
+ * \brief Send the state of the speaker rate controller.
+ */
+void send_audio_rate(void)
+{
+    queue_rf_cmd_p(STATUS_AUDIO_RATE_CMD, rate_fill, OCR0A, rate_integ >> 8);
+}
+#endif
+
+#if (OPT_LINK_STATS)
+/**
+ * \brief Send the counters of the RF link, from communication_task() as
+ * there's room for them.
+ */
+void send_link_stats(void)
+{
+    link_stats_left = LINK_COUNTERS;
+}
+#endif
+
+#if (OPT_BULK)
+/**
+ * \brief Start accepting bulk frames, the first one having the index
+ * BULK_FIRST_IDX.
+ */
+void bulk_start(void)
+{
+    bulk_idx = BULK_FIRST_IDX - 1;
+    bulk_on = true;
+}
+
+/**
+ * \brief Stop accepting bulk frames.
+ */
+void bulk_stop(void)
+{
+    bulk_on = false;
+}
+
+/**
+ * \brief Push the bytes of a bulk frame in the audio fifo if it follows the
+ * last one stored and if there's room for it.
+ */
+static void bulk_frame(void)
+{
+    uint8_t i;
+
+    if (!bulk_on || spi_in[SPI_IDX_OFFSET] != (uint8_t)(bulk_idx + 1) ||
+        AudioFifoCapacity - AudioFifoLength() < BULK_SIZE)
+        return;
+    bulk_idx++;
+    for (i=SPI_DATA_OFFSET; i<SPI_SIZE; i++)
+        AudioFifoPut_inl(spi_in[i]);
+}
+#else
+#define bulk_frame()
+#endif
+
+#if (OPT_CMD_PACK)
+/**
+ * \brief Send and receive groups of commands, see PACKED_CMDS_CMD.
+ */
+void cmd_pack_set(bool on)
+{
+    cmd_pack = on;
+}
+#endif
+
+/**
+ * \brief Take the group of commands of the frame received.
+ * \return True once all of them have been parsed or queued for tuxcore.
+ *
+ * A command for tuxcore waits for room in its stack, the group is taken again
+ * from the next frame which carries it, after the commands already taken.
+ */
+static bool cmds_in(uint8_t config_in)
+{
+    uint8_t count = 1;
+    uint8_t *cmd;
+
+    if (cmd_pack && !(config_in & CFG_AUDIO_MK) &&
+        spi_in[CMD_PACK_IN_OFFSET] <= CMD_PACK_IN_MAX)
+        count += spi_in[CMD_PACK_IN_OFFSET];
+    /* The rest of a group started is only in the frames without audio. */
+    else if (cmd_in_done)
+        return false;
+    while (cmd_in_done < count)
+    {
+        if (FifoLength(core_cmdout) > FifoSize(core_cmdout) - CMD_SIZE)
+            return false;
+        if (cmd_in_done)
+            cmd = &spi_in[CMD_PACK_IN_OFFSET + 1 +
+                          (cmd_in_done - 1) * CMD_SIZE];
+        else
+            cmd = &spi_in[SPI_DATA_OFFSET];
+#if (OPT_CMD_WINDOW)
+        /* The window starts with no command of tuxaudio waiting for its
+         * ack, which is in this frame otherwise. */
+        if (cmd[0] == WINDOWED_CMDS_CMD &&
+            (!(config_out & CFG_DATA_MK)) != (!(config_in & CFG_ACK_MK)))
+            return false;
+#endif
+        /* Parse the command and forward to tuxcore if it isn't dropped. */
+        if (!parse_cmd(cmd))
+            queue_core_cmd(cmd);
+        cmd_in_done++;
+    }
+    cmd_in_done = 0;
+    return true;
+}
+
+/**
+ * \brief Put the next group of commands in the frame to send.
+ *
+ * The commands following the first one stay in the frame after the
+ * microphone samples until the group is acked.
+ */
+static void cmds_out(void)
+{
+    uint8_t count = 0;
+
+    popStatus(&spi_out[SPI_DATA_OFFSET]);
+    if (!cmd_pack)
+        return;
+    while (count < CMD_PACK_OUT_MAX &&
+           !popStatus(&spi_out[CMD_PACK_OUT_OFFSET + 1 + count * CMD_SIZE]))
+        count++;
+    spi_out[CMD_PACK_OUT_OFFSET] = count;
+}
+
+#if (OPT_CMD_WINDOW)
+/**
+ * \brief Number the commands and ack them with a window, see
+ * WINDOWED_CMDS_CMD.
+ *
+ * Called while the frame which carries the command is taken, its ack is the
+ * last one sent with the alternating bit.
+ */
+void cmd_window_start(void)
+{
+    if (cmd_window)
+        return;
+    cmd_window = true;
+    win_mark = (config_out & CFG_DATA_MK) ? CFG_ACK_MK : 0;
+    win_in_next = 0;
+    win_out_base = 0;
+    win_out_sent = 0;
+    win_out_pos = 0;
+#if (OPT_CMD_URGENT)
+    win_out_urgent = 0;
+#endif
+}
+
+/**
+ * \brief Take the ack and the commands of a frame received in the window.
+ *
+ * The commands already taken are skipped, the ones for tuxcore wait for room
+ * in its stack and are taken again from the next frame which carries them.
+ */
+static void window_in(uint8_t config_in)
+{
+    uint8_t idx = spi_in[SPI_IDX_OFFSET];
+    uint8_t acked = (idx - win_out_base) & CMD_SEQ_MK;
+    uint8_t count = 1;
+    uint8_t i;
+    uint8_t *cmd;
+
+    /* Drop the commands acked. */
+    if (acked <= win_out_sent)
+    {
+        uint8_t urgent = win_urgent_before(acked);
+
+        if (acked)
+            link_acked((win_out_base + acked - 1) & (CMD_WINDOW - 1));
+#if (OPT_CMD_URGENT)
+        FifoSkip_inl(rf_cmdout_urgent, urgent * CMD_SIZE);
+        win_out_urgent >>= acked;
+#endif
+        FifoSkip_inl(rf_cmdout_buf, (acked - urgent) * CMD_SIZE);
+        win_out_base = idx & CMD_SEQ_MK;
+        win_out_sent -= acked;
+        win_out_pos = (win_out_pos > acked) ? win_out_pos - acked : 0;
+    }
+
+    if (!(config_in & CFG_DATA_MK))
+        return;
+    if (cmd_pack && !(config_in & CFG_AUDIO_MK) &&
+        spi_in[CMD_PACK_IN_OFFSET] < CMD_WINDOW)
+        count += spi_in[CMD_PACK_IN_OFFSET];
+    /* A command after the next one expected gives a large offset. */
+    for (i = (win_in_next - (idx >> CMD_SEQ_SHIFT)) & CMD_SEQ_MK; i < count;
+         i++)
+    {
+        if (FifoLength(core_cmdout) > FifoSize(core_cmdout) - CMD_SIZE)
+            return;
+        if (i)
+            cmd = &spi_in[CMD_PACK_IN_OFFSET + 1 + (i - 1) * CMD_SIZE];
+        else
+            cmd = &spi_in[SPI_DATA_OFFSET];
+        if (!parse_cmd(cmd))
+            queue_core_cmd(cmd);
+        win_in_next = (win_in_next + 1) & CMD_SEQ_MK;
+    }
+}
+
+/**
+ * \brief Copy a command of the window.
+ * \param k Position of the command from the oldest one not acked.
+ * \param cmd Where to copy the command.
+ *
+ * A command not sent yet is taken from rf_cmdout_urgent first.
+ */
+static void window_cmd(uint8_t k, uint8_t *cmd)
+{
+    uint8_t urgent = win_urgent_before(k);
+    fifo_t *fifo = rf_cmdout_buf;
+    uint8_t offset = k - urgent;
+    uint8_t i;
+
+#if (OPT_CMD_URGENT)
+    if ((k < win_out_sent) ? (win_out_urgent & _BV(k)) :
+        (FifoLength(rf_cmdout_urgent) > urgent * CMD_SIZE))
+    {
+        fifo = rf_cmdout_urgent;
+        offset = urgent;
+        win_out_urgent |= _BV(k);
+    }
+    else
+    {
+        win_out_urgent &= ~_BV(k);
+    }
+#endif
+    for (i=0; i<CMD_SIZE; i++)
+        cmd[i] = FifoPeek_inl(fifo, offset * CMD_SIZE + i);
+#if (OPT_LINK_STATS)
+    if (k < win_out_sent)
+        link_resent((win_out_base + k) & (CMD_WINDOW - 1), 1);
+    else
+        link_sent((win_out_base + k) & (CMD_WINDOW - 1));
+#endif
+}
+
+/**
+ * \brief Put the next commands of the window and the ack in the frame to
+ * send.
+ *
+ * The new commands are sent first, then the ones not acked again from the
+ * oldest.
+ */
+static void window_out(void)
+{
+    uint8_t queued = rf_cmds_queued();
+    uint8_t count;
+    uint8_t i;
+
+    if (queued > CMD_WINDOW)
+        queued = CMD_WINDOW;
+    if (win_out_pos >= queued)
+        win_out_pos = 0;
+    count = queued - win_out_pos;
+    if (count > (cmd_pack ? 1 + CMD_PACK_OUT_MAX : 1))
+        count = cmd_pack ? 1 + CMD_PACK_OUT_MAX : 1;
+
+    spi_out[SPI_IDX_OFFSET] =
+        (((win_out_base + win_out_pos) & CMD_SEQ_MK) << CMD_SEQ_SHIFT) |
+        win_in_next;
+    if (!count)
+    {
+        config_out &= ~CFG_DATA_MK;
+        return;
+    }
+    config_out |= CFG_DATA_MK;
+    rf_cmdout_sent = false;
+    window_cmd(win_out_pos, &spi_out[SPI_DATA_OFFSET]);
+    for (i=1; i<count; i++)
+    {
+        window_cmd(win_out_pos + i,
+                   &spi_out[CMD_PACK_OUT_OFFSET + 1 + (i - 1) * CMD_SIZE]);
+    }
+    if (cmd_pack)
+        spi_out[CMD_PACK_OUT_OFFSET] = count - 1;
+    win_out_pos += count;
+    if (win_out_pos > win_out_sent)
+        win_out_sent = win_out_pos;
+}
+#endif
 
 bool cmds_sent(void)
 {
     return (!FifoLength(core_cmdout) && (i2c_get_status() != I2C_BUSY) &&
-            !FifoLength(rf_cmdout_buf) && rf_cmdout_sent);
+            !rf_cmds_queued() && rf_cmdout_sent);
 }
 
 /**
@@ -364,43 +1038,117 @@ void communication_task(void)
     if (spi_idx >= SPI_SIZE)
     {
         uint8_t config_in;
-        static uint8_t config_out;
         uint8_t i;
 
         spi_idx = 0;
         config_in = spi_in[SPI_CONFIG_OFFSET];
 
+#if (OPT_LINK_STATS)
+        link_stats[LINK_FRAMES]++;
+        if (!(config_in & CFG_CRCOK_MK))
+            link_stats[LINK_CRC_ERRORS]++;
+        /* The index numbers the frames and the bulk frames apart, the
+         * frames aren't numbered in the window. The dongle goes back to
+         * the first bulk frame not acked, it's not a loss. */
+        if (link_in_kind == (config_in & CFG_BULK_MK))
+        {
+            uint8_t gap = spi_in[SPI_IDX_OFFSET] - link_in_idx;
+
+            if (!gap)
+                link_stats[LINK_REPEATED]++;
+            else if (!link_in_kind || gap < 0x80)
+                link_stats[LINK_LOST] += gap - 1;
+        }
+        link_in_idx = spi_in[SPI_IDX_OFFSET];
+        link_in_kind = config_in & CFG_BULK_MK;
+        if (cmd_window && !link_in_kind)
+            link_in_kind = LINK_IDX_NONE;
+#endif
+
+#if (OPT_CMD_WINDOW)
+        /* Go back to the alternating bit when the dongle is lost. */
+        if (cmd_window && !(RF_ONLINE_PIN & RF_ONLINE_MK))
+        {
+            cmd_window = false;
+            win_out_sent = 0;
+#if (OPT_CMD_URGENT)
+            win_out_urgent = 0;
+#endif
+        }
+#endif
+
         /* Incoming data */
+#if (OPT_CMD_WINDOW)
+        if (cmd_window)
+        {
+            if (!(config_in & CFG_BULK_MK) &&
+                (config_in & CFG_ACK_MK) != win_mark)
+                window_in(config_in);
+        }
+        else
+#endif
         if (frame_in_idx != spi_in[SPI_IDX_OFFSET])
         {
             //PORTB |= 0x80; // XXX DEBUG
             frame_in_idx = spi_in[SPI_IDX_OFFSET];
-            if ((!(config_in & CFG_DATA_MK)) != (!(config_out & CFG_ACK_MK)))
+            /* Bulk frames don't carry commands. */
+            if (!(config_in & CFG_BULK_MK) &&
+                (!(config_in & CFG_DATA_MK)) != (!(config_out & CFG_ACK_MK)) &&
+                cmds_in(config_in))
             {
-                /* Parse the command and forward to tuxcore if it isn't
-                 * dropped. */
-                uint8_t *cmd = &spi_in[SPI_DATA_OFFSET];
-                if (!parse_cmd(cmd))
-                    queue_core_cmd(cmd);
                 /* Ack the data by toggling the bit */
                 config_out ^= CFG_ACK_MK;
             }
         }
         //else
             //PORTB |= 0x80; // XXX DEBUG
-        if (config_in & CFG_AUDIO_MK && !flashPlay)
+        if (config_in & CFG_BULK_MK)
+        {
+            bulk_frame();
+        }
+        /* Without the mixer, the stream is held back during a flash sound. */
+        else if ((config_in & CFG_AUDIO_MK) && (OPT_MIXER || !flashPlay))
         {
+            /* The fifo ran empty since the last frame of the stream. */
+            if (mixer_rf_active && !AudioFifoLength())
+                link_count(LINK_UNDERRUNS, 1);
+            mixer_rf_active = MIXER_RF_TIMEOUT;
+            /* A sound played from the flash is mixed with the stream. */
+            if (flashPlay && !mixer_flash)
+                mixer_start();
             adapt_audio_rate();
+            AudioHalfRate = 0;
 
-            for (i=0; i<AUDIO_SPK_SIZE; i++)
+#if (OPT_SPK_ADPCM)
+            if (config_in & CFG_ADPCM_MK)
+            {
+                uint8_t *audio = &spi_in[SPI_AUDIO_OFFSET];
+
+                /* Each frame carries the decoder state. */
+                adpcm_set(&spk_adpcm, audio[0], audio[1]);
+                for (i=AUDIO_ADPCM_HDR_SIZE; i<AUDIO_SPK_SIZE; i++)
+                {
+                    AudioFifoPut_inl(spk_sample(adpcm_decode(&spk_adpcm,
+                                                             audio[i])));
+                    AudioFifoPut_inl(spk_sample(adpcm_decode(&spk_adpcm,
+                                                             audio[i] >> 4)));
+                }
+            }
+            else
+#endif
             {
-                AudioFifoPut_inl(spi_in[i+SPI_AUDIO_OFFSET]);
+                for (i=0; i<AUDIO_SPK_SIZE; i++)
+                {
+                    AudioFifoPut_inl(spk_sample(spi_in[i+SPI_AUDIO_OFFSET]));
+                }
             }
         }
         else
         {
             if (frame_without_sound)
                 frame_without_sound --;
+            if (mixer_rf_active && !--mixer_rf_active)
+                mixer_stop();
         }
 
         /* DEBUG VERSION
@@ -432,33 +1180,88 @@ void communication_task(void)
         /*PORTB ^= 0x80; // XXX DEBUG*/
 
         /* Outgoing data, add commands and/or audio. */
-        spi_out[SPI_IDX_OFFSET] = frame_out_idx++;
-        if ((!(config_out & CFG_DATA_MK)) == (!(config_in & CFG_ACK_MK)) &&
-            FifoLength(rf_cmdout_buf) >= CMD_SIZE)
+#if (OPT_CMD_WINDOW)
+        if (cmd_window)
         {
-            config_out ^= CFG_DATA_MK;
-            rf_cmdout_sent = false;
-            for (i=0; i<CMD_SIZE; i++)
+            window_out();
+        }
+        else
+#endif
+        {
+            /* Set once the last group sent is acked. */
+            bool acked = (!(config_out & CFG_DATA_MK)) ==
+                (!(config_in & CFG_ACK_MK));
+
+            spi_out[SPI_IDX_OFFSET] = frame_out_idx++;
+            if (acked)
+                link_acked(0);
+            if (acked && rf_cmds_queued())
             {
-                FifoGet(rf_cmdout_buf, &spi_out[i+SPI_DATA_OFFSET]);
+                config_out ^= CFG_DATA_MK;
+                rf_cmdout_sent = false;
+                cmds_out();
+                link_sent(0);
             }
+            else if (!acked)
+            {
+                /* The group not acked is sent again in this frame. */
+                link_resent(0, cmd_pack ? 1 + spi_out[CMD_PACK_OUT_OFFSET] : 1);
+            }
+        }
+#if (OPT_BULK)
+        if (bulk_on)
+        {
+            /* Ack the bulk frames instead of sending the microphone. */
+            spi_out[BULK_ACK_OFFSET] = bulk_idx;
+            spi_out[BULK_CREDIT_OFFSET] =
+                (AudioFifoCapacity - AudioFifoLength()) / BULK_SIZE;
+            config_out &= ~CFG_AUDIO_MK;
+            config_out |= CFG_BULK_MK;
         }
+        else
+#endif
         if (MicroFifoLength() >= AUDIO_MIC_SIZE)
         {
-            config_out |= CFG_AUDIO_MK;
             for (i=0; i<AUDIO_MIC_SIZE; i++)
             {
                 MicroFifoGet_inl(&spi_out[i+SPI_AUDIO_OFFSET]);
             }
+            /* Silent frames are sent without audio. */
+            if (mic_activity(&spi_out[SPI_AUDIO_OFFSET]))
+                config_out |= CFG_AUDIO_MK;
+            else
+                config_out &= ~CFG_AUDIO_MK;
         }
         else
         {
             config_out &= ~CFG_AUDIO_MK;
         }
+        if (!bulk_on)
+            config_out &= ~CFG_BULK_MK;
+#if (OPT_SPK_ADPCM)
+        /* Advertise the compressed speaker stream. */
+        spi_out[SPI_CONFIG_OFFSET] = config_out | CFG_ADPCM_MK;
+#else
         spi_out[SPI_CONFIG_OFFSET] = config_out;
+#endif
         rf_txe = false;
     }
 
+#if (OPT_LINK_STATS)
+    /* The link counters take the room in the stack before the status of
+     * tuxcore. */
+    while (link_stats_left &&
+           FifoLength(rf_cmdout_buf) <= RF_BUF_SIZE - CMD_SIZE)
+    {
+        uint8_t i = LINK_COUNTERS - link_stats_left--;
+
+        /* The frames aren't numbered in the window. */
+        if (i == LINK_LOST && cmd_window)
+            continue;
+        queue_rf_cmd_p(STATUS_LINK_CMD, i, link_stats[i] >> 8, link_stats[i]);
+    }
+#endif
+
     /* If busy, pass. */
     if (i2c_get_status() == I2C_BUSY)
         return;
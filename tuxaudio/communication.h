@@ -27,10 +27,33 @@
 #include "common/commands.h"
 #include "common/api.h"
 #include "common/defines.h"
+#include "features.h"
 
 void communication_init(void);
 void communication_task(void);
 bool cmds_sent(void);
+#if (OPT_RATE_REQ)
+void send_audio_rate(void);
+#endif
+#if (OPT_LINK_STATS)
+void send_link_stats(void);
+#endif
+#if (OPT_BULK)
+void bulk_start(void);
+void bulk_stop(void);
+#else
+#define bulk_start()
+#define bulk_stop()
+#endif
+#if (OPT_CMD_PACK)
+void cmd_pack_set(bool on);
+#endif
+#if (OPT_CMD_WINDOW)
+void cmd_window_start(void);
+#endif
+#if (!OPT_CMD_URGENT)
+void drop_status(void);
+#endif
 
 int8_t queue_core_cmd(uint8_t *command);
 int8_t queue_core_cmd_p(uint8_t command, uint8_t param1, uint8_t param2, \
@@ -41,7 +64,5 @@ int8_t queue_rf_cmd_p(uint8_t cmd, uint8_t param1, uint8_t param2, \
 
 /* XXX to remove */
 void initCommunicationBuffers(void);
-/* XXX change this when reviewing the rf communication. */
-uint8_t popStatus(uint8_t * command);
 
 #endif /* COMMUNICATION_H */
@@ -0,0 +1,371 @@
+/*
+ * TUXAUDIO - Firmware for the 'audio' CPU of tuxdroid
+ * Copyright (C) 2007 C2ME S.A. <tuxdroid@c2me.be>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* $Id$ */
+
+#include <avr/io.h>
+#include "varis.h"
+#include "communication.h"
+#include "hardware.h"
+#include "spi.h"
+#include "AT26F004.h"
+#include "flash.h"
+#include "toc.h"
+#include "compact.h"
+#include "common/api.h"
+
+/** Set while a block is being erased. */
+static uint8_t compact_busy;
+/** Set once the block dst points to has been erased. */
+static uint8_t compact_erased;
+/** Copy from src to dst, up to end. */
+static uint32_t src, dst, end;
+/** Blocks the sounds are moved down by. */
+static uint16_t shift;
+/** First and last blocks to erase once the sounds are moved. */
+static uint16_t tail, last;
+/** End of the first sound in block 0 if it has been saved, 0 otherwise. */
+static uint16_t saved;
+/** Set if the TOC has been saved with the start of block 0. */
+static uint8_t toc_saved;
+/** Bytes of the new TOC written. */
+static uint16_t toc_idx;
+
+/**
+ * \ingroup compact
+   \brief Return the address of the TOC entry n, without the codec flag.
+ */
+static uint32_t toc_address(uint16_t n)
+{
+    uint8_t entry[3];
+
+    toc_entry(n, entry);
+    return ((uint32_t)(entry[0] & TOC_ADDR_MK) << 16) |
+        ((uint16_t)entry[1] << 8) | entry[2];
+}
+
+/**
+ * \ingroup compact
+   \brief Return the first block a sound has to itself.
+
+   Sounds start at the block following the previous one, the first sound
+   at entry 0 which may be in block 0 with the TOC.
+ */
+static uint16_t start_block(uint16_t n)
+{
+    if (n == 1)
+        return (toc_address(0) + IMAGE_BLOCK_SIZE - 1) >> 12;
+    else
+        return (toc_address(n - 1) >> 12) + 1;
+}
+
+/**
+ * \ingroup compact
+   \brief Copy entry n of the TOC without the deleted sound.
+ */
+static void toc_new_entry(uint16_t n, uint8_t *entry)
+{
+    uint32_t address;
+
+    if (n == 0)
+    {
+        if (delete_sound > 1)
+            toc_entry(0, entry);
+        else if (numSound > 1)
+        {
+            /* The next sound becomes the first one. */
+            entry[0] = start_block(1) >> 4;
+            entry[1] = start_block(1) << 4;
+            entry[2] = 0;
+        }
+        else
+        {
+            /* Empty flash, as written by erase(). */
+            entry[0] = 0x00;
+            entry[1] = 0x04;
+            entry[2] = 0x00;
+        }
+    }
+    else if (n < delete_sound)
+        toc_entry(n, entry);
+    else
+    {
+        toc_entry(n + 1, entry);
+        address = (((uint32_t)(entry[0] & TOC_ADDR_MK) << 16) |
+                   ((uint16_t)entry[1] << 8) | entry[2]) -
+            ((uint32_t)shift << 12);
+        entry[0] = (entry[0] & ~TOC_ADDR_MK) | (address >> 16);
+        entry[1] = address >> 8;
+        entry[2] = address;
+    }
+}
+
+/**
+ * \ingroup compact
+   \brief Start erasing a block, compact() waits for it.
+ */
+static void compact_erase(uint16_t block)
+{
+    block_erase_start(block);
+    compact_busy = 1;
+}
+
+/**
+ * \ingroup compact
+   \brief Copy chunks from src to dst until the end, the end of the block of
+   dst or an RF frame.
+
+   The destination should be erased.
+ */
+static void compact_copy(void)
+{
+    uint8_t data[COMPACT_CHUNK];
+    uint8_t len, i;
+
+    do
+    {
+        len = COMPACT_CHUNK;
+        if (end - src < len)
+            len = end - src;
+        if (IMAGE_BLOCK_SIZE - (dst & (IMAGE_BLOCK_SIZE - 1)) < len)
+            len = IMAGE_BLOCK_SIZE - (dst & (IMAGE_BLOCK_SIZE - 1));
+
+        flash_select();
+        spiSend(READ_ARRAY_LOW_F);
+        spiSend(src >> 16);
+        spiSend(src >> 8);
+        spiSend(src);
+        for (i = 0; i < len; i++)
+            data[i] = spiSend(NOP);
+        flash_unselect();
+
+        sequ_program_start(dst >> 16, dst >> 8, dst, data[0]);
+        for (i = 1; i < len; i++)
+            sequ_program(data[i]);
+        sequ_program_end();
+
+        src += len;
+        dst += len;
+    } while (!rf_txe && (src != end) && (dst & (IMAGE_BLOCK_SIZE - 1)));
+}
+
+/**
+ * \ingroup compact
+   \brief Delete a sound and move the next ones down, see DELETE_SOUND_CMD.
+
+   This function contain 7 states :
+
+   COMPACT_INIT : Find the blocks to move and the ones freed.
+
+   COMPACT_MOVE : Erase each destination block and copy the sounds into it.
+
+   COMPACT_SAVE : Copy the start of the first sound from block 0 to a freed
+   block, with the TOC if the mirror doesn't hold all of it.
+
+   COMPACT_TOC : Erase block 0 and write the TOC without the deleted sound.
+
+   COMPACT_RESTORE : Copy the start of the first sound back to block 0.
+
+   COMPACT_TAIL : Erase the freed blocks.
+
+   COMPACT_END : Read the new TOC.
+*/
+void compact(void)
+{
+    uint8_t static compact_state = COMPACT_INIT;
+
+    /* Wait for the end of an erase. */
+    if (compact_busy)
+    {
+        if (read_status() & BUSY)
+            return;
+        compact_busy = 0;
+    }
+
+    if (compact_state == COMPACT_INIT)
+    {
+        /* Wait for a sound stopped by the command. */
+        playWait();
+        dst = (uint32_t)start_block(delete_sound) << 12;
+        last = last_block;
+        if (delete_sound < numSound)
+        {
+            src = (uint32_t)start_block(delete_sound + 1) << 12;
+            end = toc_address(numSound);
+            shift = (src - dst) >> 12;
+            tail = last - shift + 1;
+            /* The first sound fits in block 0, nothing to move. */
+            if (!shift)
+                src = end;
+        }
+        else
+        {
+            src = end = 0;
+            shift = 0;
+            tail = dst >> 12;
+        }
+        /* The TOC has to be saved, in the next block if none is freed. */
+        if (numSound > TOC_EE_SOUNDS && tail >= flash_blocks())
+        {
+            queue_rf_cmd_p(STATUS_FLASH_PROG_CMD, FLASH_FULL, 0, 0);
+            compactFlag = 0;
+            return;
+        }
+        compact_erased = 0;
+        compact_state ++;
+    }
+    else if (compact_state == COMPACT_MOVE)
+    {
+        if (src != end)
+        {
+            if (!(dst & (IMAGE_BLOCK_SIZE - 1)) && !compact_erased)
+            {
+                uint16_t blocks = (end - src + IMAGE_BLOCK_SIZE - 1) >> 12;
+
+                queue_rf_cmd_p(STATUS_FLASH_PROG_CMD, COMPACTING,
+                               blocks > 0xFF ? 0xFF : blocks, 0);
+                compact_erase(dst >> 12);
+                compact_erased = 1;
+            }
+            else
+            {
+                compact_copy();
+                if (!(dst & (IMAGE_BLOCK_SIZE - 1)))
+                    compact_erased = 0;
+            }
+            return;
+        }
+
+        saved = 0;
+        src = end = 0;
+        if (delete_sound > 1 && toc_address(0) < IMAGE_BLOCK_SIZE)
+        {
+            /* The first sound starts in block 0, save it in a freed block. */
+            src = toc_address(0);
+            end = toc_address(1);
+            if (end > IMAGE_BLOCK_SIZE)
+                end = IMAGE_BLOCK_SIZE;
+            saved = end;
+        }
+        toc_saved = (numSound > TOC_EE_SOUNDS);
+        if (toc_saved)
+        {
+            /* The entries which aren't mirrored are read from the copy. */
+            src = 0;
+            if (end < TOC_END)
+                end = TOC_END;
+        }
+        if (src != end)
+        {
+            /* No block has been freed, the next one is erased again. */
+            if (tail > last)
+                last = tail;
+            dst = ((uint32_t)tail << 12) + src;
+            compact_erase(tail);
+            compact_state = COMPACT_SAVE;
+        }
+        else
+        {
+            compact_erase(0);
+            toc_idx = 0;
+            compact_state = COMPACT_TOC;
+        }
+    }
+    else if (compact_state == COMPACT_SAVE)
+    {
+        compact_copy();
+        if (src == end)
+        {
+            if (toc_saved)
+                toc_move((uint32_t)tail << 12);
+            compact_erase(0);
+            toc_idx = 0;
+            compact_state ++;
+        }
+    }
+    else if (compact_state == COMPACT_TOC)
+    {
+        /* The byte 0xFE and entries 0 to numSound - 1. */
+        uint16_t len = 1 + 3 * numSound;
+        uint8_t data[COMPACT_CHUNK];
+        uint8_t entry[3];
+        uint8_t i, n;
+
+        /* The entries may be read from the flash, so they're read by chunks
+         * before being programmed. The chunk is left for an RF frame and
+         * read again from toc_idx. */
+        while (!rf_txe && toc_idx < len)
+        {
+            n = (len - toc_idx > COMPACT_CHUNK) ? COMPACT_CHUNK : len - toc_idx;
+            for (i = 0; i < n; i++)
+            {
+                uint16_t idx = toc_idx + i - TOC_FIRST;
+
+                if (toc_idx + i == 0)
+                    data[i] = 0xFE;
+                else
+                {
+                    if (i == 0 || idx % 3 == 0)
+                        toc_new_entry(idx / 3, entry);
+                    data[i] = entry[idx % 3];
+                }
+            }
+            sequ_program_start(0x00, toc_idx >> 8, toc_idx, data[0]);
+            for (i = 1; i < n && !rf_txe; i++)
+                sequ_program(data[i]);
+            sequ_program_end();
+            toc_idx += i;
+        }
+        if (toc_idx == len)
+        {
+            toc_move(0);
+            if (saved)
+            {
+                src = ((uint32_t)tail << 12) + toc_address(0);
+                end = ((uint32_t)tail << 12) + saved;
+                dst = toc_address(0);
+                compact_state = COMPACT_RESTORE;
+            }
+            else
+                compact_state = COMPACT_TAIL;
+        }
+    }
+    else if (compact_state == COMPACT_RESTORE)
+    {
+        compact_copy();
+        if (src == end)
+            compact_state ++;
+    }
+    else if (compact_state == COMPACT_TAIL)
+    {
+        /* The next sound is stored in blocks which must be erased. */
+        if (tail <= last)
+            compact_erase(tail++);
+        else
+            compact_state ++;
+    }
+    else if (compact_state == COMPACT_END)
+    {
+        toc_scan();
+        compact_state = COMPACT_INIT;
+        compactFlag = 0;
+        queue_rf_cmd_p(STATUS_FLASH_PROG_CMD, STANDBY, 0, 0);
+        toc_send();
+    }
+}
@@ -0,0 +1,73 @@
+/*
+ * TUXAUDIO - Firmware for the 'audio' CPU of tuxdroid
+ * Copyright (C) 2007 C2ME S.A. <tuxdroid@c2me.be>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* $Id$ */
+
+/** \defgroup compact Deletion of a sound
+    \ingroup compact
+
+    A sound is deleted with DELETE_SOUND_CMD without erasing the whole flash.
+    The sounds following it are moved down by whole 4kB blocks so the free
+    space stays at the end of the flash, then the TOC is written again and
+    the blocks freed at the end are erased for the next STORE_SOUND_CMD.
+
+    compact() is called from the main loop while the RF isn't exchanging a
+    frame and returns as soon as it does, or while a block is being erased.
+    The sounds are copied by chunks of COMPACT_CHUNK bytes, read then
+    programmed in sequential mode.
+
+    The TOC is in block 0 with the start of the first sound. When a later
+    sound is deleted, those bytes are saved in a freed block while block 0 is
+    erased. When the first sound is deleted, the next one isn't moved into
+    block 0, entry 0 of the TOC gives its block instead. With more sounds than
+    the EEPROM mirror holds, the TOC is saved too and its entries are read from
+    that copy, see toc_move().
+
+    The old TOC is kept in the EEPROM mirror until the end, see toc.h.
+*/
+
+/** \file compact.h
+    \ingroup compact
+*/
+/** \file compact.c
+    \ingroup compact
+*/
+
+#ifndef COMPACT_H
+#define COMPACT_H
+
+/** \name Compaction states
+  @{ */
+enum {
+    COMPACT_INIT = 0,
+    COMPACT_MOVE,
+    COMPACT_SAVE,
+    COMPACT_TOC,
+    COMPACT_RESTORE,
+    COMPACT_TAIL,
+    COMPACT_END,
+};
+/* @} */
+
+/** Bytes copied at a time, kept on the stack. */
+#define COMPACT_CHUNK   16
+
+extern void compact(void);
+
+#endif /* COMPACT_H */
@@ -25,7 +25,7 @@
 #include "common/config.h"
 
 /* Configuration registers */
-tuxaudio_config_t tuxaudio_config;
+extern tuxaudio_config_t tuxaudio_config;
 
 void config_init(void);
 
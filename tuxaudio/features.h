@@ -0,0 +1,172 @@
+/*
+ * TUXAUDIO - Firmware for the 'audio' CPU of tuxdroid
+ * Copyright (C) 2007 C2ME S.A. <tuxdroid@c2me.be>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* $Id$ */
+
+/** \file features.h
+    \brief Optional features of the firmware.
+
+    The application has to end below the .version section at 0x1DF0 and the
+    ATmega88 has 1kB of RAM, stack included. The default build leaves about
+    400 bytes below .version, the optional features are only built when
+    their flag is set to 1, from the Makefile:
+
+        make OPT_MIC_VAD=1
+
+    Each of the features of the Makefile fits alone, not all of them
+    together. Run 'make clean' after changing a flag; the link fails if the
+    application overlaps .version. 'make size' in sim/ estimates a build
+    before.
+
+    The features marked as not fitting the ATmega88 take more than the room
+    left even alone. They're refused by the firmware build and only built by
+    the host simulation in sim/, which builds all of them.
+*/
+
+#ifndef FEATURES_H
+#define FEATURES_H
+
+/** Mirror of the TOC in the EEPROM, checked at boot instead of scanning the
+ * flash and read by PLAY_SOUND_CMD, see toc.h. */
+#ifndef OPT_TOC_MIRROR
+#define OPT_TOC_MIRROR 0
+#endif
+
+/** DELETE_SOUND_CMD, the sounds following the deleted one are moved down in
+ * the background, see compact.h. Needs OPT_TOC_MIRROR. Doesn't fit the
+ * ATmega88. */
+#ifndef OPT_SOUND_DELETE
+#define OPT_SOUND_DELETE 0
+#endif
+#if (OPT_SOUND_DELETE && !OPT_TOC_MIRROR)
+#error "OPT_SOUND_DELETE needs OPT_TOC_MIRROR"
+#endif
+
+/** Serial flashes other than the AT26F004, found from their JEDEC ID, and
+ * up to 340 sounds, see AT26F004.h. Doesn't fit the ATmega88. */
+#ifndef OPT_FLASH_DETECT
+#define OPT_FLASH_DETECT 0
+#endif
+
+/** IMA-ADPCM sounds in the flash, stored with codec 1, see adpcm.h. Doesn't
+ * fit the ATmega88. */
+#ifndef OPT_SOUND_ADPCM
+#define OPT_SOUND_ADPCM 0
+#endif
+
+/** IMA-ADPCM speaker stream, selected by CFG_ADPCM_MK in the RF frame, see
+ * defines.h. Doesn't fit the ATmega88. */
+#ifndef OPT_SPK_ADPCM
+#define OPT_SPK_ADPCM 0
+#endif
+
+/** MIC_VAD_CMD, frames sent without microphone audio when nothing is heard,
+ * see api.h. */
+#ifndef OPT_MIC_VAD
+#define OPT_MIC_VAD 0
+#endif
+
+/** MIXER_GAIN_CMD, a sound played from the flash during an RF stream is mixed
+ * with it instead of holding the stream back, see mixer.h. Doesn't fit the
+ * ATmega88. */
+#ifndef OPT_MIXER
+#define OPT_MIXER 0
+#endif
+
+/** Sounds sent in bulk frames to STORE_SOUND_CMD, see CFG_BULK_MK in
+ * defines.h. */
+#ifndef OPT_BULK
+#define OPT_BULK 0
+#endif
+
+/** WRITE_BLOCK_CMD, a complete flash image written one 4kB block at a time,
+ * see api.h. Needs OPT_BULK. Doesn't fit the ATmega88. */
+#ifndef OPT_FLASH_IMAGE
+#define OPT_FLASH_IMAGE 0
+#endif
+#if (OPT_FLASH_IMAGE && !OPT_BULK)
+#error "OPT_FLASH_IMAGE needs OPT_BULK"
+#endif
+
+/** CRC_SOUND_CMD and CRC_RANGE_CMD, CRC-32 of the sounds or blocks of the
+ * flash, see checksum.h. Doesn't fit the ATmega88. */
+#ifndef OPT_FLASH_CRC
+#define OPT_FLASH_CRC 0
+#endif
+
+/** LINK_STATS_REQ_CMD, counters of the frames and commands of the RF link,
+ * see api.h. */
+#ifndef OPT_LINK_STATS
+#define OPT_LINK_STATS 0
+#endif
+
+/** Parameter 1 of ERASE_FLASH_CMD, only the blocks used by the sounds are
+ * erased instead of the whole chip, see commands.h. */
+#ifndef OPT_ERASE_USED
+#define OPT_ERASE_USED 0
+#endif
+
+/** PROG_RATE of STATUS_FLASH_PROG_CMD, throughput of STORE_SOUND_CMD sent
+ * each second, see api.h. */
+#ifndef OPT_PROG_RATE
+#define OPT_PROG_RATE 0
+#endif
+
+/** AUDIO_RATE_REQ_CMD, state of the speaker rate controller, see api.h. */
+#ifndef OPT_RATE_REQ
+#define OPT_RATE_REQ 0
+#endif
+
+/** Sounds starting with a header giving their sample rate, length and loop,
+ * stored with codec 3, see flash.h. Doesn't fit the ATmega88. */
+#ifndef OPT_SOUND_HEADER
+#define OPT_SOUND_HEADER 0
+#endif
+
+/** QUEUE_SOUND_CMD, SKIP_SOUND_CMD and CLEAR_QUEUE_CMD, sounds played one
+ * after the other without gap. Doesn't fit the ATmega88. */
+#ifndef OPT_SOUND_QUEUE
+#define OPT_SOUND_QUEUE 0
+#endif
+
+/** PACKED_CMDS_CMD, several commands in each RF frame, see api.h. */
+#ifndef OPT_CMD_PACK
+#define OPT_CMD_PACK 0
+#endif
+
+/** WINDOWED_CMDS_CMD, several commands sent to the RF before the first one
+ * is acked, see api.h. Doesn't fit the ATmega88. */
+#ifndef OPT_CMD_WINDOW
+#define OPT_CMD_WINDOW 0
+#endif
+
+/** Stack of the replies and events to the RF, sent before the routine
+ * status of tuxcore. */
+#ifndef OPT_CMD_URGENT
+#define OPT_CMD_URGENT 0
+#endif
+
+#if defined(__AVR__) && (OPT_SOUND_DELETE || OPT_FLASH_DETECT || \
+                         OPT_SOUND_ADPCM || OPT_SPK_ADPCM || OPT_MIXER || \
+                         OPT_FLASH_IMAGE || OPT_FLASH_CRC || \
+                         OPT_SOUND_HEADER || OPT_SOUND_QUEUE || OPT_CMD_WINDOW)
+#error "A feature which doesn't fit the ATmega88 is set, see features.h"
+#endif
+
+#endif /* FEATURES_H */
@@ -173,6 +173,36 @@ static inline void FifoGet_inl(fifo_t *p, uint8_t *data)
     *data = p->buffer[p->outIdx++ & (p->size-1)];
 }
 
+/** \brief Return an element without removing it.
+ *  \param p Fifo pointer.
+ *  \param offset Position of the element from the next one to get, must be
+ *  lower than the length of the fifo.
+ */
+static inline uint8_t FifoPeek_inl(fifo_t const *p, uint8_t offset)
+{
+    return p->buffer[(uint8_t)(p->outIdx + offset) & (p->size-1)];
+}
+
+/** \brief Remove the elements at the output without reading them.
+ *  \param p Fifo pointer.
+ *  \param count Number of elements to remove, must not be higher than the
+ *  length of the fifo.
+ */
+static inline void FifoSkip_inl(fifo_t *p, uint8_t count)
+{
+    p->outIdx += count;
+}
+
+/** \brief Remove the last elements added, keeping the first ones.
+ *  \param p Fifo pointer.
+ *  \param length Number of elements to keep.
+ */
+static inline void FifoKeep_inl(fifo_t *p, uint8_t length)
+{
+    if (FifoLength(p) > length)
+        p->inIdx = p->outIdx + length;
+}
+
 /*! @} */
 /*! @} */
 #endif /* _FIFO_H_ */
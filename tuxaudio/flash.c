@@ -21,6 +21,7 @@
 
 #include <avr/io.h>
 #include <avr/interrupt.h>
+#include <util/crc16.h>
 #include "varis.h"
 #include "communication.h"
 #include "spi.h"
@@ -30,67 +31,111 @@
 #include "common/commands.h"
 #include "common/api.h"
 #include "audio_fifo.h"
+#include "adpcm.h"
+#include "mixer.h"
+#include "toc.h"
+#include "fifo.h"
 
 /* Declarations */
 static void init_programming(uint8_t adi0, uint8_t adi1, uint8_t adi2);
 static void programming_sound(void);
-static void playInit(uint8_t const nsound);
+#if (OPT_PROG_RATE)
+static void prog_report(void);
+static uint16_t prog_rate(uint32_t bytes, uint16_t ticks);
+#endif
+static void erase_report(void);
+static void playInit(uint16_t const nsound);
+static uint8_t playOpen(uint16_t const nsound);
+#if (OPT_SOUND_HEADER)
+static uint8_t playHeader(uint32_t start);
+static uint8_t playPart(void);
+#endif
 static void playingSound(void);
+static void playNext(void);
+#if (OPT_SOUND_QUEUE)
+static void playQueued(void);
+#endif
 static void stopPlaying(void);
 
 uint8_t flash_state;
 uint8_t soundNum;
 static uint16_t index;
 static uint8_t sound_stored = 0;
-static uint8_t count, ad0, ad1;
-static uint8_t first_block;
+static uint16_t first_block;
+/** Ticks of the last progress report. */
+static uint8_t prog_tick;
+#if (OPT_PROG_RATE)
+/** Bytes stored since the last throughput report. */
+static uint16_t prog_bytes;
+/** Bytes stored and ticks elapsed since the start of the programming. */
+static uint32_t prog_total;
+static uint16_t prog_ticks;
+#else
+#define prog_report()
+#endif
+#if (OPT_ERASE_USED)
+/** Next and last blocks to erase. */
+static uint16_t erase_block, erase_last;
+#endif
+/** Seconds elapsed since the erase started. */
+static uint8_t erase_seconds;
+#if (OPT_FLASH_IMAGE)
+/** Bytes of the image block left to program or to read back, and its CRC. */
+static uint16_t image_left;
+static uint16_t image_crc;
+#endif
+/** Codec of the sound being played, as stored in the TOC or its header. */
+#if (OPT_SOUND_ADPCM)
+static uint8_t play_codec;
+static struct adpcm_state adpcm;
+#else
+#define play_codec          0
+#endif
+/** Number of bytes of the part of the sound left to read. */
+static volatile uint32_t play_left;
+/** Space needed in the fifo to read a byte. */
+static uint8_t play_need;
+#if (OPT_SOUND_HEADER)
+/** Rate conversion, see PLAY_RATE_MIN: the previous sample, the samples of the
+ * sound read for each sample played and the position of the next one played
+ * after the previous sample, in 1/256 of sample. */
+static uint8_t play_prev;
+static uint16_t play_step, play_pos;
+/** Part of the sound being read, see PLAY_INTRO. */
+static uint8_t play_part;
+/** Set if the last byte of the sound holds a single ADPCM sample. */
+static uint8_t play_trim;
+/** Repetitions of the loop left, its address and size, and the size of the
+ * tail. */
+static uint8_t play_loops;
+static uint32_t play_loop_addr, play_loop_len, play_tail;
+#if (OPT_SOUND_ADPCM)
+/** ADPCM state at the start of the loop. */
+static struct adpcm_state loop_adpcm;
+#endif
+#else
+/* The sounds are played in a single part at 8kHz. */
+#define play_trim           0
+#define play_part           PLAY_TAIL
+#define playPart()          0
+#define playRate(sample)    playSample(sample)
+#endif
+#if (OPT_SOUND_QUEUE)
+/** Set to go on with the next queued sound. */
+static uint8_t play_skip;
+
+FIFO_INSTANCE(play_queue_buf, 2 * PLAY_QUEUE_SIZE);
+/** Sounds to play after the current one, with their attenuation. */
+static fifo_t *play_queue = FifoPointer(play_queue_buf);
+#else
+/* The end of the sound ends the play sequence. */
+#define play_skip           0
+#define playQueued()        stopPlaying()
+#endif
+/** Set while the SPI interrupt reads the sound. */
+static volatile uint8_t play_busy;
 
 
-/**
- * \ingroup flash
-   \brief Read the number of sound in the flash memory.
-
-   This function scan the sound's indexes, and return the number of sound stored
-   in the flash memory.
-   */
-
-uint8_t readFlashNumber(void)
-{
-    uint8_t i;
-    ad0 = 0x01;
-    ad1 = 0x00;
-    count = 0;
-    while(1)
-    {
-        if (read_data(0x00, ad1, ad0) == 0xFF)
-        {
-            count --;
-            return count;
-        }
-        else
-        {
-            for (i = 0; i < 3; i++)
-            {
-                ad0 ++;
-                if (ad0 == 0)
-                    ad1++;
-            }
-        }
-        count ++;
-    }
-    return 0;
-}
-
-uint8_t readLastBlock(uint8_t num)
-{
-    index = (numSound * 3) + 1;
-    ad[0] = read_data(0x00, (index>>8), (index & 0xFF));
-    index ++;
-    ad[1] = read_data(0x00, (index>>8), (index & 0xFF));
-    index ++;
-    ad[2] = read_data(0x00, (index>>8), (index & 0xFF));
-    return (ad[0] << 4) + (ad[1] >> 4);
-}
 /**
  * \ingroup flash
    \brief Store a sound in the memory.
@@ -132,12 +177,8 @@ void programming(void)
         {
             /* One or more sounds are programmed in the flash memory.
              * The next sound must be stored after the others */
-            index = (numSound * 3) + 1;
-            ad[0] = read_data(0x00, (index>>8), (index & 0xFF));
-            index ++;
-            ad[1] = read_data(0x00, (index>>8), (index & 0xFF));
-            index ++;
-            ad[2] = read_data(0x00, (index>>8), (index & 0xFF));
+            toc_entry(numSound, (uint8_t *)ad);
+            ad[0] &= TOC_ADDR_MK;
 
             // Goto the next 4kB block.
             ad[1] += 0x10;
@@ -145,11 +186,11 @@ void programming(void)
             if (ad[1] == 0)
                 ad[0] ++;
             ad[2] = 0;
-            first_block = (ad[0] << 4) + (ad[1] >> 4);
+            first_block = ((uint16_t)ad[0] << 4) + (ad[1] >> 4);
         }
         AudioFifoClear();
 
-        if (ad[0] > 0x07)
+        if (ad[0] > flash_top || numSound >= TOC_MAX_SOUNDS)
         {
             programming_state = PROG_END;
             queue_rf_cmd_p(STATUS_FLASH_PROG_CMD, FLASH_FULL, 0, 0);
@@ -164,20 +205,42 @@ void programming(void)
     else if (programming_state == PROG_INIT)
     {
         init_programming(ad[0], ad[1], ad[2]);
+        /* The audio fifo has been cleared, the bulk frames can be stored. */
+        if (store_bulk)
+            bulk_start();
         programming_state ++;
         flash_state = 1;
         sound_stored = 0;
+#if (OPT_PROG_RATE)
+        prog_bytes = 0;
+        prog_total = 0;
+        prog_ticks = 0;
+        prog_tick = main_tick;
+#endif
     }
     else if (programming_state == PROGRAMMING)
     {
         if (flash_state)
+        {
             programming_sound();
-
+            prog_report();
+        }
         else
         {
-            write_disable();
+            /* The last byte may still be programmed. */
+            sequ_program_end();
+#if (OPT_PROG_RATE)
+            prog_ticks += (uint8_t)(main_tick - prog_tick);
+            prog_total += prog_bytes;
+#endif
             if (sound_stored)
             {
+#if (OPT_PROG_RATE)
+                if (prog_ticks)
+                    queue_rf_cmd_p(STATUS_FLASH_PROG_CMD, PROG_RATE,
+                                   prog_rate(prog_total, prog_ticks) >> 8,
+                                   prog_rate(prog_total, prog_ticks));
+#endif
                 last_block = (ad[0] << 4) + (ad[1] >> 4);
                 queue_rf_cmd_p(STATUS_FLASH_PROG_CMD, WAITING_FOR_CONFIRMATION, last_block - first_block, 0);
                 programming_state ++;
@@ -218,7 +281,20 @@ void programming(void)
         queue_rf_cmd_p(STATUS_FLASH_PROG_CMD, WRITE_TOC, 0, 0);
         numSound ++;
         index = (numSound * 3) + 1;
-        program_flash(0x00, (index>>8), (index & 0xFF), ad[0]);
+        /* The codec is flagged in the high address byte. */
+#if (OPT_SOUND_ADPCM)
+        if (store_codec == CODEC_ADPCM)
+            program_flash(0x00, (index>>8), (index & 0xFF),
+                          ad[0] | TOC_ADPCM_MK);
+        else
+#endif
+#if (OPT_SOUND_HEADER)
+        if (store_codec == CODEC_HEADER)
+            program_flash(0x00, (index>>8), (index & 0xFF),
+                          ad[0] | TOC_HEADER_MK);
+        else
+#endif
+            program_flash(0x00, (index>>8), (index & 0xFF), ad[0]);
         index ++;
         program_flash(0x00, (index>>8), (index & 0xFF), ad[1]);
         index ++;
@@ -228,12 +304,16 @@ void programming(void)
     }
     else if (programming_state == PROG_END)
     {
-        numSound = readFlashNumber();
+        toc_scan();
+        bulk_stop();
+#if (OPT_BULK)
+        store_bulk = 0;
+#endif
         programming_state = 0;
         programmingFlash = 0;
         TIMSK0 = 0x01;
         queue_rf_cmd_p(STATUS_FLASH_PROG_CMD, STANDBY, 0, 0);
-        queue_rf_cmd_p(SOUND_VAR_CMD, numSound, last_block, 0);
+        toc_send();
     }
 }
 
@@ -266,26 +346,86 @@ void leave_deep_sleep(void)
     flash_unselect();
 }
 
+/**
+ * \ingroup flash
+   \brief Send the progress of the erase with STATUS_FLASH_PROG_CMD, the
+   blocks left are given up to 255, all of them during a chip erase.
+ */
+static void erase_report(void)
+{
+    uint16_t blocks = flash_blocks();
+
+#if (OPT_ERASE_USED)
+    if (eraseFlag == ERASE_USED_FLAG)
+        blocks = erase_last - erase_block + 1;
+#endif
+    queue_rf_cmd_p(STATUS_FLASH_PROG_CMD, ERASING,
+                   blocks > 0xFF ? 0xFF : blocks, erase_seconds);
+}
+
 /**
  * \ingroup flash
    \brief Erase the flash memory.
 
-    The first step is to send the command to erase the flash.
-    After, the status is polled while the erase process isn't finished.
-    When the BUSY flag is null, the erase sequence is stopped.
+   This function contain 3 states :
+
+   ERASE_START : Send the chip erase command, or set the blocks to erase
+   with ERASE_USED_FLAG.
+
+   ERASE_BUSY : Poll the status until the chip is erased, or erase the blocks
+   one after the other.
+
+   ERASE_TOC : Write the first index, then read the TOC.
+
+   The function returns while the flash is busy so the RF frames, the
+   commands and the audio go on. The progress is reported with ERASING of
+   STATUS_FLASH_PROG_CMD each second.
 */
 void erase(void)
 {
-    uint8_t static enter = 1;
-    if (enter)
+    uint8_t static erase_state = ERASE_START;
+
+    if (erase_state == ERASE_START)
+    {
+        /* Wait for a sound stopped by the command. */
+        playWait();
+        prog_tick = main_tick;
+        erase_seconds = 0;
+#if (OPT_ERASE_USED)
+        if (eraseFlag == ERASE_USED_FLAG)
+        {
+            erase_block = 0;
+            erase_last = last_block;
+        }
+        else
+#endif
+            erase_flash();
+        erase_state = ERASE_BUSY;
+        erase_report();
+    }
+    else if (erase_state == ERASE_BUSY)
     {
-        erase_flash();
-        enter = 0;
+        if (read_status() & BUSY)
+        {
+            uint8_t ticks = main_tick - prog_tick;
+
+            if (ticks >= PROG_RATE_TICKS)
+            {
+                prog_tick += ticks;
+                erase_seconds ++;
+                erase_report();
+            }
+        }
+#if (OPT_ERASE_USED)
+        else if (eraseFlag == ERASE_USED_FLAG && erase_block <= erase_last)
+            block_erase_start(erase_block ++);
+#endif
+        else
+            erase_state = ERASE_TOC;
     }
-    else if (!(read_status() & BUSY))
+    else if (erase_state == ERASE_TOC)
     {
-        //queue_rf_cmd_p(STATUS_FLASH_PROG_CMD, STANDBY, 0, 0);
-        enter = 1;
+        erase_state = ERASE_START;
         eraseFlag = 0;
 
         /* Wite the first index. */
@@ -293,16 +433,142 @@ void erase(void)
         program_flash(0x00, 0x00, 0x01, 0x00);
         program_flash(0x00, 0x00, 0x02, 0x04);
         program_flash(0x00, 0x00, 0x03, 0x00);
-        numSound = 0;
-        last_block = 0;
+        toc_scan();
 
         queue_rf_cmd_p(STATUS_FLASH_PROG_CMD, STANDBY, 0, 0);
-        queue_rf_cmd_p(SOUND_VAR_CMD, numSound, last_block, 0);
+        toc_send();
         /* Re-enable audio PWM interrupt */
         TIMSK0 = 0x01;
     }
 }
 
+#if (OPT_FLASH_IMAGE)
+/**
+ * \ingroup flash
+   \brief Write a block of a flash image, see WRITE_BLOCK_CMD.
+
+   This function contain 5 states :
+
+   IMAGE_ERASE : Start erasing the block.
+
+   IMAGE_ERASING : Poll the status until the block is erased, then accept the
+   bulk frames.
+
+   IMAGE_PROGRAM : Program the bytes of the bulk frames in sequential mode.
+
+   IMAGE_VERIFY : Read the block back and compute its CRC.
+
+   IMAGE_END : Send the CRC and restore the context.
+
+   The flash is accessed with a doubled SPI clock, it's set back to 2MHz
+   before returning as the RF doesn't support it.
+
+   If no bulk frame is received for START_FRAME_NUMBER frames, the block is
+   left as is and NO_SOUND is sent instead of the CRC.
+*/
+void image(void)
+{
+    uint8_t static image_state = IMAGE_ERASE;
+
+    if (image_state == IMAGE_ERASE)
+    {
+        /* Wait for a sound stopped by the command. */
+        playWait();
+        /* Disable audio PWM interrupt */
+        TIMSK0 = 0x00;
+        block_erase_start(image_block);
+        image_state ++;
+    }
+    else if (image_state == IMAGE_ERASING)
+    {
+        if (read_status() & BUSY)
+            return;
+        AudioFifoClear();
+        bulk_start();
+        ad[0] = image_block >> 4;
+        ad[1] = image_block << 4;
+        ad[2] = 0;
+        image_left = IMAGE_BLOCK_SIZE;
+        frame_without_sound = START_FRAME_NUMBER;
+        image_state ++;
+    }
+    else if (image_state == IMAGE_PROGRAM)
+    {
+        uint8_t data;
+
+        SPSR |= _BV(SPI2X);
+        while (!rf_txe && image_left && AudioFifoLength())
+        {
+            frame_without_sound = START_FRAME_NUMBER;
+            AudioFifoGet_inl(&data);
+            if (image_left == IMAGE_BLOCK_SIZE)
+                sequ_program_start(ad[0], ad[1], ad[2], data);
+            else
+                sequ_program(data);
+            image_left --;
+        }
+
+        if (!image_left || !frame_without_sound)
+        {
+            /* The last byte may still be programmed. */
+            sequ_program_end();
+            bulk_stop();
+            if (image_left)
+            {
+                queue_rf_cmd_p(STATUS_FLASH_PROG_CMD, NO_SOUND, 0, 0);
+                image_state = IMAGE_END;
+            }
+            else
+            {
+                image_left = IMAGE_BLOCK_SIZE;
+                image_crc = 0xFFFF;
+                image_state ++;
+            }
+        }
+        SPSR &= ~_BV(SPI2X);
+    }
+    else if (image_state == IMAGE_VERIFY)
+    {
+        SPSR |= _BV(SPI2X);
+        flash_select();
+        spiSend(READ_ARRAY_LOW_F);
+        spiSend(ad[0]);
+        spiSend(ad[1]);
+        spiSend(ad[2]);
+        /* A block doesn't cross the high address byte. */
+        while (!rf_txe && image_left)
+        {
+            image_crc = _crc_ccitt_update(image_crc, spiSend(NOP));
+            image_left --;
+            ad[2] ++;
+            if (ad[2] == 0x00)
+                ad[1] ++;
+        }
+        flash_unselect();
+        SPSR &= ~_BV(SPI2X);
+        if (!image_left)
+            image_state ++;
+    }
+    else if (image_state == IMAGE_END)
+    {
+        if (!image_left)
+            queue_rf_cmd_p(STATUS_FLASH_BLOCK_CMD, image_block,
+                           image_crc >> 8, image_crc);
+        /* Drop the padding of the last frame. */
+        AudioFifoClear();
+        if (image_block == 0)
+        {
+            toc_scan();
+            toc_send();
+        }
+        image_state = IMAGE_ERASE;
+        imageFlag = 0;
+        /* Re-enable audio PWM interrupt */
+        TIMSK0 = 0x01;
+    }
+}
+#endif
+
 /**
  * \ingroup flash
    \brief This function is used to play a sound from the flash memory.
@@ -310,7 +576,7 @@ void erase(void)
    The first step (playInit) is to initialize the flash memory with the selected sound to play.
    Many tests are made to ensure that the sound to play exist, the indexes are correct, etc.
 
-   The second step (playingSound) is to fill the fifo with the sound's bytes, and to verify the addresses.
+   The second step (playingSound) is to fill the fifo with the sound's bytes in the background and to check the end of the sound.
    */
 
 
@@ -322,12 +588,93 @@ void playSound(void)
         playingSound();
 }
 
+#if (OPT_SOUND_QUEUE)
+/**
+ * \ingroup flash
+   \brief Queue a sound to play after the current one.
+   \param nsound Track number.
+   \param level Attenuation of the sound, see audioLevel.
+
+   The sound is dropped if the queue is full.
+ */
+void queue_sound(uint16_t nsound, uint8_t level)
+{
+    if (FifoLength(play_queue) <= 2 * PLAY_QUEUE_SIZE - 2)
+    {
+        /* The high bits of the sound number are kept with the level. */
+        FifoPut(play_queue, nsound);
+        FifoPut(play_queue, (level & SOUND_LEVEL_MK) |
+                ((nsound >> 2) & SOUND_HI_MK));
+    }
+}
+
+/**
+ * \ingroup flash
+   \brief Drop the queued sounds, the current one goes on.
+ */
+void clear_sounds(void)
+{
+    FifoClear(play_queue);
+}
+
+/**
+ * \ingroup flash
+   \brief Stop the current sound and go on with the next queued one.
+ */
+void skip_sound(void)
+{
+    play_skip = 1;
+}
+#endif
+
 /* Static functions */
 /**
  * \ingroup flash
    \brief This function is used to init the memory to play a sound.
    \param nsound Track number to be played.
 
+    The sound is opened with playOpen() and the fifo cleared unless it's
+    mixed with the RF stream. The queue is cleared if the sound can't be
+    played.
+*/
+
+static void playInit(uint16_t const nsound)
+{
+#if (OPT_SOUND_HEADER)
+    play_prev = 0x80;
+#endif
+#if (OPT_SOUND_QUEUE)
+    play_skip = 0;
+#endif
+    if (!playOpen(nsound))
+    {
+        clear_sounds();
+        flashPlay = 0;
+        soundToPlay = 0;
+        return;
+    }
+#if (OPT_MIXER)
+    if (mixer_rf_active)
+        mixer_start();
+    else
+#endif
+    {
+#if (OPT_MIXER)
+        mixer_flash = 0;
+#endif
+        AudioFifoClear();
+        AudioHalfRate = 1;
+        OCR0A = 250;            // Normal operation for PWM if fifo adaptative is on
+    }
+    flash_state = 0;
+}
+
+/**
+ * \ingroup flash
+   \brief Open a sound to play it.
+   \param nsound Track number to be played.
+   \return 0 if the sound can't be played.
+
     To prevent bugs, some verifications are made :
     - check if the sound to play exist
     - check if the sound to play is not null
@@ -335,48 +682,44 @@ void playSound(void)
 
     If these conditions are respected, the memory is initialised with the first sound's byte address.
     The next index is stored to identify the end of the sound track.
-*/
 
-static void playInit(uint8_t const nsound)
+    A sound flagged with TOC_HEADER_MK starts with a header which is read
+    here, see playHeader(). It isn't played without OPT_SOUND_HEADER.
+*/
+static uint8_t playOpen(uint16_t const nsound)
 {
-    uint8_t i;
+#if (OPT_SOUND_HEADER)
+    uint8_t play_header;
+#endif
 
     if (numSound == 0x00)  /* if unprogrammed we have 0xFF stored in flash */
     {
-        flashPlay = 0;
-        soundToPlay = 0;
-        return;
+        return 0;
     }
     if (!nsound || (nsound > numSound))    /* check the limits */
     {
-        flashPlay = 0;
-        soundToPlay = 0;
-        return;
-    }
-
-    count = 1;
-    ad1 = 0x00;
-    ad0 = 0x01;
-    while (count != nsound)     // Compute address
-    {
-        for (i = 0; i < 3; i++)
-        {
-            ad0++;
-            if (ad0 == 0)
-                ad1++;
-        }
-        count++;
+        return 0;
     }
-    flash_select();             // Chip Select
-    spiSend(READ_ARRAY_LOW_F);  // Send Read Page Command
-    spiSend(0x00);              // Send Address
-    spiSend(ad1);
-    spiSend(ad0);
 
-    for (i = 0; i < 6; i++)
-    {
-        ad[i] = spiSend(NOP);  // Read start and stop sound address
-    }
+    /* Start and stop addresses are taken from the TOC mirror, the flash is
+     * only accessed to read the sound. */
+    toc_entry(nsound - 1, (uint8_t *)&ad[0]);
+    toc_entry(nsound, (uint8_t *)&ad[3]);
+    /* The codec is given by the stop address of the sound. */
+#if (OPT_SOUND_ADPCM)
+    play_codec = ad[3] & TOC_ADPCM_MK;
+#else
+    if (ad[3] & TOC_ADPCM_MK)
+        return 0;
+#endif
+#if (OPT_SOUND_HEADER)
+    play_header = ad[3] & TOC_HEADER_MK;
+#else
+    if (ad[3] & TOC_HEADER_MK)
+        return 0;
+#endif
+    ad[0] &= TOC_ADDR_MK;
+    ad[3] &= TOC_ADDR_MK;
     if (nsound > 1)
     {
         ad[1] += 0x10;
@@ -386,58 +729,41 @@ static void playInit(uint8_t const nsound)
         ad[2] = 0;
     }
 
-    flash_unselect();              // Chip Deselect
-
     /* Check addresses */
-    if (ad[0] > TOP_A2)
+    if (ad[0] > flash_top)
     {
-        flashPlay = 0;
-        soundToPlay = 0;
-        return;
+        return 0;
     }                  /* don't read outside the flash */
-    if (ad[3] > TOP_A2)
+    if (ad[3] > flash_top)
     {
-        flashPlay = 0;
-        soundToPlay = 0;
-        return;
+        return 0;
     }                  /* don't read outside the flash */
     if ((ad[0] == 0) && (ad[1] < 0x04))
     {
-        flashPlay = 0;
-        soundToPlay = 0;
-        return;
+        return 0;
     }                  /* minimum index not respected */
     if ((ad[4] == 0) && (ad[5] < 0x04))
     {
-        flashPlay = 0;
-        soundToPlay = 0;
-        return;
+        return 0;
     }    /* minimum index not respected */
     if (ad[3] < ad[0])
     {
-        flashPlay = 0;
-        soundToPlay = 0;
-        return;
+        return 0;
     }    /* check that the stop index is greater than the start index */
     else if (ad[3] == ad[0])
     {
         if (ad[4] < ad[1])
         {
-            flashPlay = 0;
-            soundToPlay = 0;
-            return;
+            return 0;
         }
         else if (ad[4] == ad[1])
         {
             if (ad[5] <= ad[2])
             {
-                flashPlay = 0;
-                soundToPlay = 0;
-                return;
+                return 0;
             }
         }
     }
-    AudioFifoClear();
     flash_select();             // Chip Select
 
     spiSend(0x03);              // Send Read Page Command
@@ -445,52 +771,375 @@ static void playInit(uint8_t const nsound)
     spiSend(ad[1]);
     spiSend(ad[2]);
 
-    OCR0A = 250;                // Normal operation for PWM if fifo adaptative is on
-    flash_state = 0;
+    play_left = (((uint32_t)ad[3] << 16) | ((uint16_t)ad[4] << 8) | ad[5]) -
+        (((uint32_t)ad[0] << 16) | ((uint16_t)ad[1] << 8) | ad[2]);
+#if (OPT_SOUND_ADPCM)
+    adpcm_init(&adpcm);
+#endif
+#if (OPT_SOUND_HEADER)
+    play_step = 256;
+    play_pos = 256;
+    play_part = PLAY_TAIL;
+    play_trim = 0;
+    if (play_header &&
+        !playHeader(((uint32_t)ad[0] << 16) | ((uint16_t)ad[1] << 8) | ad[2]))
+    {
+        flash_unselect();
+        return 0;
+    }
+#endif
+    play_need = play_codec ? 2 : 1;
+#if (OPT_SOUND_HEADER)
+    /* Samples played for a sample read when the rate is raised. */
+    play_need *= 255 / play_step + 1;
+#endif
     queue_rf_cmd_p(STATUS_AUDIO_CMD, numSound, 0, 0);
+    return 1;
+}
+
+
+#if (OPT_SOUND_HEADER)
+/**
+ * \ingroup flash
+   \brief Return a value of a sound header.
+   \param p First byte of the value, 3 bytes big-endian.
+ */
+static uint32_t hdr24(uint8_t const *p)
+{
+    return ((uint32_t)p[0] << 16) | ((uint16_t)p[1] << 8) | p[2];
+}
+
+/**
+ * \ingroup flash
+   \brief Read the header of the sound and set up its playback.
+   \param start Address of the sound, the header is read from the flash.
+   \return 0 if the header isn't valid.
+
+   The header gives the codec, the sample rate, the exact length and the loop
+   of the sound, see HDR_VERSION. A sound is split in 3 parts: the intro
+   before the loop, the loop repeated HDR_LOOPS times more and the tail. A
+   sound without loop only has a tail. ADPCM loop points are rounded down to
+   an even sample as a byte holds 2 samples.
+ */
+static uint8_t playHeader(uint32_t start)
+{
+    uint8_t hdr[SOUND_HDR_SIZE];
+    uint8_t i;
+    uint16_t rate;
+    uint32_t samples, size, loop_start, loop_end;
+
+    for (i = 0; i < SOUND_HDR_SIZE; i++)
+        hdr[i] = spiSend(NOP);
+    if (hdr[HDR_VERSION] < SOUND_HDR_VERSION ||
+        hdr[HDR_SIZE] < SOUND_HDR_SIZE || hdr[HDR_SIZE] >= play_left)
+        return 0;
+    /* Skip the fields of newer versions. */
+    for (; i < hdr[HDR_SIZE]; i++)
+        spiSend(NOP);
+    start += hdr[HDR_SIZE];
+    play_left -= hdr[HDR_SIZE];
+
+#if (OPT_SOUND_ADPCM)
+    play_codec = (hdr[HDR_CODEC] == CODEC_ADPCM);
+#else
+    if (hdr[HDR_CODEC] == CODEC_ADPCM)
+        return 0;
+#endif
+    rate = ((uint16_t)hdr[HDR_RATE] << 8) | hdr[HDR_RATE + 1];
+    if (rate < PLAY_RATE_MIN || rate > PLAY_RATE_MAX)
+        return 0;
+    play_step = ((uint32_t)rate * 256 + PLAY_RATE / 2) / PLAY_RATE;
+    /* The first sample played is interpolated from the mid level. When the
+     * rate is dropped it's half way, a 16kHz sound is averaged by pairs. */
+    play_pos = (play_step <= 256) ? play_step : (play_step + 256) >> 1;
+
+    /* The bytes after the last sample are ignored. */
+    samples = hdr24(&hdr[HDR_LENGTH]);
+    size = play_codec ? (samples + 1) >> 1 : samples;
+    if (size && size <= play_left)
+    {
+        play_left = size;
+        play_trim = play_codec && (samples & 1);
+    }
+
+    play_loops = hdr[HDR_LOOPS];
+    loop_start = hdr24(&hdr[HDR_LOOP_START]);
+    loop_end = hdr24(&hdr[HDR_LOOP_END]);
+    if (play_codec)
+    {
+        loop_start >>= 1;
+        loop_end >>= 1;
+    }
+    if (play_loops && loop_start < loop_end && loop_end <= play_left)
+    {
+        play_loop_addr = start + loop_start;
+        play_loop_len = loop_end - loop_start;
+        play_tail = play_left - loop_end;
+        if (loop_start)
+        {
+            play_part = PLAY_INTRO;
+            play_left = loop_start;
+        }
+        else
+        {
+            play_part = PLAY_LOOP;
+#if (OPT_SOUND_ADPCM)
+            loop_adpcm = adpcm;
+#endif
+            play_left = play_loop_len;
+        }
+    }
+    return 1;
+}
+#endif
+
+/**
+ * \ingroup flash
+   \brief Return the number of samples that can be added to the fifo the sound
+   is played to.
+ */
+static uint8_t playSpace(void)
+{
+#if (OPT_MIXER)
+    if (mixer_flash)
+        return mixer_flash_space();
+#endif
+    return AudioFifoCapacity - AudioFifoLength();
+}
+
+/**
+ * \ingroup flash
+   \brief Add a sample of the sound to the audio fifo or to the mixer if an RF
+   stream is playing.
+ */
+static void playSample(uint8_t sample)
+{
+#if (OPT_MIXER)
+    if (mixer_flash)
+        mixer_flash_put(sample);
+    else
+        AudioFifoPut_inl(mixer_scale(sample,
+                                     mixer_gain[MIX_FLASH] >> audioLevel));
+#else
+    /* Attenuated around the mid level. */
+    AudioFifoPut_inl(((int8_t)(sample - 0x80) >> audioLevel) + 0x80);
+#endif
+}
+
+/**
+ * \ingroup flash
+   \brief Start reading the next byte of the sound if there's space for it.
+ */
+static void playNext(void)
+{
+    if (playSpace() >= play_need)
+    {
+        play_busy = 1;
+        SPDR = NOP;
+        SPCR |= _BV(SPIE);
+    }
 }
 
 /* Static functions */
 /**
  * \ingroup flash
-   \brief Read the flash memory and fill the fifo.
+   \brief Fill the fifo in the background while a sound is played.
 
-    This function reads bytes into the flash memory and fill the fifo.
-    When the last byte is read, the sound play's sequence is stopped.
+    The bytes of the sound are read by the SPI interrupt which starts the
+    next one as long as there's space in the fifo. The reading stops when the
+    fifo is full or when the RF has a frame to exchange, and is restarted
+    from here once the frame has been processed. The end of the sound is
+    checked here too.
+
+    The samples are stored once at 8kHz, the sampling interrupt or the mixer
+    interpolates them. An ADPCM byte holds 2 samples, the fifo should then
+    have space for 2 bytes instead of 1, and 4 times more for a 2kHz sound.
+
+    The sound is stopped here too when PLAY_SOUND_CMD is received with sound
+    0, which is the only way to stop a sound looping forever.
+
+    At the end of the sound, or when it's skipped, the next queued sound is
+    read right away, see playQueued().
  */
 
 static void playingSound(void)
 {
-    uint8_t sound;
-    while (!rf_txe && AudioFifoLength() < (AudioFifoSize-1))
-    {
-        sound = spiSend(0x00);  // Wait response
-        sound = sound >> audioLevel;
-        /* Save it twice to have 16kHz */
-        AudioFifoPut_inl(sound);
-        AudioFifoPut_inl(sound);
+    if (play_busy)
+        return;
+    if (!soundToPlay)
+        stopPlaying();
+    else if (play_skip || (!play_left && !playPart()))
+        playQueued();
+    else
+        playNext();
+}
+
+#if (OPT_SOUND_QUEUE)
+/**
+ * \ingroup flash
+   \brief Go on with the next queued sound.
 
-        ad[2]++;        // Increment address for next play
-        if (ad[2] == 0)
+   The fifo isn't cleared, the next sound follows the samples of the previous
+   one without gap. Queued sounds which can't be played are dropped and the
+   play sequence stops once the queue is empty.
+ */
+static void playQueued(void)
+{
+    uint8_t lo, level;
+    uint16_t nsound;
+
+    play_skip = 0;
+    flash_unselect();
+    while (FifoGet(play_queue, &lo) == FIFO_OK)
+    {
+        FifoGet(play_queue, &level);
+        nsound = sound_number(lo, level);
+        audioLevel = level & SOUND_LEVEL_MK;
+        if (playOpen(nsound))
         {
-            ad[1]++;
-            if (ad[1] == 0)
-            {
-                ad[0]++;
-                if (ad[0] == 0x08)      // Address overflow
-                {
-                    stopPlaying();
-                    break;
-                }
-            }
+            soundToPlay = nsound;
+            playNext();
+            return;
         }
-        if (ad[0] == ad[3])     // Test end of sound
-            if (ad[1] == ad[4])
-                if (ad[2] == ad[5])
-                {
-                    stopPlaying();
-                    break;
-                }
+    }
+    stopPlaying();
+}
+#endif
+
+#if (OPT_SOUND_HEADER)
+/**
+ * \ingroup flash
+   \brief Go on with the next part of the sound once one has been read.
+   \return 0 at the end of the sound.
+
+   The intro, the loop and the tail follow each other in the flash, the
+   reading only goes back to the start of the loop to repeat it. The ADPCM
+   state is then restored to the one saved when the loop was first reached.
+ */
+static uint8_t playPart(void)
+{
+    if (play_part == PLAY_INTRO)
+    {
+#if (OPT_SOUND_ADPCM)
+        loop_adpcm = adpcm;
+#endif
+        play_part = PLAY_LOOP;
+        play_left = play_loop_len;
+    }
+    else if (play_part == PLAY_LOOP && play_loops)
+    {
+        if (play_loops != SOUND_LOOP_FOREVER)
+            play_loops --;
+        flash_unselect();
+        flash_select();
+        spiSend(READ_ARRAY_LOW_F);
+        spiSend(play_loop_addr >> 16);
+        spiSend(play_loop_addr >> 8);
+        spiSend(play_loop_addr);
+#if (OPT_SOUND_ADPCM)
+        adpcm = loop_adpcm;
+#endif
+        play_left = play_loop_len;
+    }
+    else if (play_part == PLAY_LOOP && play_tail)
+    {
+        play_part = PLAY_TAIL;
+        play_left = play_tail;
+    }
+    else
+        return 0;
+    return 1;
+}
+#endif
+
+/**
+ * \ingroup flash
+   \brief Wait until the SPI interrupt doesn't read the flash anymore.
+
+   Called before using the SPI for something else, the reading stops by
+   itself after the current byte when rf_txe is set.
+ */
+void playWait(void)
+{
+    while (play_busy)
+        ;
+}
+
+/**
+ * \ingroup flash
+   \brief Stop the sound before another command uses the flash.
+
+   The SPI interrupt leaves the flash selected in the middle of the sound when
+   the fifo is full, it's deselected here and the end of the sound is reported
+   as with PLAY_SOUND_CMD 0.
+ */
+void playStop(void)
+{
+    if (flashPlay)
+        stopPlaying();
+    playWait();
+}
+
+#if (OPT_SOUND_HEADER)
+/**
+ * \ingroup flash
+   \brief Convert a sample of the sound to 8kHz and add it to the fifo.
+
+   A phase accumulator gives the position of the samples played between the
+   previous sample of the sound and this one, each is interpolated between
+   both. There's none or one sample played when the rate is dropped, several
+   when it's raised.
+ */
+static void playRate(uint8_t sample)
+{
+    while (play_pos <= 256)
+    {
+        playSample(((uint16_t)play_prev * (256 - play_pos) +
+                    (uint16_t)sample * play_pos) >> 8);
+        play_pos += play_step;
+    }
+    play_pos -= 256;
+    play_prev = sample;
+}
+#endif
+
+/**
+ * \ingroup flash
+   \brief SPI interrupt, one byte of the sound has been read.
+
+   Other interrupts are allowed so the sampling interrupt isn't delayed by
+   the decoding.
+ */
+ISR(SPI_STC_vect, ISR_NOBLOCK)
+{
+    uint8_t sound = SPDR;
+
+#if (OPT_SOUND_ADPCM)
+    if (play_codec)
+    {
+        playRate(adpcm_decode(&adpcm, sound));
+        sound = adpcm_decode(&adpcm, sound >> 4);
+        /* The last byte of a sound of odd length holds a single sample. */
+        if (!(play_trim && play_left == 1 && play_part == PLAY_TAIL))
+            playRate(sound);
+    }
+    else
+#endif
+        playRate(sound);
+
+    /* Stopped or skipped sounds are left to playingSound() right away. */
+    if (--play_left && flashPlay && soundToPlay && !play_skip && !rf_txe &&
+        playSpace() >= play_need)
+    {
+        SPDR = NOP;
+    }
+    else
+    {
+        SPCR &= ~_BV(SPIE);
+        /* Stopped by another command. */
+        if (!flashPlay)
+            flash_unselect();
+        play_busy = 0;
     }
 }
 
@@ -502,6 +1151,7 @@ static void playingSound(void)
     */
 static void stopPlaying(void)
 {
+    clear_sounds();
     soundToPlay = 0;
     flashPlay = 0;
     queue_rf_cmd_p(STATUS_AUDIO_CMD, 0, 0, 0);
@@ -522,18 +1172,9 @@ static void stopPlaying(void)
 static void init_programming(uint8_t adi0, uint8_t adi1, uint8_t adi2)
 {
     uint8_t data;
-    write_enable();
-    flash_select();
-    spiSend(SEQU_PROGRAM);
-    spiSend(adi0);
-    spiSend(adi1);
-    spiSend(adi2);
-    if (AudioFifoGet(&data) == A_FIFO_OK)
-        spiSend(data);
-    else
-        spiSend(0x80);
-
-    flash_unselect();              // Chip Deselect
+    if (AudioFifoGet(&data) != A_FIFO_OK)
+        data = 0x80;
+    sequ_program_start(adi0, adi1, adi2, data);
 }
 
 
@@ -541,8 +1182,13 @@ static void init_programming(uint8_t adi0, uint8_t adi1, uint8_t adi2)
  * \ingroup flash
    \brief Program the sound's data into the flash memory
 
-    This function is executed while the SPI start command is not present.  Each
-    cycle, one byte is popped from the PWM fifo and stored in the sound flash.
+    This function is executed while the SPI start command is not present.
+    The audio fifo is the buffer of the sound bytes received by the RF, all
+    the bytes it holds are programmed in a row in sequential mode.
+
+    The flash programs a byte while the next one is popped from the fifo and
+    while the RF frames are exchanged, it's only polled before sending the
+    next byte.
 
     The frame_without_sound variable is decremented each time the RF receive a
     frame without sound.  When this variable is null, the sound process is
@@ -551,8 +1197,8 @@ static void init_programming(uint8_t adi0, uint8_t adi1, uint8_t adi2)
     If a programming sequence starts, but no sound is received, the cycle is
     stopped.
 
-    If the address is equal to 0x07FFFF (the last memory address), the programming
-    cycle is stopped.
+    If the address is equal to the last address of the flash, 0x07FFFF for
+    an AT26F004, the programming cycle is stopped.
 
     The sound_stored flag is set when at least one byte is stored in the memory.
     Else, this variable is null.
@@ -560,41 +1206,39 @@ static void init_programming(uint8_t adi0, uint8_t adi1, uint8_t adi2)
 
 static void programming_sound(void)
 {
-    while (!rf_txe)
+    /* Always read as the fifo holds step bytes, gcc can't tell. */
+    uint8_t data = 0x80, dropped;
+    /* Bytes popped for each byte stored. */
+    uint8_t step = (store_codec == CODEC_RAW) ? 2 : 1;
+
+    while (!rf_txe && AudioFifoLength() >= step)
     {
-        if (AudioFifoLength())
+        sound_stored = 1;
+        frame_without_sound = STOP_FRAME_NUMBER;
+
+        AudioFifoGet_inl(&data);
+        /* Drop one byte out of 2 to store in 8kHz. ADPCM and CODEC_RAW_8K
+         * are already sent at the storage rate. */
+        if (step == 2)
+            AudioFifoGet_inl(&dropped);
+
+        sequ_program(data);
+#if (OPT_PROG_RATE)
+        prog_bytes++;
+#endif
+
+        ad[2] ++;
+        if (ad[2] == 0x00)
         {
-            uint8_t data;
-            sound_stored = 1;
-            frame_without_sound = STOP_FRAME_NUMBER;
-
-            flash_select();
-            spiSend(SEQU_PROGRAM);
-            AudioFifoGet_inl(&data);
-            spiSend(data);
-            /* Drop one byte out of 2 to store in 8kHz */
-            AudioFifoGet_inl(&data);
-            flash_unselect();
-
-            ad[2] ++;
-            if (ad[2] == 0x00)
-            {
-                ad[1]++;
-                if (ad[1] == 0x00)
-                    ad[0]++;
-            }
-            if (ad[0] == 0x07 && ad[1] == 0xFF && ad[2] == 0xFF)
-            {
-                flash_state = 0;
-                break;
-            }
-            while (read_status() & BUSY) ;
+            ad[1]++;
+            if (ad[1] == 0x00)
+                ad[0]++;
         }
-        else
+        if (ad[0] == flash_top && ad[1] == TOP_A1 && ad[2] == TOP_A0)
         {
+            flash_state = 0;
             break;
         }
-
     }
     /* Check for the last sound byte */
     if (!(frame_without_sound))
@@ -603,3 +1247,35 @@ static void programming_sound(void)
     }
 }
 
+#if (OPT_PROG_RATE)
+/**
+ * \ingroup flash
+   \brief Return the throughput in bytes/s of a number of bytes stored in a
+   number of ticks of main_tick.
+ */
+static uint16_t prog_rate(uint32_t bytes, uint16_t ticks)
+{
+    /* A tick lasts 256 * 1024 / 8MHz, 512 / 15625 s. */
+    return (bytes * 125 / ticks) * 125 / 512;
+}
+
+/**
+ * \ingroup flash
+   \brief Send the programming throughput with STATUS_FLASH_PROG_CMD every
+   PROG_RATE_TICKS.
+ */
+static void prog_report(void)
+{
+    uint8_t ticks = main_tick - prog_tick;
+
+    if (ticks < PROG_RATE_TICKS)
+        return;
+    prog_tick += ticks;
+    prog_ticks += ticks;
+    prog_total += prog_bytes;
+    queue_rf_cmd_p(STATUS_FLASH_PROG_CMD, PROG_RATE,
+                   prog_rate(prog_bytes, ticks) >> 8,
+                   prog_rate(prog_bytes, ticks));
+    prog_bytes = 0;
+}
+#endif
@@ -34,6 +34,8 @@
 #ifndef FLASH_H
 #define FLASH_H
 
+#include "features.h"
+
 /** \name Flash programming states
   @{ */
 enum {
@@ -46,6 +48,127 @@ enum {
 };
 /* @} */
 
+/** \name Flash erase states
+  @{ */
+enum {
+    ERASE_START = 0,
+    ERASE_BUSY,
+    ERASE_TOC,
+};
+/* @} */
+
+/** \name Values of eraseFlag
+ * What erase() should erase.
+  @{ */
+#define ERASE_CHIP_FLAG     1   /**< The whole chip */
+#define ERASE_USED_FLAG     2   /**< The blocks up to the last sound */
+/* @} */
+
+/** \name Flash image states
+ * States of image(), which writes a block of WRITE_BLOCK_CMD.
+  @{ */
+enum {
+    IMAGE_ERASE = 0,
+    IMAGE_ERASING,
+    IMAGE_PROGRAM,
+    IMAGE_VERIFY,
+    IMAGE_END,
+};
+/* @} */
+
+/** \name Flash image blocks
+  @{ */
+#define IMAGE_BLOCK_SIZE    0x1000
+#define IMAGE_BLOCKS        128
+/* @} */
+
+/** \name Sound codecs
+ * Codec of a sound, given as parameter of STORE_SOUND_CMD.
+ @{ */
+enum {
+    CODEC_RAW = 0,      /**< 8-bit unsigned samples at 8kHz, sent at 16kHz */
+    CODEC_ADPCM,        /**< 4-bit IMA-ADPCM at 8kHz, see adpcm.h */
+    CODEC_RAW_8K,       /**< CODEC_RAW sent at 8kHz, every byte is stored */
+    CODEC_HEADER,       /**< Sound starting with a header, stored as is */
+};
+/** Last codec accepted by STORE_SOUND_CMD. */
+#if (OPT_SOUND_HEADER)
+#define CODEC_LAST          CODEC_HEADER
+#else
+#define CODEC_LAST          CODEC_RAW_8K
+#endif
+/* @} */
+
+/** \name TOC entries
+ * The AT26F004 only needs the 3 lower bits of the high address byte, the
+ * upper bits of the stop address of a sound tell its codec and if it starts
+ * with a header.
+ @{ */
+#define TOC_ADDR_MK     0x3F
+#define TOC_HEADER_MK   0x40
+#define TOC_ADPCM_MK    0x80
+/* @} */
+
+/** \name Sound header
+ * A sound flagged with TOC_HEADER_MK starts with this header, its samples
+ * follow. Sizes and sample positions are big-endian like the TOC. New fields
+ * are added at the end and HDR_SIZE tells where the samples start, so older
+ * firmwares can still play the sound. Without OPT_SOUND_HEADER these sounds
+ * aren't played.
+ @{ */
+enum {
+    HDR_VERSION = 0,    /**< Version of the header, SOUND_HDR_VERSION */
+    HDR_SIZE,           /**< Size of the header in bytes */
+    HDR_CODEC,          /**< CODEC_RAW_8K or CODEC_ADPCM */
+    HDR_LOOPS,          /**< Times the loop is repeated, SOUND_LOOP_FOREVER */
+    HDR_RATE,           /**< Sample rate in Hz, 2 bytes, see PLAY_RATE_MIN */
+    HDR_LENGTH = 6,     /**< Length in samples, 3 bytes */
+    HDR_LOOP_START = 9, /**< First sample of the loop, 3 bytes */
+    HDR_LOOP_END = 12,  /**< Sample following the loop, 3 bytes */
+};
+#define SOUND_HDR_VERSION   1
+#define SOUND_HDR_SIZE      15
+/** The loop is played until the sound is stopped by another command. */
+#define SOUND_LOOP_FOREVER  0xFF
+/* @} */
+
+/** \name Playback rates
+ * The sounds are played at 8kHz. The rate of a header can be anything from
+ * PLAY_RATE_MIN to PLAY_RATE_MAX, each sample played is interpolated between
+ * the 2 samples of the sound around it. A sound of another rate isn't played.
+ @{ */
+#define PLAY_RATE           8000
+#define PLAY_RATE_MIN       2000
+#define PLAY_RATE_MAX       32000
+/* @} */
+
+/** Number of sounds that can be queued after the one being played. */
+#define PLAY_QUEUE_SIZE     8
+
+/** \name Sound numbers above 255
+ * Bits 8 and 9 of the sound number are sent in the high bits of the second
+ * parameter of PLAY_SOUND_CMD, QUEUE_SOUND_CMD and DELETE_SOUND_CMD, the
+ * attenuation keeps the low nibble.
+ @{ */
+#define SOUND_HI_MK         0xC0
+#define SOUND_LEVEL_MK      0x0F
+#define sound_number(lo, param) \
+    ((lo) | ((uint16_t)((param) & SOUND_HI_MK) << 2))
+/* @} */
+
+/** \name Parts of a looped sound
+ @{ */
+enum {
+    PLAY_INTRO = 0,     /**< Samples before the loop */
+    PLAY_LOOP,          /**< The loop, repeated */
+    PLAY_TAIL,          /**< Samples after the loop, or the whole sound */
+};
+/* @} */
+
+/** Ticks of main_tick between two reports of the programming throughput,
+ * about 1s. */
+#define PROG_RATE_TICKS 32
+
 /** \name No sound in frame timeout 
   @{ */
 #define STOP_FRAME_NUMBER  10
@@ -70,9 +193,19 @@ enum {
 
 extern void programming(void);
 extern void playSound(void);
+extern void playWait(void);
+extern void playStop(void);
+#if (OPT_SOUND_QUEUE)
+extern void queue_sound(uint16_t nsound, uint8_t level);
+extern void clear_sounds(void);
+extern void skip_sound(void);
+#else
+#define clear_sounds()
+#endif
 extern void erase(void);
-extern uint8_t readFlashNumber(void);
-extern uint8_t readLastBlock(uint8_t num);
+#if (OPT_FLASH_IMAGE)
+extern void image(void);
+#endif
 extern void enter_deep_sleep(void);
 extern void leave_deep_sleep(void);
 
@@ -36,6 +36,12 @@
 #include "communication.h"
 #include "parser.h"
 #include "flash.h"
+#include "AT26F004.h"
+#include "toc.h"
+#if (OPT_SOUND_DELETE)
+#include "compact.h"
+#endif
+#include "checksum.h"
 #include "config.h"
 #include "audio_fifo.h"
 #include "micro_fifo.h"
@@ -44,6 +50,10 @@
  * Debug and test flags
  */
 #define DBG_STACK 0
+/* Measure the duration of the sampling interrupt, set by 'make isr_cycles' */
+#ifndef DBG_ISR_CYCLES
+#define DBG_ISR_CYCLES 0
+#endif
 
 /*
  * Stack Overflow detection
@@ -81,9 +91,40 @@ int8_t check_stack(void)
 #define check_stack() 1
 #endif
 
+/*
+ * Sampling interrupt duration
+ *
+ * The longest time between the timer 0 overflow and the end of the sampling
+ * ISR is kept for the speaker only calls and for the speaker and microphone
+ * ones. It's sent with the sensors as a debug status (0xFE) with these 2
+ * values, in cycles, as parameters. The epilogue of the ISR isn't included,
+ * take it from the listing (tuxaudio.lss).
+ */
+#if (DBG_ISR_CYCLES)
+#define DBG_ISR_CYCLES_CMD 0xFE
+static uint8_t isr_cycles[2];
+#endif
+
 /* When sensor values should be sent to the computer */
 static bool send_sensors_flag;
 
+/**
+ * \brief Power the microphone, its supply is ramped up slowly by toggling
+ * PD0 and PD1.
+ */
+static void power_micro(void)
+{
+    volatile uint16_t _count;
+    for (_count = 0; _count<0x0DFF; _count++)
+    {
+        volatile uint8_t i;
+        for (i=0x0F; i>((_count>>8)+2); i--)
+            DDRD &= ~0x03;
+        for (; i>0;i--)
+            DDRD |= 0x03;
+    }
+}
+
 //ISR(SIG_PIN_CHANGE1)
 ISR(PCINT1_vect) /* Mise  jour 03/12/2013 - Jol Matteotti <sf user: joelmatteotti> */
 {
@@ -156,16 +197,7 @@ void sleep(void)
     PRR = PRR_bak;
 
     init_avr();
-    /* Power the microphone */
-    volatile uint16_t _count;
-    for (_count = 0; _count<0x0DFF; _count++)
-    {
-        volatile uint8_t i;
-        for (i=0x0F; i>((_count>>8)+2); i--)
-            DDRD &= ~0x03;
-        for (; i>0;i--)
-            DDRD |= 0x03;
-    }
+    power_micro();
 
     initCommunicationBuffers();
     communication_init();
@@ -223,16 +255,7 @@ int main(void)
 
     /* Reset the RF to eliminate timing uncertainties */
     PORTB &= ~0x80;
-    /* Power the microphone */
-    volatile uint16_t _count;
-    for (_count = 0; _count<0x0DFF; _count++)
-    {
-        volatile uint8_t i;
-        for (i=0x0F; i>((_count>>8)+2); i--)
-            DDRD &= ~0x03;
-        for (; i>0;i--)
-            DDRD |= 0x03;
-    }
+    power_micro();
     /* Start the RF */
     PORTB |= 0x80;
 
@@ -241,8 +264,11 @@ int main(void)
     MicroFifoClear();
     /* Load configuration defaults from EEPROM */
     config_init();
-    numSound = readFlashNumber();
-    last_block = readLastBlock(numSound);
+#if (OPT_FLASH_DETECT)
+    /* The geometry of the flash is needed to load its TOC. */
+    flash_detect();
+#endif
+    toc_load();
     communication_init();
 
     /* Wait for the RF board to signal itself with a stong low on PB6 */
@@ -277,6 +303,21 @@ int main(void)
 
             if (eraseFlag)
                 erase();
+
+#if (OPT_FLASH_IMAGE)
+            if (imageFlag)
+                image();
+#endif
+
+#if (OPT_SOUND_DELETE)
+            if (compactFlag)
+                compact();
+#endif
+
+#if (OPT_FLASH_CRC)
+            if (checksumFlag)
+                checksum();
+#endif
         }
 
         /* Send commands to I2C, otherwise get new status from tuxcore */
@@ -300,6 +341,10 @@ int main(void)
             sendSensors();
             /* XXX debug of the audio stack */
             //queue_rf_cmd_p(0xFE, FifoLength(PWMFifo), OCR0A, 0);
+#if (DBG_ISR_CYCLES)
+            queue_rf_cmd_p(DBG_ISR_CYCLES_CMD, isr_cycles[0], isr_cycles[1],
+                           0);
+#endif
         }
     }
 }
@@ -311,6 +356,7 @@ int main(void)
 ISR(TIMER2_OVF_vect) /* Mise  jour 03/12/2013 - Jol Matteotti <sf user: joelmatteotti> */
 {
     send_sensors_flag = true;
+    main_tick++;
 }
 
 //static inline void audio_sampling(void) __attribute__ ( ( always_inline ) );
@@ -381,17 +427,46 @@ ISR(TIMER2_OVF_vect) /* Mise 
 ISR(__vector_audio_sampling)
 {
     //FifoPut(ADCFifo, ADCH);
+    /* Odd calls sample the microphone and the 8kHz speaker samples. */
+    sampling_pwm++;
 
     /* Speaker at 16kHz */
-    AudioFifoGet_inl((uint8_t *)&OCR0B);
+    if (AudioHalfRate)
+    {
+        /* 8kHz samples, output the mean of 2 samples between them. */
+        static uint8_t last, cur;
+
+        if (sampling_pwm & 0x01)
+        {
+            AudioFifoGet_inl(&cur);
+            OCR0B = ((uint16_t)last + cur) >> 1;
+        }
+        else
+        {
+            OCR0B = cur;
+            last = cur;
+        }
+    }
+    else
+        AudioFifoGet_inl((uint8_t *)&OCR0B);
 
-    if (sampling_pwm & 0x02)
+    if (sampling_pwm & 0x01)
     {
         /* Microphone at 8kHz */
         MicroFifoPut_inl(ADCH);
         ADCSRA |= 0x40;
     }
 
+#if (DBG_ISR_CYCLES)
+    {
+        /* The timer counts the cycles since the overflow. */
+        uint8_t cycles = TCNT0;
+
+        if (cycles > isr_cycles[sampling_pwm & 0x01])
+            isr_cycles[sampling_pwm & 0x01] = cycles;
+    }
+#endif
+
     // XXX DEBUG: used to generate a saw waveform
     //static uint8_t cnt = 0;
     //static uint8_t dir = 1;
@@ -408,56 +483,25 @@ ISR(__vector_audio_sampling)
 /*
  * Timer 0 overflow interrupt service routine (PWM)
  * 32KHz timer so the ISR is called each 31.25us
+ *
+ * One overflow out of two jumps to the sampling ISR which then returns by
+ * itself. The divider is bit 0 of GPIOR0, sbic, sbi and cbi don't change SREG
+ * so nothing has to be saved. Cycles counted from the interrupt request,
+ * including the 4 cycles of the response and the rjmp of the vector table:
+ *   - idle overflow: 4 + 2 + 2 (sbic, skip) + 2 (sbi) + 4 (reti) = 14;
+ *   - sampling overflow: 4 + 2 + 1 (sbic) + 2 (rjmp) + 2 (cbi) + 2 (rjmp)
+ *     = 13 before the prologue of __vector_audio_sampling.
+ * Add up to 3 cycles of latency if a multi-cycle instruction was running.
+ * The duration of the sampling ISR can be measured with DBG_ISR_CYCLES.
  */
-#if 1
-//ISR(SIG_OVERFLOW0)
-ISR(TIMER0_OVF_vect) /* Mise  jour 03/12/2013 - Jol Matteotti <sf user: joelmatteotti> */
-{
-    /* timer 0 is clocked at 32KHz so we divide it by 4 to get 8KHz */
-    if (++sampling_pwm & 0x01)
-    {
-        asm("rcall __vector_audio_sampling"::);
-        cli();
-    }
-}
-#endif
-
-#if 0
-ISR(SIG_OVERFLOW0) __attribute__((naked));
-ISR(SIG_OVERFLOW0)
+ISR(TIMER0_OVF_vect, ISR_NAKED)
 {
-    asm volatile (
-        "in	r0, 0x3f" "\n\t"
-        "push	r28" "\n\t"
-        "lds	r28, 0x0100" "\n\t"
-        "subi	r28, 0xFF" "\n\t"
-        "sts	0x0100, r28" "\n\t"
-        "sbrs	r28, 0" "\n\t"
-        "rjmp	v_out" "\n\t"
-        "rcall __vector_audio_sampling" "\n\t"
-        "cli" "\n\t"
-        "v_out:"
-        "pop	r28" "\n\t"
-        "out	0x3f, r0" "\n\t"
-        ::);
-    asm ("reti" "\n\t"::);
+    asm (
+        "sbic %0, 0" "\n\t"
+        "rjmp 1f" "\n\t"
+        "sbi %0, 0" "\n\t"
+        "reti" "\n\t"
+        "1: cbi %0, 0" "\n\t"
+        "rjmp __vector_audio_sampling" "\n\t"
+        :: "I" (_SFR_IO_ADDR(GPIOR0)));
 }
-#endif
-//ISR(SIG_OVERFLOW0) __attribute__((naked));
-//ISR(SIG_OVERFLOW0)
-//{
-    ////asm volatile (
-        ////"in __tmp_reg__,__SREG__" "\n\t"
-        ////"push r24" "\n\t"
-        ////"lds r24, sampling_pwm" "\n\t"
-        ////"subi r24, 0x01" "\n\t"
-        ////"andi r24, 0x03" "\n\t"
-        ////"sts sampling_pwm, r24" "\n\t"
-        ////"brne 1f" "\n\t"
-        ////"rcall audio_sampling" "\n\t"
-        ////"1: cli" "\n\t"
-        ////"1: pop r24" "\n\t"
-        ////"out  __SREG__, __tmp_reg__" "\n\t"
-        ////"reti" "\n\t"
-        ////::);
-//}
@@ -24,8 +24,7 @@
 
 uint8_t MicroInIdx = 0;
 uint8_t MicroOutIdx = 0;
-uint8_t MicroFifoSize = 64;
-uint8_t MicroBuffer[64];
+uint8_t MicroBuffer[MicroFifoSize];
 
 /* Empty the buffer by clearing the indexes. */
 void MicroFifoClear(void)
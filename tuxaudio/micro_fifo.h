@@ -22,6 +22,10 @@
 #ifndef _MICRO_FIFO_H_
 #define _MICRO_FIFO_H_
 
+/** Size of the fifo, a power of 2. It's a constant so the sampling interrupt
+ * doesn't have to load it. */
+#define MicroFifoSize 64
+
 #define MicroFifoLength() (uint8_t)(MicroInIdx - MicroOutIdx)
 
 enum MICRO_FIFO_STATUS {M_FIFO_OK = 0, M_FIFO_FULL, M_FIFO_EMPTY};
@@ -32,7 +36,6 @@ int8_t MicroFifoGet(uint8_t *data);
 
 extern uint8_t MicroInIdx;
 extern uint8_t MicroOutIdx;
-extern uint8_t MicroFifoSize;
 extern uint8_t MicroBuffer[];
 
 
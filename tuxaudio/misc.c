@@ -26,6 +26,7 @@
 #include "communication.h"
 #include "version.h"
 #include "varis.h"
+#include "toc.h"
 
 /*
  * Version number
@@ -53,5 +54,5 @@ void send_info(void)
     queue_rf_cmd((uint8_t const *) buf+4);
     queue_rf_cmd((uint8_t const *) buf+8);
     /* Send extra information */
-    queue_rf_cmd_p(SOUND_VAR_CMD, numSound, last_block, 0);
+    toc_send();
 }
@@ -0,0 +1,163 @@
+/*
+ * TUXAUDIO - Firmware for the 'audio' CPU of tuxdroid
+ * Copyright (C) 2007 C2ME S.A. <tuxdroid@c2me.be>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* $Id$ */
+
+#include "mixer.h"
+#include "fifo.h"
+#include "audio_fifo.h"
+#include "varis.h"
+
+uint8_t mixer_rf_active;
+
+#if (OPT_MIXER)
+uint8_t mixer_gain[2] = {MIXER_UNITY, MIXER_UNITY};
+uint8_t mixer_flash;
+
+FIFO_INSTANCE(flash_buf, MIXER_FIFO_SIZE);
+/** Flash samples waiting to be mixed, at 8kHz. */
+static fifo_t *flash_fifo = FifoPointer(flash_buf);
+
+/** Interpolation of the flash samples. */
+static uint8_t flash_last, flash_cur, flash_phase;
+
+/**
+ * \ingroup mixer
+ * \brief Return the signed contribution of a sample scaled by a gain.
+ */
+static int16_t contribution(uint8_t sample, uint8_t gain)
+{
+    return ((int16_t)(int8_t)(sample - 0x80) * gain) >> 7;
+}
+
+/**
+ * \ingroup mixer
+ * \brief Convert a signed sum back to an unsigned sample, saturated.
+ */
+static uint8_t saturate(int16_t sum)
+{
+    if (sum > 127)
+        sum = 127;
+    else if (sum < -128)
+        sum = -128;
+    return sum + 0x80;
+}
+
+/**
+ * \ingroup mixer
+ * \brief Scale a sample.
+ * \param sample Unsigned sample.
+ * \param gain Gain, MIXER_UNITY for 1.
+ * \return The scaled sample.
+ */
+uint8_t mixer_scale(uint8_t sample, uint8_t gain)
+{
+    return saturate(contribution(sample, gain));
+}
+
+/**
+ * \ingroup mixer
+ * \brief Mix an RF sample with the flash sound.
+ * \param sample RF sample at 16kHz.
+ * \return The sample to push in the audio fifo.
+ *
+ * The flash samples are interpolated like in the sampling interrupt. If the
+ * flash fifo runs empty while the sound is playing, the last sample is held.
+ */
+uint8_t mixer_rf(uint8_t sample)
+{
+    int16_t sum = contribution(sample, mixer_gain[MIX_RF]);
+    uint8_t flash;
+
+    if (!mixer_flash)
+        return saturate(sum);
+
+    if (flash_phase ^= 1)
+    {
+        if (FifoGet(flash_fifo, &flash_cur) != FIFO_OK && !flashPlay)
+        {
+            /* End of the sound. */
+            mixer_flash = 0;
+            return saturate(sum);
+        }
+        flash = ((uint16_t)flash_last + flash_cur) >> 1;
+    }
+    else
+    {
+        flash = flash_cur;
+        flash_last = flash_cur;
+    }
+    sum += contribution(flash, mixer_gain[MIX_FLASH] >> audioLevel);
+    return saturate(sum);
+}
+
+/**
+ * \ingroup mixer
+ * \brief Add a flash sample to be mixed.
+ */
+void mixer_flash_put(uint8_t sample)
+{
+    FifoPut(flash_fifo, sample);
+}
+
+/**
+ * \ingroup mixer
+ * \brief Return the number of flash samples that can be added.
+ */
+uint8_t mixer_flash_space(void)
+{
+    return MIXER_FIFO_SIZE - FifoLength(flash_fifo);
+}
+
+/**
+ * \ingroup mixer
+ * \brief Mix the flash sound with the RF stream.
+ *
+ * Called when a sound starts during a stream or when a stream starts during a
+ * sound. In the latter case, the flash samples already in the audio fifo are
+ * dropped, that's at most 16ms of the sound.
+ */
+void mixer_start(void)
+{
+    if (!mixer_flash && AudioHalfRate)
+        AudioFifoClear();
+    AudioHalfRate = 0;
+    FifoClear(flash_fifo);
+    flash_last = flash_cur = 0x80;
+    flash_phase = 0;
+    mixer_flash = 1;
+}
+
+/**
+ * \ingroup mixer
+ * \brief Stop mixing when the RF stream stops, the rest of the flash sound
+ * goes to the audio fifo.
+ */
+void mixer_stop(void)
+{
+    uint8_t sample;
+
+    if (!mixer_flash)
+        return;
+    mixer_flash = 0;
+    AudioHalfRate = 1;
+    while (FifoGet(flash_fifo, &sample) == FIFO_OK)
+        AudioFifoPut(mixer_scale(sample, mixer_gain[MIX_FLASH] >> audioLevel));
+}
+#endif
@@ -0,0 +1,91 @@
+/*
+ * TUXAUDIO - Firmware for the 'audio' CPU of tuxdroid
+ * Copyright (C) 2007 C2ME S.A. <tuxdroid@c2me.be>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* $Id$ */
+
+/** \defgroup mixer Speaker mixer
+    \ingroup mixer
+
+    Mixes a sound played from the flash over the speaker stream received from
+    the RF.
+
+    When no stream is received, the flash sound goes to the audio fifo at 8kHz
+    as before, only scaled by its gain. When a stream is received, the flash
+    samples are queued in a small fifo instead and added to each RF sample
+    before it's pushed in the audio fifo, interpolated to 16kHz. The sampling
+    interrupt doesn't change.
+
+    The gains are unsigned with 128 (MIXER_UNITY) being a gain of 1. They
+    apply to the signal around the mid level 0x80 and the mix is saturated.
+*/
+
+/** \file mixer.h
+    \ingroup mixer
+*/
+/** \file mixer.c
+    \ingroup mixer
+*/
+
+#ifndef MIXER_H
+#define MIXER_H
+
+#include <stdint.h>
+#include "features.h"
+
+/** \name Mixer sources
+  @{ */
+enum {
+    MIX_RF = 0,
+    MIX_FLASH,
+};
+/* @} */
+
+/** Gain of 1. */
+#define MIXER_UNITY 128
+/** Size of the fifo of the flash samples while mixing. */
+#define MIXER_FIFO_SIZE 32
+/** Number of frames without audio after which the RF stream is considered
+ * stopped. */
+#define MIXER_RF_TIMEOUT 10
+
+/** Frames left before the RF stream is considered stopped, null when there's
+ * no stream. */
+extern uint8_t mixer_rf_active;
+
+#if (OPT_MIXER)
+/** Gain of each source. */
+extern uint8_t mixer_gain[2];
+/** Set when the flash sound goes through the mixer. */
+extern uint8_t mixer_flash;
+
+extern uint8_t mixer_scale(uint8_t sample, uint8_t gain);
+extern uint8_t mixer_rf(uint8_t sample);
+extern void mixer_flash_put(uint8_t sample);
+extern uint8_t mixer_flash_space(void);
+extern void mixer_start(void);
+extern void mixer_stop(void);
+#else
+/* The RF stream is held back while a sound is played from the flash. */
+#define mixer_flash         0
+#define mixer_rf(sample)    (sample)
+#define mixer_start()
+#define mixer_stop()
+#endif
+
+#endif
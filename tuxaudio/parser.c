@@ -28,6 +28,9 @@
 #include "misc.h"
 #include "varis.h" /* XXX remove this one */
 #include "flash.h" /* XXX remove this one */
+#include "checksum.h"
+#include "config.h"
+#include "mixer.h"
 
 /**
  * Parse a cmd received by the computer or by tuxcore and drop it if it
@@ -55,19 +58,56 @@ bool parse_cmd(uint8_t *cmd)
     {
         send_info();
     }
-    else if (cmd[0] == PLAY_SOUND_CMD)
+    else if (cmd[0] == PLAY_SOUND_CMD || (OPT_SOUND_QUEUE &&
+                                          cmd[0] == QUEUE_SOUND_CMD))
         /* param: cmd[1] : sound number */
         /* cmd[2] : mic sound intensity  */
     {
-        /* Drop the cmd if a sound is already playing */
-        if (!(flashPlay || programmingFlash))
+        /* Sound 0 stops the sound being played and clears the queue. */
+        if (cmd[0] == PLAY_SOUND_CMD && !sound_number(cmd[1], cmd[2]))
+            soundToPlay = 0;
+#if (OPT_SOUND_QUEUE)
+        else if (cmd[0] == QUEUE_SOUND_CMD && flashPlay)
+            queue_sound(sound_number(cmd[1], cmd[2]), cmd[2]);
+#endif
+        /* Drop the cmd if a sound is already playing or the flash is
+         * written */
+        else if (!(flashPlay || programmingFlash || eraseFlag || imageFlag ||
+                   compactFlag || checksumFlag))
         {
-            audioLevel = cmd[2];
-            soundToPlay = cmd[1];
+            clear_sounds();
+            audioLevel = cmd[2] & SOUND_LEVEL_MK;
+            soundToPlay = sound_number(cmd[1], cmd[2]);
             flashPlay = 1;
             flash_state = 1;
         }
     }
+#if (OPT_MIC_VAD)
+    else if (cmd[0] == MIC_VAD_CMD)
+    {
+        tuxaudio_config.vad_threshold = cmd[1];
+        tuxaudio_config.vad_hangover = cmd[2];
+    }
+#endif
+#if (OPT_RATE_REQ)
+    else if (cmd[0] == AUDIO_RATE_REQ_CMD)
+    {
+        send_audio_rate();
+    }
+#endif
+#if (OPT_LINK_STATS)
+    else if (cmd[0] == LINK_STATS_REQ_CMD)
+    {
+        send_link_stats();
+    }
+#endif
+#if (OPT_MIXER)
+    else if (cmd[0] == MIXER_GAIN_CMD)
+    {
+        mixer_gain[MIX_RF] = cmd[1];
+        mixer_gain[MIX_FLASH] = cmd[2];
+    }
+#endif
     else if (cmd[0] == MUTE_CMD)
     {
         if (cmd[1])
@@ -75,17 +115,99 @@ bool parse_cmd(uint8_t *cmd)
         else
             unmute_amp();
     }
-    else if (cmd[0] == STORE_SOUND_CMD)
+#if (OPT_SOUND_QUEUE)
+    else if (cmd[0] == SKIP_SOUND_CMD)
     {
         if (flashPlay)
-            flashPlay = 0;
+            skip_sound();
+    }
+    else if (cmd[0] == CLEAR_QUEUE_CMD)
+    {
+        clear_sounds();
+    }
+#endif
+    else if (cmd[0] == STORE_SOUND_CMD)
+    {
+        /* The sound would be stored after the ones being moved or in blocks
+         * being erased, and a CRC would end the sequential programming. */
+        if (imageFlag || compactFlag || checksumFlag || eraseFlag)
+            return true;
+        /* An unknown codec would be stored as is and played at the wrong
+         * rate. */
+        if (cmd[1] > CODEC_LAST ||
+            (!OPT_SOUND_ADPCM && cmd[1] == CODEC_ADPCM) ||
+            (!OPT_BULK && cmd[2]))
+        {
+            queue_rf_cmd_p(STATUS_FLASH_PROG_CMD, UNKNOWN_CODEC, cmd[1], 0);
+            return true;
+        }
+        playStop();
+        store_codec = cmd[1];
+#if (OPT_BULK)
+        store_bulk = cmd[2];
+        /* Bulk bytes are stored as is. */
+        if (store_bulk && store_codec == CODEC_RAW)
+            store_codec = CODEC_RAW_8K;
+#endif
         flash_state = 1; /* Erasing flash flag */
         programmingFlash = 1; /* Set the flag to enter programming sequence */
     }
     else if (cmd[0] == ERASE_FLASH_CMD)
     {
-        eraseFlag = 1;
+        /* Not under a sound or a block being written or read back. */
+        if (!(eraseFlag || compactFlag || programmingFlash || imageFlag ||
+              checksumFlag))
+        {
+            playStop();
+            eraseFlag = cmd[1] ? ERASE_USED_FLAG : ERASE_CHIP_FLAG;
+        }
+    }
+#if (OPT_FLASH_IMAGE)
+    else if (cmd[0] == WRITE_BLOCK_CMD)
+    {
+        /* One block at a time, and not while a sound is stored or
+         * checked. */
+        if (!(programmingFlash || eraseFlag || imageFlag || compactFlag ||
+              checksumFlag) &&
+            cmd[1] < IMAGE_BLOCKS)
+        {
+            playStop();
+            image_block = cmd[1];
+            imageFlag = 1;
+        }
+    }
+#endif
+#if (OPT_SOUND_DELETE)
+    else if (cmd[0] == DELETE_SOUND_CMD)
+    {
+        if (!(programmingFlash || eraseFlag || imageFlag || compactFlag ||
+              checksumFlag) &&
+            sound_number(cmd[1], cmd[2]) &&
+            sound_number(cmd[1], cmd[2]) <= numSound)
+        {
+            playStop();
+            delete_sound = sound_number(cmd[1], cmd[2]);
+            compactFlag = 1;
+        }
     }
+#endif
+#if (OPT_FLASH_CRC)
+    else if (cmd[0] == CRC_SOUND_CMD || cmd[0] == CRC_RANGE_CMD)
+    {
+        /* One at a time, the sound or blocks are checked by checksum(). Its
+         * reads would end the sequential programming of the flash. */
+        if (!(checksumFlag || programmingFlash || imageFlag || compactFlag ||
+              eraseFlag))
+        {
+            playStop();
+            /* The first block has the high bits of a sound number. */
+            checksum_first = sound_number(cmd[1], cmd[2]);
+            checksum_blocks = (cmd[2] & ~SOUND_HI_MK) + 1;
+            checksumFlag = (cmd[0] == CRC_SOUND_CMD) ?
+                CHECKSUM_SOUND_FLAG : CHECKSUM_RANGE_FLAG;
+        }
+    }
+#endif
     else if (cmd[0] == CONFIRM_STORAGE_CMD)
     {
         if (cmd[1])
@@ -93,12 +215,30 @@ bool parse_cmd(uint8_t *cmd)
         else
             write_toc = 2;
     }
+#if (OPT_CMD_PACK)
+    else if (cmd[0] == PACKED_CMDS_CMD)
+    {
+        cmd_pack_set(cmd[1]);
+        /* Tell the computer the format is known. */
+        queue_rf_cmd_p(PACKED_CMDS_CMD, cmd[1] ? 1 : 0, CMD_PACK_IN_MAX,
+                       CMD_PACK_OUT_MAX);
+    }
+#endif
+#if (OPT_CMD_WINDOW)
+    else if (cmd[0] == WINDOWED_CMDS_CMD)
+    {
+        cmd_window_start();
+        queue_rf_cmd_p(WINDOWED_CMDS_CMD, CMD_WINDOW, 0, 0);
+    }
+#endif
     else if (cmd[0] == CONNECT_ID_CMD)
     {
-        /* Send it back as an ack */
-        /* XXX check if the problem is here */
-        uint8_t tmp[4];
-        popStatus(tmp);
+#if (!OPT_CMD_URGENT)
+        /* The replies share the stack of the status, drop one so there's
+         * room for the ack. */
+        drop_status();
+#endif
+        /* Send it back as an ack. */
         queue_rf_cmd(cmd);
     }
     else if (cmd[0] == SLEEP_CMD)
@@ -106,6 +246,11 @@ bool parse_cmd(uint8_t *cmd)
         if (cmd[1] == SLEEPTYPE_QUICK)
         {
             sleep_f = true;
+            /* The sound must end before sleeping and the commands are now
+             * dropped, stop it as with sound 0 otherwise a sound looping
+             * forever or a queue keeps tuxaudio awake. */
+            clear_sounds();
+            soundToPlay = 0;
             /* We need to be sure there's enough place for the sleep commands
              * and we don't need the other commands/status anymore. */
             initCommunicationBuffers();
@@ -0,0 +1,261 @@
+/*
+ * TUXAUDIO - Firmware for the 'audio' CPU of tuxdroid
+ * Copyright (C) 2007 C2ME S.A. <tuxdroid@c2me.be>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* $Id$ */
+
+/** \file at26f004.c
+    \brief Model of the AT26F004 serial flash, replacing spi.c on the host.
+
+    Other parts can be modelled with sim_flash_set_part(), they only differ
+    by their JEDEC ID, their size and the sequential program mode.
+
+    Only the opcodes used by the firmware are decoded. A transaction starts
+    with the first byte sent after the chip select has been released. Writes
+    need the write enable latch, clear bits like the real NOR array and keep
+    the part busy for a while, during which everything but the status read is
+    ignored.
+*/
+
+#include <string.h>
+#include <avr/io.h>
+
+#include "sim.h"
+#include "../hardware.h"
+#include "../spi.h"
+#include "../AT26F004.h"
+
+/** \name Busy times of the model, in CPU cycles.
+ * @{ */
+#define T_BYTE_PROGRAM  (20 * SIM_CYCLES_PER_US)
+#define T_BLOCK_ERASE   (50000 * SIM_CYCLES_PER_US)
+#define T_CHIP_ERASE    (5000000ULL * SIM_CYCLES_PER_US)
+/* @} */
+
+/** Parts that can be modelled, the first one is the default. */
+static struct sim_flash_part const parts[] = {
+    {"at26f004", {0x1F, 0x04, 0x00}, SIM_FLASH_SIZE, true},
+    {"at25df041a", {0x1F, 0x44, 0x01}, 0x80000, false},
+    {"w25q16", {0xEF, 0x40, 0x15}, 0x200000, false},
+    {"w25q32", {0xEF, 0x40, 0x16}, 0x400000, false},
+    /* Not known by the firmware, taken as an AT26F004. */
+    {"unknown", {0x12, 0x34, 0x56}, SIM_FLASH_SIZE, true},
+};
+
+uint8_t sim_flash[SIM_FLASH_MAX];
+struct sim_flash_part sim_flash_part = parts[0];
+struct sim_flash_stats sim_flash_stats;
+
+static uint8_t opcode;
+static uint8_t count;
+static uint32_t address;
+static bool wel;
+static bool deep_sleep;
+/* Set after the first sequential program command, the following ones only
+ * carry the data byte. */
+static bool sequential;
+static uint64_t busy_until;
+
+/**
+ * \brief Select the part modelled by its name, return false if unknown.
+ *
+ * sim_flash_init() should be called next.
+ */
+bool sim_flash_set_part(char const *name)
+{
+    unsigned i;
+
+    for (i = 0; i < sizeof parts / sizeof parts[0]; i++)
+        if (!strcmp(parts[i].name, name))
+        {
+            sim_flash_part = parts[i];
+            return true;
+        }
+    return false;
+}
+
+/**
+ * \brief Erase the whole array and reset the model.
+ */
+void sim_flash_init(void)
+{
+    memset(sim_flash, 0xFF, sizeof sim_flash);
+    memset(&sim_flash_stats, 0, sizeof sim_flash_stats);
+    wel = false;
+    deep_sleep = false;
+    sequential = false;
+    busy_until = 0;
+}
+
+static void erase(uint32_t start, uint32_t size, uint64_t time)
+{
+    start &= ~(size - 1);
+    memset(&sim_flash[start % sim_flash_part.size], 0xFF, size);
+    sim_flash_stats.erased_blocks += size >> 12;
+    busy_until = sim_cycles + time;
+    wel = false;
+}
+
+static void program(uint8_t data)
+{
+    sim_flash[address++ % sim_flash_part.size] &= data;
+    sim_flash_stats.programmed++;
+    busy_until = sim_cycles + T_BYTE_PROGRAM;
+}
+
+/*
+ * Process one byte of the current transaction. 'count' is the position of
+ * the byte in the transaction, the opcode being 0.
+ */
+static uint8_t flash_byte(uint8_t data)
+{
+    bool busy = sim_cycles < busy_until;
+
+    if (count == 0)
+    {
+        opcode = data;
+        if (deep_sleep && opcode != RESUME_DEEP_MODE)
+            opcode = NOP;
+        else if (busy && opcode != READ_STATUS_REG)
+            opcode = NOP;
+        else if (opcode == SEQU_PROGRAM && !sim_flash_part.sequential)
+            opcode = NOP;
+        if (opcode != SEQU_PROGRAM && opcode != READ_STATUS_REG &&
+            opcode != NOP)
+            sequential = false;
+        switch (opcode)
+        {
+        case WRITE_EN:
+            wel = true;
+            break;
+        case WRITE_DIS:
+            wel = false;
+            break;
+        case CHIP_ERASE:
+            if (wel)
+                erase(0, sim_flash_part.size, T_CHIP_ERASE);
+            break;
+        case DEEP_POWER_MODE:
+            deep_sleep = true;
+            break;
+        case RESUME_DEEP_MODE:
+            deep_sleep = false;
+            break;
+        }
+        return 0xFF;
+    }
+
+    switch (opcode)
+    {
+    case READ_STATUS_REG:
+        return (busy ? BUSY : 0) | (wel ? WEL : 0);
+    case READ_MANUFACT:
+        return count <= 3 ? sim_flash_part.id[count - 1] : 0x00;
+    case SEQU_PROGRAM:
+        if (sequential)
+        {
+            if (count == 1 && wel)
+                program(data);
+            return 0xFF;
+        }
+        break;
+    case NOP:
+        return 0xFF;
+    }
+
+    /* Address bytes, MSB first */
+    if (count <= 3)
+    {
+        if (count == 1)
+            address = 0;
+        address = (address << 8) | data;
+        if (count == 3 && wel)
+        {
+            if (opcode == BLOCK_ERASE_4K)
+                erase(address, 0x1000, T_BLOCK_ERASE);
+            else if (opcode == BLOCK_ERASE_32K)
+                erase(address, 0x8000, T_BLOCK_ERASE);
+            else if (opcode == BLOCK_ERASE_64K)
+                erase(address, 0x10000, T_BLOCK_ERASE);
+        }
+        return 0xFF;
+    }
+
+    switch (opcode)
+    {
+    case READ_ARRAY:
+        /* One dummy byte before the data. */
+        if (count == 4)
+            return 0xFF;
+        return sim_flash[address++ % sim_flash_part.size];
+    case READ_ARRAY_LOW_F:
+        return sim_flash[address++ % sim_flash_part.size];
+    case BYTE_PROGRAM:
+        if (count == 4 && wel)
+        {
+            program(data);
+            wel = false;
+        }
+        break;
+    case SEQU_PROGRAM:
+        if (count == 4 && wel)
+        {
+            program(data);
+            sequential = true;
+        }
+        break;
+    }
+    return 0xFF;
+}
+
+/**
+ * \brief Exchange one byte with the flash, if it's selected.
+ */
+uint8_t sim_flash_xfer(uint8_t data)
+{
+    uint8_t ret = 0xFF;
+
+    sim_flash_stats.bytes++;
+    /* Selected and not on hold */
+    if ((PORTB & (FLASH_CS_PIN | FLASH_HOLD_PIN)) == FLASH_HOLD_PIN)
+    {
+        if (sim_flash_cs_released)
+        {
+            sim_flash_cs_released = false;
+            sim_flash_stats.transactions++;
+            count = 0;
+        }
+        ret = flash_byte(data);
+        if (count < 0xFF)
+            count++;
+    }
+    return ret;
+}
+
+/**
+ * \brief Exchange one byte on the SPI bus.
+ *
+ * Only the flash is driven with spiSend() or the SPI interrupt, the RF frames
+ * are exchanged by the RF interrupts.
+ */
+unsigned char spiSend(unsigned char data)
+{
+    sim_advance((SPSR & _BV(SPI2X)) ? SIM_SPI2X_BYTE_CYCLES
+                                     : SIM_SPI_BYTE_CYCLES);
+    return sim_flash_xfer(data);
+}
@@ -0,0 +1,53 @@
+/*
+ * TUXAUDIO - Firmware for the 'audio' CPU of tuxdroid
+ * Copyright (C) 2007 C2ME S.A. <tuxdroid@c2me.be>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* $Id$ */
+
+/** \file avr/eeprom.h
+    \brief Host stand-in for the avr-libc EEPROM access.
+
+    EEMEM variables live in RAM, so reading or writing the EEPROM is a plain
+    memory copy. The bytes written are counted in sim_eeprom_writes as each
+    one takes 3.3ms on the target.
+*/
+
+#ifndef _SIM_AVR_EEPROM_H_
+#define _SIM_AVR_EEPROM_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#ifndef EEMEM
+#define EEMEM
+#endif
+
+extern uint32_t sim_eeprom_writes;
+
+#define eeprom_read_block(dst, src, n) memcpy((dst), (src), (n))
+#define eeprom_write_block(src, dst, n) \
+    (sim_eeprom_writes += (n), memcpy((dst), (src), (n)))
+#define eeprom_read_byte(p) (*(uint8_t const *)(p))
+#define eeprom_write_byte(p, v) \
+    (sim_eeprom_writes++, *(uint8_t *)(p) = (v))
+#define eeprom_read_word(p) (*(uint16_t const *)(p))
+#define eeprom_write_word(p, v) \
+    (sim_eeprom_writes += 2, *(uint16_t *)(p) = (v))
+#define eeprom_busy_wait()
+
+#endif /* _SIM_AVR_EEPROM_H_ */
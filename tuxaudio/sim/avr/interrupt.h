@@ -0,0 +1,44 @@
+/*
+ * TUXAUDIO - Firmware for the 'audio' CPU of tuxdroid
+ * Copyright (C) 2007 C2ME S.A. <tuxdroid@c2me.be>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* $Id$ */
+
+/** \file avr/interrupt.h
+    \brief Host stand-in for the avr-libc interrupt macros.
+
+    Interrupt vectors become ordinary functions named after the vector so the
+    simulator can call them when it models the corresponding hardware event.
+*/
+
+#ifndef _SIM_AVR_INTERRUPT_H_
+#define _SIM_AVR_INTERRUPT_H_
+
+#include <avr/io.h>
+
+#define ISR(vector, ...) void vector(void); void vector(void)
+
+#define sei() (SREG |= 0x80)
+#define cli() (SREG &= ~0x80)
+
+/* Inline AVR assembly has no meaning on the host. The only statement the
+ * firmware emits is the timer 0 overflow ISR which jumps to the sampling
+ * vector, the simulator models it itself. */
+#define asm(...)
+
+#endif /* _SIM_AVR_INTERRUPT_H_ */
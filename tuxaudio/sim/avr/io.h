@@ -0,0 +1,106 @@
+/*
+ * TUXAUDIO - Firmware for the 'audio' CPU of tuxdroid
+ * Copyright (C) 2007 C2ME S.A. <tuxdroid@c2me.be>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* $Id$ */
+
+/** \file avr/io.h
+    \brief Host stand-in for the avr-libc register definitions.
+
+    Every I/O register used by the firmware is a plain global byte so the
+    sources compile unmodified with the host compiler. PORTB is the only
+    register routed through an accessor: the flash model needs to see the
+    chip select edges to split the SPI transactions.
+*/
+
+#ifndef _SIM_AVR_IO_H_
+#define _SIM_AVR_IO_H_
+
+#include <stdint.h>
+
+#ifndef _BV
+#define _BV(bit) (1 << (bit))
+#endif
+
+/*
+ * Registers
+ */
+extern volatile uint8_t *sim_portb(void);
+#define PORTB (*sim_portb())
+
+extern volatile uint8_t PORTC, PORTD;
+extern volatile uint8_t DDRB, DDRC, DDRD;
+extern volatile uint8_t PINB, PINC, PIND;
+extern volatile uint8_t SREG, CLKPR, PRR, GPIOR0;
+extern volatile uint8_t TCCR0A, TCCR0B, OCR0A, OCR0B, TIMSK0, TIFR0;
+extern volatile uint8_t TCCR2A, TCCR2B, TIMSK2, TIFR2;
+extern volatile uint8_t SPCR, SPSR, SPDR;
+extern volatile uint8_t ADCH, ADCL, ADCSRA, ADMUX;
+extern volatile uint8_t EICRA, EIMSK, EIFR;
+extern volatile uint8_t PCICR, PCIFR, PCMSK1;
+extern volatile uint8_t TWCR;
+
+/*
+ * Bits
+ */
+#define PB0 0
+#define PB1 1
+#define PB2 2
+#define PB3 3
+#define PB4 4
+#define PB5 5
+#define PB6 6
+#define PB7 7
+
+#define PD0 0
+#define PD1 1
+#define PD2 2
+#define PD3 3
+#define PD4 4
+#define PD5 5
+#define PD6 6
+#define PD7 7
+
+#define INT0 0
+#define INT1 1
+#define ISC00 0
+#define ISC01 1
+#define ISC10 2
+#define ISC11 3
+
+#define TOIE2 0
+#define CS20 0
+#define CS21 1
+#define CS22 2
+
+#define ADIF 4
+#define SPIE 7
+#define SPIF 7
+#define SPI2X 0
+#define PCIE1 1
+#define TWINT 7
+
+#define PRADC 0
+#define PRUSART0 1
+#define PRSPI 2
+#define PRTIM1 3
+#define PRTIM0 5
+#define PRTIM2 6
+#define PRTWI 7
+
+#endif /* _SIM_AVR_IO_H_ */
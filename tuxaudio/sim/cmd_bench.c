@@ -0,0 +1,354 @@
+/*
+ * TUXAUDIO - Firmware for the 'audio' CPU of tuxdroid
+ * Copyright (C) 2007 C2ME S.A. <tuxdroid@c2me.be>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* $Id$ */
+
+/** \file cmd_bench.c
+    \brief Latency of the commands exchanged in the RF frames.
+
+    tuxcore sends a burst of status commands every 100ms, read by I2C and
+    sent to the RF, while the dongle sends commands to tuxcore at a given
+    rate. The frames carry no audio unless -a is given, the dongle takes the
+    frames of tuxaudio and acks them a few frames later to stand for the
+    radio round trip. The time taken by each command to get through is
+    printed for both directions, with the commands out of order. The run
+    fails if a command is missing.
+
+    With -p, the dongle also sends CONNECT_ID_CMD which tuxaudio sends back,
+    to measure the latency of its replies behind the status commands.
+
+    The dongle then requests the statistics of the link with
+    LINK_STATS_REQ_CMD, the frames lost and with a CRC error must match the
+    ones it caused. The frames lost aren't sent in the window.
+
+    With -k, the dongle enables the packed commands with PACKED_CMDS_CMD and
+    waits for the answer before sending groups of commands. With -n, it
+    enables the window with WINDOWED_CMDS_CMD the same way.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <avr/io.h>
+
+#include "sim.h"
+#include "../common/defines.h"
+#include "../common/commands.h"
+#include "../common/api.h"
+
+/** Commands tracked in each direction. */
+#define CMD_MAX 65536
+
+/** Commands of one direction, tagged with their number in parameters 1 and
+ * 2. */
+struct cmd_stats
+{
+    uint64_t sent_at[CMD_MAX];
+    uint32_t sent, received, wrong, next;
+    uint64_t sum, max;
+};
+
+static struct cmd_stats status, cmds, replies;
+/** Status commands of tuxcore left in the current burst. */
+static uint32_t burst_left;
+/** Set once PACKED_CMDS_CMD and WINDOWED_CMDS_CMD have been answered. */
+static bool pack_answer, window_answer;
+/** Probability to lose a frame and to flag a CRC error, in percent. */
+static double loss, crc_errors;
+/** Frames lost and flagged with a CRC error until then. */
+static uint64_t faults_end;
+static uint32_t frames_lost, frames_crc;
+/** Counters of STATUS_LINK_CMD, the ones received and the ones expected. */
+static uint16_t link_stats[LINK_COUNTERS];
+static unsigned link_answers, link_expected;
+
+static void usage(void)
+{
+    fprintf(stderr,
+            "usage: cmd_bench [options]\n"
+            "  -k        pack the commands in the frames\n"
+            "  -n        number the commands and ack them with a window\n"
+            "  -d SEC    duration (10)\n"
+            "  -b MIN:MAX status commands in each burst of tuxcore (4:7)\n"
+            "  -i MS     interval between the bursts (100)\n"
+            "  -r HZ     commands sent by the dongle each second (50)\n"
+            "  -p HZ     CONNECT_ID_CMD sent back each second (0)\n"
+            "  -w N      frames before the dongle takes a frame (4)\n"
+            "  -a        frames with speaker audio\n"
+            "  -l PCT    frame loss probability (0)\n"
+            "  -e PCT    CRC error probability (0)\n"
+            "  -s SEED   random seed (1)\n"
+            "  -c CYC    cycles taken by one main loop iteration (400)\n");
+    exit(1);
+}
+
+/*
+ * Check the number of a command received and account for its latency. The
+ * commands which follow one out of order are checked from it.
+ */
+static void cmd_received(struct cmd_stats *s, uint8_t const *cmd)
+{
+    uint32_t n = (cmd[1] << 8) | cmd[2];
+    uint64_t latency;
+
+    if (n != s->next)
+        s->wrong++;
+    s->next = n + 1;
+    if (n >= s->sent)
+        return;
+    latency = sim_cycles - s->sent_at[n];
+    s->sum += latency;
+    if (latency > s->max)
+        s->max = latency;
+    s->received++;
+}
+
+/*
+ * Commands sent by tuxaudio to the RF.
+ */
+static void rf_cmd(uint8_t const *cmd)
+{
+    if (cmd[0] == STATUS_LIGHT_CMD)
+        cmd_received(&status, cmd);
+    else if (cmd[0] == CONNECT_ID_CMD)
+        cmd_received(&replies, cmd);
+    else if (cmd[0] == PACKED_CMDS_CMD)
+        pack_answer = true;
+    else if (cmd[0] == WINDOWED_CMDS_CMD)
+        window_answer = true;
+    else if (cmd[0] == STATUS_LINK_CMD && cmd[1] < LINK_COUNTERS)
+    {
+        link_stats[cmd[1]] = (cmd[2] << 8) | cmd[3];
+        link_answers++;
+    }
+}
+
+/*
+ * Commands forwarded to tuxcore.
+ */
+static void core_cmd(uint8_t const *cmd)
+{
+    if (cmd[0] == LED_SET_CMD)
+        cmd_received(&cmds, cmd);
+}
+
+/*
+ * Status commands read from tuxcore.
+ */
+static bool core_status(uint8_t *cmd)
+{
+    if (!burst_left || status.sent == CMD_MAX)
+        return false;
+    burst_left--;
+    cmd[0] = STATUS_LIGHT_CMD;
+    cmd[1] = status.sent >> 8;
+    cmd[2] = status.sent;
+    cmd[3] = 0;
+    status.sent++;
+    return true;
+}
+
+/*
+ * Lose frames and flag CRC errors at random.
+ */
+static bool rf_fill(uint8_t *frame)
+{
+    if (sim_cycles >= faults_end)
+        return true;
+    if (loss > 0 && rand() < loss / 100 * RAND_MAX)
+    {
+        frames_lost++;
+        return false;
+    }
+    if (crc_errors > 0 && rand() < crc_errors / 100 * RAND_MAX)
+    {
+        frame[SPI_CONFIG_OFFSET] &= ~CFG_CRCOK_MK;
+        frames_crc++;
+    }
+    return true;
+}
+
+static void print_stats(char const *name, struct cmd_stats const *s)
+{
+    printf("%-10s %6u sent, %6u received, %u out of order, "
+           "latency mean %.2f ms, max %.2f ms\n", name, s->sent, s->received,
+           s->wrong,
+           s->received ? s->sum * 1e3 / s->received / F_CPU : 0.0,
+           s->max * 1e3 / F_CPU);
+}
+
+int main(int argc, char *argv[])
+{
+    double duration = 10, interval = 100, rate = 50, reply_rate = 0;
+    double period = AUDIO_SPK_SIZE * 1e6 / 16000;
+    unsigned burst_min = 4, burst_max = 7, delay = 4, loop = 400, seed = 1;
+    bool pack = false, window = false, audio = false;
+    struct sim_frame *frames;
+    uint64_t end, next_burst, next_cmd, next_reply;
+    uint32_t count, i;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "knd:b:i:r:p:w:al:e:s:c:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 'k': pack = true; break;
+        case 'n': window = true; break;
+        case 'd': duration = atof(optarg); break;
+        case 'b':
+            if (sscanf(optarg, "%u:%u", &burst_min, &burst_max) != 2)
+                usage();
+            break;
+        case 'i': interval = atof(optarg); break;
+        case 'r': rate = atof(optarg); break;
+        case 'p': reply_rate = atof(optarg); break;
+        case 'w': delay = atoi(optarg); break;
+        case 'a': audio = true; break;
+        case 'l': loss = atof(optarg); break;
+        case 'e': crc_errors = atof(optarg); break;
+        case 's': seed = atoi(optarg); break;
+        case 'c': loop = atoi(optarg); break;
+        default: usage();
+        }
+    }
+    if (duration <= 0 || interval <= 0 || rate < 0 || reply_rate < 0 ||
+        burst_min > burst_max ||
+        delay < 1 || delay >= SIM_RF_DELAY_MAX || loss < 0 || loss >= 100 ||
+        crc_errors < 0 || crc_errors > 100 || loop < 1)
+        usage();
+    srand(seed);
+
+    count = duration * 1e6 / period;
+    frames = malloc(count * sizeof *frames);
+    for (i = 0; i < count; i++)
+    {
+        frames[i].at = (uint64_t)((i + 1) * period * SIM_CYCLES_PER_US);
+        frames[i].config = audio ? CFG_AUDIO_MK : 0;
+    }
+
+    sim_init();
+    sim_rf_cmd = rf_cmd;
+    sim_rf_fill = rf_fill;
+    sim_core_cmd = core_cmd;
+    sim_core_status = core_status;
+    sim_rf_delay = delay;
+    sim_rf_load(frames, count);
+    end = frames[count - 1].at;
+    faults_end = end - F_CPU / 2;
+
+    if (pack)
+    {
+        uint8_t cmd[4] = {PACKED_CMDS_CMD, 1, 0, 0};
+
+        sim_rf_send(cmd);
+        while (!pack_answer && sim_cycles < end)
+            sim_main_loop(loop);
+        sim_rf_pack = pack_answer;
+    }
+    if (window)
+    {
+        uint8_t cmd[4] = {WINDOWED_CMDS_CMD, 0, 0, 0};
+
+        sim_rf_send(cmd);
+        while (!window_answer && sim_cycles < end)
+            sim_main_loop(loop);
+    }
+
+    /* The last commands have a quarter of a second to get through, then the
+     * statistics are requested. */
+    next_burst = next_cmd = next_reply = sim_cycles;
+    while (sim_cycles + F_CPU / 4 < end)
+    {
+        if (sim_cycles >= next_burst && sim_cycles + F_CPU / 2 < end)
+        {
+            burst_left = burst_min + rand() % (burst_max - burst_min + 1);
+            for (i = 0; i < burst_left && status.sent + i < CMD_MAX; i++)
+                status.sent_at[status.sent + i] = sim_cycles;
+            next_burst += interval * 1e3 * SIM_CYCLES_PER_US;
+        }
+        if (rate > 0 && sim_cycles >= next_cmd &&
+            sim_cycles + F_CPU / 2 < end && cmds.sent < CMD_MAX)
+        {
+            uint8_t cmd[4] = {LED_SET_CMD, cmds.sent >> 8, cmds.sent, 0};
+
+            if (sim_rf_send(cmd))
+                cmds.sent_at[cmds.sent++] = sim_cycles;
+            next_cmd += 1e6 / rate * SIM_CYCLES_PER_US;
+        }
+        if (reply_rate > 0 && sim_cycles >= next_reply &&
+            sim_cycles + F_CPU / 2 < end && replies.sent < CMD_MAX)
+        {
+            uint8_t cmd[4] = {CONNECT_ID_CMD, replies.sent >> 8, replies.sent,
+                              0};
+
+            if (sim_rf_send(cmd))
+                replies.sent_at[replies.sent++] = sim_cycles;
+            next_reply += 1e6 / reply_rate * SIM_CYCLES_PER_US;
+        }
+        sim_main_loop(loop);
+    }
+    /* The faults are over by now. LINK_LOST isn't sent in the window. */
+    link_expected = sim_rf_window ? LINK_COUNTERS - 1 : LINK_COUNTERS;
+    if (sim_cycles < end)
+    {
+        uint8_t cmd[4] = {LINK_STATS_REQ_CMD, 0, 0, 0};
+
+        sim_rf_send(cmd);
+        while (link_answers < link_expected && sim_cycles < end)
+            sim_main_loop(loop);
+    }
+
+    printf("frames:    %u of %.1f us, %s, %u exchanged, %u lost, taken by "
+           "the dongle %u frames later\n", count, period,
+           audio ? "audio" : "no audio", sim_stats.frames,
+           sim_stats.frames_lost, delay);
+    printf("format:    %s, %s\n", sim_rf_pack ? "packed commands" :
+           "one command per frame", sim_rf_window ? "window of commands" :
+           "alternating bit");
+    print_stats("status:", &status);
+    print_stats("commands:", &cmds);
+    if (reply_rate > 0)
+        print_stats("replies:", &replies);
+    if (link_answers == link_expected)
+        printf("link:      %u frames, %u lost, %u repeated, %u CRC errors, "
+               "%u underruns, %u commands resent, %u+%u dropped\n",
+               link_stats[LINK_FRAMES], link_stats[LINK_LOST],
+               link_stats[LINK_REPEATED], link_stats[LINK_CRC_ERRORS],
+               link_stats[LINK_UNDERRUNS], link_stats[LINK_CMDS_RESENT],
+               link_stats[LINK_DROPPED], link_stats[LINK_URGENT_DROPPED]);
+    else
+        printf("link:      not answered\n");
+    printf("caused:    %u lost, %u CRC errors\n", frames_lost, frames_crc);
+    free(frames);
+    /* The commands the dongle still has to send aren't missing, the
+     * statistics can be behind them. The frames overwritten by tuxaudio are
+     * lost as well. */
+    if (link_answers != link_expected && !sim_rf_queued())
+        return 1;
+    return (status.wrong || cmds.wrong || replies.wrong ||
+            status.received != status.sent ||
+            cmds.sent - cmds.received > sim_rf_queued() ||
+            replies.sent - replies.received > sim_rf_queued() ||
+            (pack && !sim_rf_pack) || (window && !sim_rf_window) ||
+            (link_answers == link_expected &&
+             (link_stats[LINK_CRC_ERRORS] != (uint16_t)frames_crc ||
+              (!window && link_stats[LINK_LOST] !=
+               (uint16_t)(frames_lost + sim_stats.frames_lost))))) ? 1 : 0;
+}
@@ -0,0 +1,347 @@
+/*
+ * TUXAUDIO - Firmware for the 'audio' CPU of tuxdroid
+ * Copyright (C) 2007 C2ME S.A. <tuxdroid@c2me.be>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* $Id$ */
+
+/** \file delete_bench.c
+    \brief Deletion of sounds with DELETE_SOUND_CMD.
+
+    The simulated flash is filled with sounds of random sizes and codecs,
+    laid out like programming() does. Sounds are then deleted one after the
+    other while speaker audio is streamed, and after each deletion the TOC,
+    the bytes of the remaining sounds and the erased space after them are
+    checked against the expected bank. The time taken, the blocks erased and
+    the frames lost or samples missed during the compaction are printed.
+
+    The bank is finally loaded again as at boot and the last sound played.
+
+    With -f, another part than the AT26F004 is modelled. A larger one can
+    hold more sounds than the EEPROM mirror, up to TOC_MAX_SOUNDS.
+
+    With -e, the bank is then erased with ERASE_FLASH_CMD in the same way,
+    printing the progress reported by the firmware.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <avr/io.h>
+
+#include "sim.h"
+#include "../common/defines.h"
+#include "../common/commands.h"
+#include "../common/api.h"
+#include "../varis.h"
+#include "../flash.h"
+#include "../toc.h"
+#include "../parser.h"
+#include "../audio_fifo.h"
+
+/** Longest time a deletion can take, in s. Parts without the sequential
+ * program mode need several minutes to move a full bank. */
+#define MAX_TIME 300
+
+/** Expected bank. */
+static struct
+{
+    uint8_t *data;
+    uint32_t size;
+    bool adpcm;
+} sounds[TOC_MAX_SOUNDS];
+static unsigned count;
+/** ERASING reports received. */
+static unsigned erase_reports;
+
+static void usage(void)
+{
+    fprintf(stderr,
+            "usage: delete_bench [options] [SOUND...]\n"
+            "  SOUND     sounds to delete in order (1, the middle one, the"
+            " last one)\n"
+            "  -n N      number of sounds in the flash (10)\n"
+            "  -s BYTES  largest size of a sound (20000)\n"
+            "  -p US     period of the RF frames (2062.5, 16kHz samples)\n"
+            "  -r SEED   random seed (1)\n"
+            "  -c CYC    cycles taken by one main loop iteration (400)\n"
+            "  -e MODE   erase the bank at the end, parameter of\n"
+            "            ERASE_FLASH_CMD (0: chip, 1: used blocks)\n"
+            "  -f PART   flash part modelled (at26f004, at25df041a, w25q16,\n"
+            "            w25q32, unknown)\n");
+    exit(1);
+}
+
+/*
+ * Commands sent to the RF by tuxaudio.
+ */
+static void rf_cmd(uint8_t const *cmd)
+{
+    if (cmd[0] == STATUS_FLASH_PROG_CMD && cmd[1] == ERASING)
+    {
+        erase_reports++;
+        printf("  %8.3f s: %u blocks left, %u s\n",
+               (double)sim_cycles / F_CPU, cmd[2], cmd[3]);
+    }
+}
+
+static uint32_t entry(unsigned n)
+{
+    uint8_t const *e = sim_flash + TOC_FIRST + 3 * n;
+
+    return ((uint32_t)(e[0] & TOC_ADDR_MK) << 16) | (e[1] << 8) | e[2];
+}
+
+/*
+ * Store the sounds and their TOC in the flash, sound 1 at 0x000400 and the
+ * next ones on the following block.
+ */
+static void fill_flash(unsigned size)
+{
+    uint32_t start = 0x400, stop = start;
+    unsigned i, j;
+
+    sim_flash_init();
+    sim_flash[0] = 0xFE;
+    sim_flash[TOC_FIRST] = 0x00;
+    sim_flash[TOC_FIRST + 1] = 0x04;
+    sim_flash[TOC_FIRST + 2] = 0x00;
+    for (i = 0; i < count; i++)
+    {
+        if (i)
+            start = ((stop >> 12) + 1) << 12;
+        sounds[i].size = 1 + rand() % size;
+        sounds[i].adpcm = rand() & 1;
+        /* The last address isn't used. */
+        if (start + sounds[i].size >= sim_flash_part.size)
+        {
+            count = i;
+            break;
+        }
+        sounds[i].data = malloc(sounds[i].size);
+        for (j = 0; j < sounds[i].size; j++)
+            sounds[i].data[j] = sim_flash[start + j] = rand();
+        stop = start + sounds[i].size;
+        sim_flash[TOC_FIRST + 3 * (i + 1)] =
+            (stop >> 16) | (sounds[i].adpcm ? TOC_ADPCM_MK : 0);
+        sim_flash[TOC_FIRST + 3 * (i + 1) + 1] = stop >> 8;
+        sim_flash[TOC_FIRST + 3 * (i + 1) + 2] = stop;
+    }
+}
+
+/*
+ * Check the TOC and the sounds against the expected bank, return the number
+ * of errors.
+ */
+static unsigned check_flash(void)
+{
+    uint32_t start = entry(0), stop = start, i, j;
+    unsigned errors = 0;
+
+    if (numSound != count)
+    {
+        printf("  %u sounds instead of %u\n", numSound, count);
+        errors++;
+    }
+    if (sim_flash[0] != 0xFE || sim_flash[TOC_FIRST + 3 * (count + 1)] != 0xFF)
+    {
+        printf("  bad TOC\n");
+        errors++;
+    }
+    for (i = 0; i < count; i++)
+    {
+        if (i)
+            start = ((stop >> 12) + 1) << 12;
+        stop = entry(i + 1);
+        if (stop - start != sounds[i].size ||
+            !(sim_flash[TOC_FIRST + 3 * (i + 1)] & TOC_ADPCM_MK) !=
+            !sounds[i].adpcm)
+        {
+            printf("  sound %u: bad entry\n", i + 1);
+            errors++;
+            continue;
+        }
+        if (memcmp(sim_flash + start, sounds[i].data, sounds[i].size))
+        {
+            printf("  sound %u: bad data\n", i + 1);
+            errors++;
+        }
+    }
+    /* The next sound can be stored right away. */
+    if (!count)
+        stop = 0x400;
+    for (j = stop; j < sim_flash_part.size; j++)
+        if (sim_flash[j] != 0xFF)
+        {
+            printf("  0x%06x not erased\n", j);
+            errors++;
+            break;
+        }
+    return errors;
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned size = 20000, loop = 400, seed = 1, errors = 0;
+    int erase = -1;
+    double period = AUDIO_SPK_SIZE * 1e6 / 16000;
+    struct sim_frame *frames;
+    uint32_t frames_max, i;
+    int opt;
+
+    count = 10;
+    while ((opt = getopt(argc, argv, "n:s:p:r:c:e:f:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n': count = atoi(optarg); break;
+        case 's': size = atoi(optarg); break;
+        case 'p': period = atof(optarg); break;
+        case 'r': seed = atoi(optarg); break;
+        case 'c': loop = atoi(optarg); break;
+        case 'e': erase = atoi(optarg); break;
+        case 'f':
+            if (!sim_flash_set_part(optarg))
+                usage();
+            break;
+        default: usage();
+        }
+    }
+    if (count < 1 || count > TOC_MAX_SOUNDS || size < 1 ||
+        size > sim_flash_part.size || period <= 0 || loop < 1)
+        usage();
+    srand(seed);
+    fill_flash(size);
+    printf("bank:   %u sounds up to %u bytes, last block %u\n", count, size,
+           (unsigned)(entry(count) >> 12));
+
+    /* Speaker audio during the whole run. */
+    frames_max = (argc - optind + 3) * MAX_TIME * 1e6 / period;
+    frames = malloc(frames_max * sizeof *frames);
+    for (i = 0; i < frames_max; i++)
+    {
+        frames[i].at = (uint64_t)((i + 1) * period * SIM_CYCLES_PER_US);
+        frames[i].config = CFG_AUDIO_MK;
+    }
+    sim_init();
+    toc_load();
+    sim_rf_load(frames, frames_max);
+    sim_rf_cmd = rf_cmd;
+    /* Let the fifo fill. */
+    while (sim_cycles < 50000 * SIM_CYCLES_PER_US)
+        sim_main_loop(loop);
+
+    for (i = 0; ; i++)
+    {
+        uint8_t cmd[4] = {DELETE_SOUND_CMD, 0, 0, 0};
+        uint64_t start = sim_cycles;
+        uint32_t erased = sim_flash_stats.erased_blocks;
+        uint32_t lost = sim_stats.frames_lost;
+        uint32_t underruns = sim_stats.underruns;
+        unsigned e, n;
+
+        if (optind + i < (unsigned)argc)
+            n = atoi(argv[optind + i]);
+        else if (i < 3 && optind == argc)
+            n = (i == 0) ? 1 : (i == 1) ? (count + 1) / 2 : count;
+        else
+            break;
+        if (n < 1 || n > count)
+            usage();
+        cmd[1] = n;
+        cmd[2] = (n >> 2) & SOUND_HI_MK;
+
+        parse_cmd(cmd);
+        while (compactFlag && sim_cycles < start + (uint64_t)MAX_TIME * F_CPU)
+            sim_main_loop(loop);
+        free(sounds[n - 1].data);
+        memmove(&sounds[n - 1], &sounds[n], (count - n) * sizeof sounds[0]);
+        count--;
+
+        printf("delete %3u: %7.3f s, %3u blocks erased, %u frames lost, "
+               "%u samples missed\n", n,
+               (double)(sim_cycles - start) / F_CPU,
+               sim_flash_stats.erased_blocks - erased,
+               sim_stats.frames_lost - lost, sim_stats.underruns - underruns);
+        if (compactFlag)
+        {
+            printf("  not finished\n");
+            return 1;
+        }
+        e = check_flash();
+        errors += e;
+        if (!count)
+            break;
+    }
+
+    /* Boot again and play the last sound, once the RF frame is exchanged as
+     * the flash is on hold until then. */
+    while (rf_txe)
+        sim_main_loop(loop);
+    numSound = 0;
+    toc_load();
+    errors += check_flash();
+    if (count)
+    {
+        uint8_t cmd[4] = {PLAY_SOUND_CMD, count, (count >> 2) & SOUND_HI_MK,
+                          0};
+
+        /* playInit() drops a sound with bad addresses. */
+        parse_cmd(cmd);
+        sim_main_loop(loop);
+        if (!flashPlay)
+        {
+            printf("  sound %u didn't play\n", count);
+            errors++;
+        }
+    }
+
+    if (erase >= 0)
+    {
+        uint8_t cmd[4] = {ERASE_FLASH_CMD, erase, 0, 0};
+        uint64_t start;
+        uint32_t erased, lost, underruns;
+
+        /* Let the sound end. */
+        while (flashPlay)
+            sim_main_loop(loop);
+        start = sim_cycles;
+        erased = sim_flash_stats.erased_blocks;
+        lost = sim_stats.frames_lost;
+        underruns = sim_stats.underruns;
+        parse_cmd(cmd);
+        while (eraseFlag && sim_cycles < start + (uint64_t)MAX_TIME * F_CPU)
+            sim_main_loop(loop);
+        printf("erase:      %7.3f s, %3u blocks erased, %u frames lost, "
+               "%u samples missed\n", (double)(sim_cycles - start) / F_CPU,
+               sim_flash_stats.erased_blocks - erased,
+               sim_stats.frames_lost - lost, sim_stats.underruns - underruns);
+        for (i = 0; i < count; i++)
+            free(sounds[i].data);
+        count = 0;
+        if (eraseFlag || !erase_reports)
+        {
+            printf("  not finished or no progress\n");
+            errors++;
+        }
+        errors += check_flash();
+    }
+    printf("errors: %u\n", errors);
+    free(frames);
+    return errors ? 1 : 0;
+}
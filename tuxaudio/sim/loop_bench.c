@@ -0,0 +1,439 @@
+/*
+ * TUXAUDIO - Firmware for the 'audio' CPU of tuxdroid
+ * Copyright (C) 2007 C2ME S.A. <tuxdroid@c2me.be>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* $Id$ */
+
+/** \file loop_bench.c
+    \brief Playback of the sounds with a header.
+
+    The simulated flash is filled with sounds of random sizes, codecs, sample
+    rates and loops, some of them without header like the older banks. Each
+    sound is played with PLAY_SOUND_CMD and the samples added to the audio
+    fifo are compared to the expected ones: the whole sound decoded once,
+    spliced at the loop points and converted to 8kHz from 2 to 32kHz. The
+    sampling interrupt is stopped, the bench empties the fifo itself.
+
+    A few sounds are then queued with QUEUE_SOUND_CMD and must follow each
+    other in the fifo, without it running empty when the sampling interrupt
+    drains it. SKIP_SOUND_CMD must go on with the next one right away.
+
+    A sound looping forever is finally played and stopped with sound 0, then
+    with SLEEP_CMD which drops the commands until tuxaudio sleeps. It's
+    played again until the fifo is full and the flash erased with
+    ERASE_FLASH_CMD, which must stop it first.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <avr/io.h>
+
+#include "sim.h"
+#include "../common/commands.h"
+#include "../varis.h"
+#include "../flash.h"
+#include "../toc.h"
+#include "../parser.h"
+#include "../adpcm.h"
+#include "../audio_fifo.h"
+
+/** Longest sound played, in samples at 8kHz. */
+#define MAX_OUT 2000000
+
+/** Sounds in the flash. */
+static struct
+{
+    bool header, adpcm;
+    unsigned rate, loops;
+    uint32_t start, size, length, loop_start, loop_end;
+} sounds[TOC_MAX_SOUNDS];
+static unsigned count;
+
+static uint8_t out[MAX_OUT];
+static uint8_t expected[MAX_OUT];
+
+static void usage(void)
+{
+    fprintf(stderr,
+            "usage: loop_bench [options]\n"
+            "  -n N      number of sounds in the flash (20)\n"
+            "  -s BYTES  largest size of a sound (6000)\n"
+            "  -r SEED   random seed (1)\n"
+            "  -c CYC    cycles taken by one main loop iteration (400)\n"
+            "  -v        print each sound\n");
+    exit(1);
+}
+
+static void set24(uint8_t *p, uint32_t value)
+{
+    p[0] = value >> 16;
+    p[1] = value >> 8;
+    p[2] = value;
+}
+
+/*
+ * Store the sounds and their TOC in the flash like flash_image does.
+ */
+static void fill_flash(unsigned size)
+{
+    static unsigned const rates[] = {2000, 4000, 6000, 8000, 11025, 16000,
+                                     22050, 32000};
+    uint32_t start = 0x400, stop = start, j;
+    unsigned i;
+
+    sim_flash_init();
+    sim_flash[0] = 0xFE;
+    sim_flash[TOC_FIRST] = 0x00;
+    sim_flash[TOC_FIRST + 1] = 0x04;
+    sim_flash[TOC_FIRST + 2] = 0x00;
+    for (i = 0; i < count; i++)
+    {
+        uint8_t *hdr;
+        uint32_t hdr_size, samples;
+
+        if (i)
+            start = ((stop >> 12) + 1) << 12;
+        sounds[i].header = i % 4 != 0;
+        sounds[i].adpcm = rand() & 1;
+        sounds[i].size = 1 + rand() % size;
+        sounds[i].rate = 8000;
+        sounds[i].loops = 0;
+        samples = sounds[i].adpcm ? 2 * sounds[i].size : sounds[i].size;
+        sounds[i].length = samples;
+        sounds[i].loop_start = sounds[i].loop_end = 0;
+        /* Newer headers are longer. */
+        hdr_size = sounds[i].header ? SOUND_HDR_SIZE + rand() % 3 : 0;
+        if (start + hdr_size + sounds[i].size >= SIM_FLASH_SIZE)
+        {
+            count = i;
+            break;
+        }
+        for (j = 0; j < sounds[i].size; j++)
+            sim_flash[start + hdr_size + j] = rand();
+        if (sounds[i].header)
+        {
+            sounds[i].rate = rates[rand() % 8];
+            /* Odd lengths and bytes after the end of the sound. */
+            sounds[i].length -= rand() % 3;
+            if (rand() % 4)
+            {
+                sounds[i].loops = (rand() % 4) ? 1 + rand() % 3 : 0;
+                sounds[i].loop_start = rand() % sounds[i].length;
+                sounds[i].loop_end = sounds[i].loop_start + 1 +
+                    rand() % (sounds[i].length - sounds[i].loop_start);
+            }
+            hdr = sim_flash + start;
+            hdr[HDR_VERSION] = SOUND_HDR_VERSION + hdr_size - SOUND_HDR_SIZE;
+            hdr[HDR_SIZE] = hdr_size;
+            hdr[HDR_CODEC] = sounds[i].adpcm ? CODEC_ADPCM : CODEC_RAW_8K;
+            hdr[HDR_LOOPS] = sounds[i].loops;
+            hdr[HDR_RATE] = sounds[i].rate >> 8;
+            hdr[HDR_RATE + 1] = sounds[i].rate;
+            set24(hdr + HDR_LENGTH, sounds[i].length);
+            set24(hdr + HDR_LOOP_START, sounds[i].loop_start);
+            set24(hdr + HDR_LOOP_END, sounds[i].loop_end);
+        }
+        sounds[i].start = start;
+        stop = start + hdr_size + sounds[i].size;
+        sim_flash[TOC_FIRST + 3 * (i + 1)] = (stop >> 16) |
+            (sounds[i].header ? TOC_HEADER_MK :
+             sounds[i].adpcm ? TOC_ADPCM_MK : 0);
+        sim_flash[TOC_FIRST + 3 * (i + 1) + 1] = stop >> 8;
+        sim_flash[TOC_FIRST + 3 * (i + 1) + 2] = stop;
+    }
+}
+
+/*
+ * Write the expected samples of a sound and return their number. The
+ * previous sample kept for the rate conversion is updated.
+ */
+static uint32_t expect(unsigned n, uint8_t *expected, uint8_t *prev)
+{
+    uint8_t const *data = sim_flash + sounds[n].start +
+        (sounds[n].header ? sim_flash[sounds[n].start + HDR_SIZE] : 0);
+    uint32_t samples = sounds[n].adpcm ? 2 * sounds[n].size : sounds[n].size;
+    uint32_t ls = sounds[n].loop_start, le = sounds[n].loop_end;
+    uint32_t length = sounds[n].length, i, k = 0, out;
+    unsigned step, pos;
+    uint8_t *decoded = malloc(samples), *seq;
+    struct adpcm_state state;
+    unsigned l;
+
+    adpcm_init(&state);
+    for (i = 0; i < sounds[n].size; i++)
+    {
+        if (sounds[n].adpcm)
+        {
+            decoded[2 * i] = adpcm_decode(&state, data[i]);
+            decoded[2 * i + 1] = adpcm_decode(&state, data[i] >> 4);
+        }
+        else
+            decoded[i] = data[i];
+    }
+    /* An ADPCM byte holds 2 samples. */
+    if (sounds[n].adpcm)
+    {
+        ls &= ~1;
+        le &= ~1;
+    }
+    seq = malloc(length * (sounds[n].loops + 1));
+    if (sounds[n].loops && ls < le)
+    {
+        memcpy(seq, decoded, le);
+        k = le;
+        for (l = 0; l < sounds[n].loops; l++, k += le - ls)
+            memcpy(seq + k, decoded + ls, le - ls);
+        memcpy(seq + k, decoded + le, length - le);
+        k += length - le;
+    }
+    else
+    {
+        memcpy(seq, decoded, length);
+        k = length;
+    }
+
+    /* Conversion to 8kHz, each sample played is interpolated between the 2
+     * samples around it, with the position in 1/256 of sample. */
+    step = (sounds[n].rate * 256 + 4000) / 8000;
+    pos = (step <= 256) ? step : (step + 256) / 2;
+    for (i = 0, out = 0; i < k; *prev = seq[i++], pos -= 256)
+        for (; pos <= 256; pos += step)
+            expected[out++] = (*prev * (256 - pos) + seq[i] * pos) / 256;
+    k = out;
+    free(decoded);
+    free(seq);
+    return k;
+}
+
+/*
+ * Play a sound and return the number of samples added to the fifo.
+ */
+static uint32_t play(unsigned n, unsigned loop, uint32_t max)
+{
+    uint8_t cmd[4] = {PLAY_SOUND_CMD, n, 0, 0};
+    uint32_t k = 0;
+
+    parse_cmd(cmd);
+    do
+    {
+        sim_main_loop(loop);
+        while (AudioFifoLength() && k < MAX_OUT)
+            AudioFifoGet(&out[k++]);
+    } while (flashPlay && k < max);
+    return k;
+}
+
+/*
+ * Play the sounds given one after the other with QUEUE_SOUND_CMD and return
+ * the number of errors. With the sampling interrupt, the fifo shouldn't run
+ * empty until the last sound ends.
+ */
+static unsigned queue(unsigned const *list, unsigned n, unsigned loop,
+                      bool sampling)
+{
+    uint8_t cmd[4] = {PLAY_SOUND_CMD, list[0], 0, 0}, prev = 0x80;
+    uint32_t k = 0, played = 0, empty = 0;
+    unsigned i;
+
+    for (i = 0; i < n; i++)
+        k += expect(list[i] - 1, expected + k, &prev);
+    TIMSK0 = sampling;
+    parse_cmd(cmd);
+    cmd[0] = QUEUE_SOUND_CMD;
+    for (i = 1; i < n; i++)
+    {
+        cmd[1] = list[i];
+        parse_cmd(cmd);
+    }
+    sim_main_loop(loop);
+    while (flashPlay)
+    {
+        sim_main_loop(loop);
+        if (!sampling)
+            while (AudioFifoLength() && played < MAX_OUT)
+                AudioFifoGet(&out[played++]);
+        else if (!AudioFifoLength())
+            empty++;
+    }
+    while (!sampling && AudioFifoLength() && played < MAX_OUT)
+        AudioFifoGet(&out[played++]);
+    TIMSK0 = 0;
+    if (sampling)
+    {
+        printf("queue of %u sounds: fifo empty %u times\n", n, empty);
+        return empty != 0;
+    }
+    printf("queue of %u sounds: %u samples played, %u expected\n", n,
+           played, k);
+    return played != k || memcmp(out, expected, k);
+}
+
+/*
+ * Skip the first sound of a queue of 2 and return the number of errors.
+ */
+static unsigned skip(unsigned a, unsigned b, unsigned loop)
+{
+    uint8_t cmd[4] = {PLAY_SOUND_CMD, a, 0, 0}, prev = 0x80;
+    uint32_t k, played = 0, first, length;
+    static uint8_t tail[MAX_OUT];
+
+    length = expect(a - 1, expected, &prev);
+    k = expect(b - 1, tail, &prev);
+    parse_cmd(cmd);
+    cmd[0] = QUEUE_SOUND_CMD;
+    cmd[1] = b;
+    parse_cmd(cmd);
+    while (!played)
+    {
+        sim_main_loop(loop);
+        while (AudioFifoLength())
+            AudioFifoGet(&out[played++]);
+    }
+    cmd[0] = SKIP_SOUND_CMD;
+    parse_cmd(cmd);
+    while (flashPlay)
+    {
+        sim_main_loop(loop);
+        while (AudioFifoLength() && played < MAX_OUT)
+            AudioFifoGet(&out[played++]);
+    }
+    first = played - k;
+    printf("skip: %u samples of sound %u out of %u, then sound %u\n", first,
+           a, length, b);
+    return played < k || first >= length || memcmp(out, expected, first) ||
+        memcmp(out + first, tail, k);
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned size = 6000, loop = 400, seed = 1, verbose = 0, errors = 0;
+    unsigned i;
+    int opt;
+
+    count = 20;
+    while ((opt = getopt(argc, argv, "n:s:r:c:vh")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n': count = atoi(optarg); break;
+        case 's': size = atoi(optarg); break;
+        case 'r': seed = atoi(optarg); break;
+        case 'c': loop = atoi(optarg); break;
+        case 'v': verbose = 1; break;
+        default: usage();
+        }
+    }
+    if (count < 1 || count >= TOC_MAX_SOUNDS || size < 3 ||
+        size > MAX_OUT / 32 || loop < 1)
+        usage();
+    srand(seed);
+    fill_flash(size);
+
+    sim_init();
+    toc_load();
+    /* The bench empties the fifo. */
+    TIMSK0 = 0;
+
+    for (i = 0; i < count; i++)
+    {
+        uint8_t prev = 0x80;
+        uint32_t k = expect(i, expected, &prev);
+        uint32_t played = play(i + 1, loop, MAX_OUT);
+        bool bad = played != k || memcmp(out, expected, k);
+
+        if (verbose || bad)
+            printf("sound %3u: %s %-5s %5uHz %6u samples, loop %u-%u x%u: "
+                   "%u samples played%s\n", i + 1,
+                   sounds[i].header ? "header" : "legacy",
+                   sounds[i].adpcm ? "adpcm" : "raw", sounds[i].rate,
+                   sounds[i].length, sounds[i].loop_start,
+                   sounds[i].loop_end, sounds[i].loops, played,
+                   bad ? ", wrong" : "");
+        errors += bad;
+    }
+    printf("%u sounds played, %u wrong\n", count, errors);
+
+    if (count >= 5)
+    {
+        /* 3 sounds with a header and a legacy one */
+        unsigned const list[] = {2, 3, 5, 4};
+
+        errors += queue(list, 4, loop, false);
+        errors += queue(list, 4, loop, true);
+        /* Sound 5 has no header, its first sample doesn't depend on the
+         * previous sound. */
+        errors += skip(2, 5, loop);
+    }
+
+    /* Loop the last sound forever and stop it. */
+    sim_flash[sounds[count - 1].start + HDR_LOOPS] = SOUND_LOOP_FOREVER;
+    if (sounds[count - 1].header && sounds[count - 1].loop_end)
+    {
+        uint8_t cmd[4] = {PLAY_SOUND_CMD, 0, 0, 0}, prev = 0x80;
+        uint32_t played = play(count, loop,
+                               4 * expect(count - 1, expected, &prev));
+
+        if (!flashPlay)
+        {
+            printf("forever: ended after %u samples\n", played);
+            errors++;
+        }
+        parse_cmd(cmd);
+        for (i = 0; i < 1000 && flashPlay; i++)
+            sim_main_loop(loop);
+        printf("forever: %u samples played, %s\n", played,
+               flashPlay ? "not stopped" : "stopped");
+        errors += flashPlay;
+
+        /* The sound must end before sleeping. */
+        play(count, loop, 4000);
+        cmd[0] = SLEEP_CMD;
+        cmd[1] = SLEEPTYPE_QUICK;
+        parse_cmd(cmd);
+        for (i = 0; i < 1000 && flashPlay; i++)
+            sim_main_loop(loop);
+        printf("sleep: sound %s\n", flashPlay ? "not stopped" : "stopped");
+        errors += flashPlay;
+        sleep_f = false;
+    }
+
+    /* Erase the flash under a sound waiting for room in the fifo. */
+    {
+        uint8_t cmd[4] = {PLAY_SOUND_CMD, count, 0, 0};
+        uint32_t left = 0;
+
+        parse_cmd(cmd);
+        for (i = 0; i < 1000 && AudioFifoLength() < AudioFifoCapacity; i++)
+            sim_main_loop(loop);
+        cmd[0] = ERASE_FLASH_CMD;
+        cmd[1] = 0;
+        parse_cmd(cmd);
+        for (i = 0; i < 100000000 && eraseFlag; i++)
+            sim_main_loop(loop);
+        /* The TOC gets the index of the next sound back. */
+        for (i = 0x400; i < sim_flash_part.size; i++)
+            left += sim_flash[i] != 0xFF;
+        printf("erase: %u bytes left, sound %s\n", left,
+               (flashPlay || soundToPlay) ? "not stopped" : "stopped");
+        errors += left || eraseFlag || flashPlay || soundToPlay;
+    }
+    printf("errors: %u\n", errors);
+    return errors ? 1 : 0;
+}
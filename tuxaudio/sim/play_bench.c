@@ -0,0 +1,210 @@
+/*
+ * TUXAUDIO - Firmware for the 'audio' CPU of tuxdroid
+ * Copyright (C) 2007 C2ME S.A. <tuxdroid@c2me.be>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* $Id$ */
+
+/** \file play_bench.c
+    \brief Latency of PLAY_SOUND_CMD and cost of loading the TOC at boot.
+
+    The simulated flash is filled with a number of raw sounds, each on its own
+    4kB block. The TOC is loaded twice like at boot, first with an empty
+    EEPROM mirror and then with the mirror written by the first load. Every
+    sound is then played with PLAY_SOUND_CMD, measuring the flash
+    transactions, the SPI bytes and the time from the command to the first
+    sample put in the audio fifo.
+
+    Only the SPI transfers and the main loop period take time in the
+    simulation, the code and the EEPROM reads are free.
+
+    With -f, another part than the AT26F004 is modelled. A larger one can
+    hold more sounds than the EEPROM mirror, their entries are read from the
+    flash.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <avr/io.h>
+#include <avr/eeprom.h>
+
+#include "sim.h"
+#include "../common/commands.h"
+#include "../varis.h"
+#include "../flash.h"
+#include "../toc.h"
+#include "../parser.h"
+#include "../audio_fifo.h"
+
+/** Flash and EEPROM costs of an operation. */
+struct cost
+{
+    uint32_t transactions;
+    uint32_t bytes;
+    uint32_t eeprom_writes;
+    uint64_t cycles;
+};
+
+static struct cost cost_start(void)
+{
+    struct cost c = {sim_flash_stats.transactions, sim_flash_stats.bytes,
+                     sim_eeprom_writes, sim_cycles};
+    return c;
+}
+
+static struct cost cost_end(struct cost start)
+{
+    struct cost c = {sim_flash_stats.transactions - start.transactions,
+                     sim_flash_stats.bytes - start.bytes,
+                     sim_eeprom_writes - start.eeprom_writes,
+                     sim_cycles - start.cycles};
+    return c;
+}
+
+static void usage(void)
+{
+    fprintf(stderr,
+            "usage: play_bench [options]\n"
+            "  -n N      number of sounds in the flash (20)\n"
+            "  -s BYTES  size of each sound (256)\n"
+            "  -c CYC    cycles taken by one main loop iteration (400)\n"
+            "  -v        print the latency of each sound\n"
+            "  -f PART   flash part modelled (at26f004, at25df041a, w25q16,\n"
+            "            w25q32, unknown)\n");
+    exit(1);
+}
+
+/*
+ * Store the sounds and their TOC in the flash.
+ */
+static void fill_flash(unsigned sounds, unsigned size)
+{
+    uint32_t start = 0x400, stop;
+    unsigned i, j;
+
+    sim_flash_init();
+    sim_flash[0] = 0xFE;
+    sim_flash[TOC_FIRST] = 0x00;
+    sim_flash[TOC_FIRST + 1] = 0x04;
+    sim_flash[TOC_FIRST + 2] = 0x00;
+    for (i = 1; i <= sounds; i++)
+    {
+        for (j = 0; j < size; j++)
+            sim_flash[start + j] = 0x80 + ((j & 0x10) ? 0x40 : -0x40);
+        stop = start + size;
+        sim_flash[TOC_FIRST + 3 * i] = stop >> 16;
+        sim_flash[TOC_FIRST + 3 * i + 1] = stop >> 8;
+        sim_flash[TOC_FIRST + 3 * i + 2] = stop;
+        start = (stop + 0xFFF) & ~0xFFFUL;
+    }
+}
+
+static void print_cost(char const *name, struct cost c)
+{
+    printf("%-22s %3u transactions %5u SPI bytes %4u EEPROM writes "
+           "%8.1f us\n", name, c.transactions, c.bytes, c.eeprom_writes,
+           (double)c.cycles / SIM_CYCLES_PER_US);
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned sounds = 20, size = 256, loop = 400, verbose = 0;
+    struct cost c, sum = {0}, max = {0};
+    unsigned i;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:s:c:vf:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n': sounds = atoi(optarg); break;
+        case 's': size = atoi(optarg); break;
+        case 'c': loop = atoi(optarg); break;
+        case 'v': verbose = 1; break;
+        case 'f':
+            if (!sim_flash_set_part(optarg))
+                usage();
+            break;
+        default: usage();
+        }
+    }
+    /* Each sound has its own block. */
+    if (sounds < 1 || sounds > TOC_MAX_SOUNDS ||
+        ((uint32_t)sounds << 12) > sim_flash_part.size || size < 1 ||
+        size > 0x1000 || loop < 1)
+        usage();
+
+    fill_flash(sounds, size);
+    sim_init();
+
+    c = cost_start();
+    toc_load();
+    print_cost("boot, empty mirror:", cost_end(c));
+    c = cost_start();
+    toc_load();
+    print_cost("boot, valid mirror:", cost_end(c));
+    if (numSound != sounds)
+    {
+        fprintf(stderr, "%u sounds found instead of %u\n", numSound, sounds);
+        return 1;
+    }
+
+    for (i = 1; i <= sounds; i++)
+    {
+        uint8_t cmd[4] = {PLAY_SOUND_CMD, i, (i >> 2) & SOUND_HI_MK, 0};
+        uint8_t in_idx = AudioInIdx;
+
+        c = cost_start();
+        parse_cmd(cmd);
+        while (AudioInIdx == in_idx && flashPlay)
+            sim_main_loop(loop);
+        c = cost_end(c);
+        if (AudioInIdx == in_idx)
+        {
+            fprintf(stderr, "sound %u didn't play\n", i);
+            return 1;
+        }
+        if (verbose)
+        {
+            char name[32];
+            snprintf(name, sizeof name, "sound %u:", i);
+            print_cost(name, c);
+        }
+        sum.transactions += c.transactions;
+        sum.bytes += c.bytes;
+        sum.cycles += c.cycles;
+        if (c.transactions > max.transactions)
+            max.transactions = c.transactions;
+        if (c.bytes > max.bytes)
+            max.bytes = c.bytes;
+        if (c.cycles > max.cycles)
+            max.cycles = c.cycles;
+
+        while (flashPlay || AudioFifoLength())
+            sim_main_loop(loop);
+    }
+    printf("first sample, mean:    %5.1f transactions %5.1f SPI bytes "
+           "%8.1f us\n", (double)sum.transactions / sounds,
+           (double)sum.bytes / sounds,
+           (double)sum.cycles / sounds / SIM_CYCLES_PER_US);
+    printf("first sample, max:     %3u transactions %5u SPI bytes "
+           "%8.1f us\n", max.transactions, max.bytes,
+           (double)max.cycles / SIM_CYCLES_PER_US);
+    return 0;
+}
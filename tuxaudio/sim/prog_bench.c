@@ -0,0 +1,655 @@
+/*
+ * TUXAUDIO - Firmware for the 'audio' CPU of tuxdroid
+ * Copyright (C) 2007 C2ME S.A. <tuxdroid@c2me.be>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* $Id$ */
+
+/** \file prog_bench.c
+    \brief Throughput of STORE_SOUND_CMD against the simulated AT26F004.
+
+    A sound is stored in an empty flash with STORE_SOUND_CMD, its bytes sent
+    in RF frames at a given period, followed by frames without audio to end
+    the programming. The time to program the sound, the bytes dropped or
+    sent again and the throughput reported by the firmware with
+    STATUS_FLASH_PROG_CMD are printed, and the stored bytes are checked.
+
+    The sound is sent either as speaker audio, AUDIO_SPK_SIZE bytes per frame
+    which are dropped when the audio fifo is full, or in bulk frames of
+    BULK_SIZE bytes. The bulk sender follows the acks of tuxaudio: it doesn't
+    send more frames than announced after the last one stored, and goes back
+    to the first frame not stored when the ack shows the previous frame was
+    refused or lost. The bulk frames tuxaudio saw lost are then requested
+    with LINK_STATS_REQ_CMD, the ones lost before the sender went back can't
+    be seen.
+
+    The bytes of the sound are a ramp, each byte being the previous one
+    plus 1.
+
+    With -i, a flash image built by tools/flash_image is written instead,
+    block by block with WRITE_BLOCK_CMD. The CRC returned for each block and
+    the whole flash are checked against the image.
+
+    With -y OLD, the flash holds the image OLD instead and is synchronized
+    with the image as tools/bank_sync would: CRC_RANGE_CMD is sent for
+    block 0 and the blocks of each sound, only the parts whose CRC differs
+    are written, then the CRC_SOUND_CMD of each sound is checked.
+
+    With -f, another part than the AT26F004 is modelled, parts without the
+    sequential program mode are written one byte per command.
+
+    With -x or -e, CRC_RANGE_CMD or ERASE_FLASH_CMD is sent while the sound
+    is stored, it should be refused and leave the programming alone.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <avr/io.h>
+#include <util/crc16.h>
+
+#include "sim.h"
+#include "../common/defines.h"
+#include "../common/commands.h"
+#include "../common/api.h"
+#include "../varis.h"
+#include "../flash.h"
+#include "../toc.h"
+#include "../parser.h"
+
+/** Delay between STORE_SOUND_CMD and the first frame, in us. */
+#define START_DELAY 5000
+/** Time during which frames without audio are sent after the sound, in us.
+ * The programming ends STOP_FRAME_NUMBER frames after the fifo is empty. */
+#define END_TIME 500000
+/** Longest time the sound can take to be stored, in us per frame. */
+#define MAX_FRAME_TIME 20000
+
+static unsigned verbose;
+/** Last throughput reported by the firmware. */
+static unsigned reported_rate;
+/** Probability to lose a frame, in percent. */
+static double loss;
+/** Last STATUS_FLASH_BLOCK_CMD received, 0 once consumed. */
+static uint8_t block_status[4];
+/** CRC returned by STATUS_FLASH_CRC_CMD, with a bit set for each half
+ * received, 4 for CRC_NONE. */
+static uint32_t crc_status;
+static uint8_t crc_parts;
+/** Set when UNKNOWN_CODEC is received. */
+static bool codec_refused;
+/** LINK_LOST of STATUS_LINK_CMD, set once received. */
+static uint16_t link_lost;
+static bool link_answered;
+
+/** Bulk sender. */
+static struct
+{
+    bool on;
+    /** Bytes to send, the last frame is padded with 0xFF. */
+    uint8_t const *data;
+    uint32_t size;
+    /** Frames of the data, frames stored, next frame to send. */
+    uint32_t frames, stored, next;
+    /** Frames tuxaudio can take after the last one stored. */
+    uint8_t credit;
+    /** Frame sent in the current and in the previous exchange, -1 for a
+     * frame without bulk data. */
+    int32_t current, previous;
+    /** Bulk frames sent and lost. */
+    uint32_t sent, lost;
+} bulk;
+
+static void usage(void)
+{
+    fprintf(stderr,
+            "usage: prog_bench [options]\n"
+            "  -k CODEC  parameter of STORE_SOUND_CMD (2)\n"
+            "            0: 16kHz samples stored at 8kHz, 1: ADPCM, 2: 8kHz\n"
+            "            3: header, others should be refused\n"
+            "  -b        send the sound in bulk frames\n"
+            "  -n BYTES  bytes of the sound to store (65536)\n"
+            "  -p US     period of the RF frames (2062.5, 16kHz samples)\n"
+            "  -l PCT    bulk frame loss probability (0)\n"
+            "  -s SEED   random seed (1)\n"
+            "  -c CYC    cycles taken by one main loop iteration (400)\n"
+            "  -i IMAGE  write a flash image in bulk frames\n"
+            "  -y OLD    only write the blocks of IMAGE which differ from OLD\n"
+            "  -v        print the throughput reported during programming\n"
+            "  -f PART   flash part modelled (at26f004, at25df041a, w25q16,\n"
+            "            w25q32, unknown)\n"
+            "  -x BYTES  send CRC_RANGE_CMD once BYTES are programmed\n"
+            "  -e BYTES  send ERASE_FLASH_CMD once BYTES are programmed\n");
+    exit(1);
+}
+
+/*
+ * Commands sent to the RF by tuxaudio.
+ */
+static void rf_cmd(uint8_t const *cmd)
+{
+    if (cmd[0] == STATUS_FLASH_PROG_CMD && cmd[1] == PROG_RATE)
+    {
+        reported_rate = (cmd[2] << 8) | cmd[3];
+        if (verbose)
+            printf("%8.3f s: %u bytes/s\n",
+                   (double)sim_cycles / F_CPU, reported_rate);
+    }
+    else if (cmd[0] == STATUS_FLASH_PROG_CMD && cmd[1] == UNKNOWN_CODEC)
+        codec_refused = true;
+    else if (cmd[0] == STATUS_FLASH_BLOCK_CMD)
+        memcpy(block_status, cmd, 4);
+    else if (cmd[0] == STATUS_FLASH_CRC_CMD)
+    {
+        if (cmd[1] == CRC_HIGH)
+            crc_status = (uint32_t)((cmd[2] << 8) | cmd[3]) << 16;
+        else if (cmd[1] == CRC_LOW)
+            crc_status |= (cmd[2] << 8) | cmd[3];
+        crc_parts |= 1 << cmd[1];
+    }
+    else if (cmd[0] == STATUS_LINK_CMD && cmd[1] == LINK_LOST)
+    {
+        link_lost = (cmd[2] << 8) | cmd[3];
+        link_answered = true;
+    }
+}
+
+/*
+ * CRC-32 computed by checksum().
+ */
+static uint32_t crc32(uint8_t const *p, uint32_t len)
+{
+    uint32_t crc = 0xFFFFFFFF;
+    int bit;
+
+    while (len--)
+    {
+        crc ^= *p++;
+        for (bit = 0; bit < 8; bit++)
+            crc = (crc >> 1) ^ ((crc & 1) ? 0xEDB88320 : 0);
+    }
+    return ~crc;
+}
+
+/*
+ * Send CRC_SOUND_CMD or CRC_RANGE_CMD and return true if the CRC returned
+ * matches.
+ */
+static bool crc_check(uint8_t code, uint16_t first, uint8_t param,
+                      uint32_t crc, unsigned loop, uint64_t end)
+{
+    uint8_t cmd[4] = {code, first, param | ((first >> 2) & SOUND_HI_MK), 0};
+
+    crc_parts = 0;
+    parse_cmd(cmd);
+    while (crc_parts != 3 && !(crc_parts & 4) && sim_cycles < end)
+        sim_main_loop(loop);
+    if (verbose)
+        printf("%8.3f s: crc 0x%08x, 0x%08x expected\n",
+               (double)sim_cycles / F_CPU, crc_status, crc);
+    return crc_parts == 3 && crc_status == crc;
+}
+
+/*
+ * Address of a TOC entry of an image, without the codec flags.
+ */
+static uint32_t image_address(uint8_t const *image, uint16_t n)
+{
+    uint8_t const *entry = image + TOC_FIRST + 3 * n;
+
+    return ((uint32_t)(entry[0] & TOC_ADDR_MK) << 16) | entry[1] << 8 |
+        entry[2];
+}
+
+/*
+ * Find the blocks of an image which differ from the flash, split as
+ * tools/bank_sync does.
+ */
+static void sync_blocks(uint8_t const *image, uint32_t blocks,
+                        bool *write, unsigned loop, uint64_t end)
+{
+    uint32_t first, last, start, stop;
+    uint16_t n;
+
+    write[0] = !crc_check(CRC_RANGE_CMD, 0, 0,
+                          crc32(image, IMAGE_BLOCK_SIZE), loop, end);
+    for (n = 1; n <= TOC_MAX_SOUNDS &&
+             image[TOC_FIRST + 3 * n] != 0xFF; n++)
+    {
+        start = (n == 1) ? IMAGE_BLOCK_SIZE :
+            ((image_address(image, n - 1) >> 12) + 1) << 12;
+        stop = image_address(image, n);
+        for (first = start >> 12; first << 12 < stop; first += 64)
+        {
+            last = (stop - 1) >> 12;
+            if (last > first + 63)
+                last = first + 63;
+            if (last >= blocks)
+                break;
+            if (!crc_check(CRC_RANGE_CMD, first, last - first,
+                           crc32(image + (first << 12),
+                                 (last - first + 1) << 12), loop, end))
+                memset(write + first, true, last - first + 1);
+        }
+    }
+}
+
+/*
+ * Check the CRC_SOUND_CMD of each sound of an image, return the number of
+ * wrong ones.
+ */
+static uint32_t sync_check(uint8_t const *image, unsigned loop,
+                           uint64_t end)
+{
+    uint32_t errors = 0, start;
+    uint16_t n;
+
+    for (n = 1; n <= TOC_MAX_SOUNDS &&
+             image[TOC_FIRST + 3 * n] != 0xFF; n++)
+    {
+        start = (n == 1) ? image_address(image, 0) :
+            ((image_address(image, n - 1) >> 12) + 1) << 12;
+        if (!crc_check(CRC_SOUND_CMD, n, 0,
+                       crc32(image + start, image_address(image, n) - start),
+                       loop, end))
+            errors++;
+    }
+    return errors;
+}
+
+/*
+ * Put the next bulk frame in the frame sent to tuxaudio.
+ */
+static bool bulk_fill(uint8_t *frame)
+{
+    uint32_t n;
+    uint8_t i;
+
+    bulk.previous = bulk.current;
+    bulk.current = -1;
+    if (!bulk.on || bulk.stored >= bulk.frames)
+        return true;
+    /* Start again from the first frame not stored once the window is
+     * full. */
+    if (bulk.next >= bulk.frames || bulk.next >= bulk.stored + bulk.credit)
+        bulk.next = bulk.stored;
+    n = bulk.next++;
+    bulk.current = n;
+    bulk.sent++;
+    frame[SPI_IDX_OFFSET] = BULK_FIRST_IDX + n;
+    frame[SPI_CONFIG_OFFSET] |= CFG_BULK_MK;
+    for (i = 0; i < BULK_SIZE; i++)
+        frame[SPI_DATA_OFFSET + i] = (n * BULK_SIZE + i < bulk.size) ?
+            bulk.data[n * BULK_SIZE + i] : 0xFF;
+    if (loss > 0 && rand() < loss / 100 * RAND_MAX)
+    {
+        bulk.lost++;
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Frames received from tuxaudio, they carry the ack of the frame sent in
+ * the previous exchange.
+ */
+static void bulk_ack(uint8_t const *frame)
+{
+    uint8_t last = BULK_FIRST_IDX + bulk.stored - 1;
+
+    if (!(frame[SPI_CONFIG_OFFSET] & CFG_BULK_MK))
+        return;
+    bulk.on = true;
+    bulk.stored += (uint8_t)(frame[BULK_ACK_OFFSET] - last);
+    bulk.credit = frame[BULK_CREDIT_OFFSET];
+    /* The previous frame was refused or lost. */
+    if (bulk.previous >= 0 && bulk.stored <= (uint32_t)bulk.previous)
+        bulk.next = bulk.stored;
+}
+
+/*
+ * Write a flash image block by block, each one being sent once its erase is
+ * done.
+ */
+static int image_run(char const *name, char const *old, double period,
+                     unsigned loop)
+{
+    static uint8_t image[SIM_FLASH_SIZE];
+    static bool write[IMAGE_BLOCKS];
+    uint32_t size, blocks, block, count, frames_max, written = 0, n, i;
+    uint32_t errors = 0, crc_errors = 0, sent = 0, lost = 0;
+    struct sim_frame *frames;
+    uint64_t start, end, synced = 0;
+    FILE *f = fopen(name, "rb");
+
+    if (!f)
+    {
+        perror(name);
+        return 1;
+    }
+    size = fread(image, 1, sizeof(image), f);
+    fclose(f);
+    blocks = (size + IMAGE_BLOCK_SIZE - 1) / IMAGE_BLOCK_SIZE;
+    if (!blocks || blocks > IMAGE_BLOCKS)
+        usage();
+    memset(image + size, 0xFF, sizeof(image) - size);
+
+    sim_flash_init();
+    if (old)
+    {
+        f = fopen(old, "rb");
+        if (!f)
+        {
+            perror(old);
+            return 1;
+        }
+        if (!fread(sim_flash, 1, sim_flash_part.size, f))
+            usage();
+        fclose(f);
+    }
+    else
+    {
+        /* The flash holds other sounds, the image replaces them. */
+        for (i = 0; i < sim_flash_part.size; i++)
+            sim_flash[i] = i;
+    }
+
+    count = (IMAGE_BLOCK_SIZE + BULK_SIZE - 1) / BULK_SIZE;
+    frames_max = blocks * (count + count * MAX_FRAME_TIME / period);
+    frames = malloc(frames_max * sizeof *frames);
+    start = START_DELAY * SIM_CYCLES_PER_US;
+    for (i = 0; i < frames_max; i++)
+    {
+        frames[i].at = start + (uint64_t)(i * period * SIM_CYCLES_PER_US);
+        frames[i].config = 0;
+    }
+
+    sim_init();
+    toc_load();
+    sim_rf_cmd = rf_cmd;
+    sim_rf_fill = bulk_fill;
+    sim_rf_out = bulk_ack;
+    sim_rf_load(frames, frames_max);
+    end = frames[frames_max - 1].at;
+
+    if (old)
+    {
+        sync_blocks(image, blocks, write, loop, end);
+        synced = sim_cycles;
+    }
+    else
+        memset(write, true, blocks);
+
+    /* Block 0 is written last, once the sounds of its TOC are there. */
+    for (n = 1; n <= blocks && sim_cycles < end; n++)
+    {
+        uint8_t cmd[4] = {WRITE_BLOCK_CMD, n % blocks, 0, 0};
+        uint8_t const *data;
+        uint16_t crc = 0xFFFF;
+
+        block = n % blocks;
+        data = image + block * IMAGE_BLOCK_SIZE;
+        if (!write[block])
+            continue;
+        written++;
+        memset(&bulk, 0, sizeof(bulk));
+        bulk.data = data;
+        bulk.size = size - block * IMAGE_BLOCK_SIZE;
+        if (bulk.size > IMAGE_BLOCK_SIZE)
+            bulk.size = IMAGE_BLOCK_SIZE;
+        bulk.frames = count;
+        bulk.current = -1;
+        block_status[0] = 0;
+        parse_cmd(cmd);
+        while (!block_status[0] && sim_cycles < end)
+            sim_main_loop(loop);
+        sent += bulk.sent;
+        lost += bulk.lost;
+
+        for (i = 0; i < IMAGE_BLOCK_SIZE; i++)
+            crc = _crc_ccitt_update(crc, i < bulk.size ? data[i] : 0xFF);
+        if (block_status[1] != block ||
+            ((block_status[2] << 8) | block_status[3]) != crc)
+            crc_errors++;
+        if (verbose)
+            printf("%8.3f s: block %u, crc 0x%02x%02x\n",
+                   (double)sim_cycles / F_CPU, block, block_status[2],
+                   block_status[3]);
+    }
+    /* Let the status commands go out. */
+    for (i = 0; i < 100; i++)
+        sim_main_loop(loop);
+    if (old)
+        crc_errors += sync_check(image, loop, end);
+
+    for (i = 0; i < blocks * IMAGE_BLOCK_SIZE; i++)
+        if (sim_flash[i] != image[i])
+            errors++;
+
+    printf("image:            %u bytes in %u blocks, frames of %.1f us\n",
+           size, blocks, period);
+    if (old)
+        printf("compared in:      %.3f s, %u blocks differ\n",
+               (double)(synced - start) / F_CPU, written);
+    if (n > blocks)
+        printf("written in:       %.3f s, %.0f bytes/s\n",
+               (double)(sim_cycles - start) / F_CPU,
+               (old ? written * IMAGE_BLOCK_SIZE : size) * (double)F_CPU /
+               (sim_cycles - start));
+    else
+        printf("written in:       not finished\n");
+    printf("sent:             %u bulk frames, %u lost, %u sent again\n",
+           sent, lost, sent - written * count);
+    printf("stored:           %u bytes wrong, %u crc wrong, %u sounds in "
+           "the TOC\n", errors, crc_errors, numSound);
+    free(frames);
+    return (errors || crc_errors || n <= blocks) ? 1 : 0;
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned codec = CODEC_RAW_8K, loop = 400, seed = 1;
+    uint32_t bytes = 65536, crc_at = 0, erase_at = 0, sent, count, frames_max, i;
+    double period = AUDIO_SPK_SIZE * 1e6 / 16000;
+    struct sim_frame *frames;
+    uint64_t start, done = 0, end;
+    uint32_t errors = 0;
+    uint8_t cmd[4] = {STORE_SOUND_CMD, 0, 0, 0};
+    uint8_t *sound = NULL;
+    char const *image = NULL, *old = NULL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "k:bn:p:l:s:c:i:y:vf:x:e:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 'k': codec = atoi(optarg); break;
+        case 'b': cmd[2] = 1; break;
+        case 'n': bytes = atoi(optarg); break;
+        case 'p': period = atof(optarg); break;
+        case 'l': loss = atof(optarg); break;
+        case 's': seed = atoi(optarg); break;
+        case 'c': loop = atoi(optarg); break;
+        case 'i': image = optarg; break;
+        case 'y': old = optarg; break;
+        case 'v': verbose = 1; break;
+        case 'x': crc_at = atoi(optarg); break;
+        case 'e': erase_at = atoi(optarg); break;
+        case 'f':
+            if (!sim_flash_set_part(optarg))
+                usage();
+            break;
+        default: usage();
+        }
+    }
+    if (codec > 0xFF || bytes < 1 || bytes > 0x70000 ||
+        period <= 0 || loss < 0 || loss >= 100 || loop < 1)
+        usage();
+    srand(seed);
+    if (image)
+        return image_run(image, old, period, loop);
+
+    /* Empty flash with the first TOC entry written by erase(). */
+    sim_flash_init();
+    sim_flash[0] = 0xFE;
+    sim_flash[TOC_FIRST] = 0x00;
+    sim_flash[TOC_FIRST + 1] = 0x04;
+    sim_flash[TOC_FIRST + 2] = 0x00;
+
+    if (cmd[2])
+    {
+        /* Bulk bytes are stored as is. */
+        if (codec == CODEC_RAW)
+            codec = CODEC_RAW_8K;
+        count = (bytes + BULK_SIZE - 1) / BULK_SIZE;
+        bytes = count * BULK_SIZE;
+        sound = malloc(bytes);
+        for (i = 0; i < bytes; i++)
+            sound[i] = i;
+        bulk.data = sound;
+        bulk.size = bytes;
+        bulk.frames = count;
+        bulk.current = -1;
+        /* The frames are filled by bulk_fill(), without audio once all
+         * are stored. */
+        frames_max = count + count * MAX_FRAME_TIME / period +
+            END_TIME / period;
+    }
+    else
+    {
+        sent = (codec == CODEC_RAW) ? 2 * bytes : bytes;
+        count = (sent + AUDIO_SPK_SIZE - 1) / AUDIO_SPK_SIZE;
+        /* The stored bytes are checked up to the end of the last frame. */
+        sent = count * AUDIO_SPK_SIZE;
+        bytes = (codec == CODEC_RAW) ? sent / 2 : sent;
+        frames_max = count + END_TIME / period + STOP_FRAME_NUMBER;
+    }
+    frames = malloc(frames_max * sizeof *frames);
+    start = START_DELAY * SIM_CYCLES_PER_US;
+    for (i = 0; i < frames_max; i++)
+    {
+        frames[i].at = start + (uint64_t)(i * period * SIM_CYCLES_PER_US);
+        frames[i].config = (!cmd[2] && i < count) ? CFG_AUDIO_MK : 0;
+    }
+
+    sim_init();
+    toc_load();
+    sim_rf_cmd = rf_cmd;
+    sim_rf_fill = bulk_fill;
+    sim_rf_out = bulk_ack;
+    sim_rf_load(frames, frames_max);
+    cmd[1] = codec;
+    parse_cmd(cmd);
+    if (codec > CODEC_HEADER)
+    {
+        while (!codec_refused && sim_cycles < frames[count].at)
+            sim_main_loop(loop);
+        printf("codec %u:         %s, %u sounds in the TOC\n", codec,
+               codec_refused ? "refused" : "not refused", numSound);
+        free(sound);
+        free(frames);
+        return (!codec_refused || programmingFlash || numSound) ? 1 : 0;
+    }
+
+    end = frames[frames_max - 1].at;
+    /* The first byte is written when the programming starts, before any
+     * frame is received. */
+    crc_parts = 0;
+    while (programmingFlash && sim_cycles < end)
+    {
+        sim_main_loop(loop);
+        if (!done && sim_flash_stats.programmed >= bytes + 1)
+            done = sim_cycles;
+        if (crc_at && sim_flash_stats.programmed >= crc_at)
+        {
+            uint8_t crc_cmd[4] = {CRC_RANGE_CMD, 0, 0, 0};
+
+            parse_cmd(crc_cmd);
+            crc_at = 0;
+        }
+        if (erase_at && sim_flash_stats.programmed >= erase_at)
+        {
+            uint8_t erase_cmd[4] = {ERASE_FLASH_CMD, 1, 0, 0};
+
+            parse_cmd(erase_cmd);
+            erase_at = 0;
+        }
+    }
+    /* Let the status commands go out. */
+    for (i = 0; i < 100; i++)
+        sim_main_loop(loop);
+    if (cmd[2])
+    {
+        uint8_t stats_cmd[4] = {LINK_STATS_REQ_CMD, 0, 0, 0};
+
+        parse_cmd(stats_cmd);
+        while (!link_answered && sim_cycles < end)
+            sim_main_loop(loop);
+    }
+
+    for (i = 0; i < bytes; i++)
+    {
+        uint8_t expected = (codec == CODEC_RAW) ? 2 * i : i;
+        if (sim_flash[0x401 + i] != expected)
+            errors++;
+    }
+    /* The codec is flagged in the stop address. */
+    if ((sim_flash[TOC_FIRST + 3] & ~TOC_ADDR_MK) !=
+        ((codec == CODEC_ADPCM) ? TOC_ADPCM_MK :
+         (codec == CODEC_HEADER) ? TOC_HEADER_MK : 0))
+        errors++;
+
+    if (cmd[2])
+        printf("sound:            %u bytes in %u bulk frames of %.1f us\n",
+               bytes, count, period);
+    else
+        printf("sound:            %u bytes in %u frames of %.1f us\n",
+               bytes, count, period);
+    if (done)
+        printf("programmed in:    %.3f s, %.0f bytes/s, %.2fx real time\n",
+               (double)(done - start) / F_CPU,
+               bytes * (double)F_CPU / (done - start),
+               ((codec == CODEC_ADPCM) ? 2.0 * bytes : bytes) / 8000.0 /
+               ((double)(done - start) / F_CPU));
+    else
+        printf("programmed in:    not finished\n");
+    printf("reported:         %u bytes/s on average\n", reported_rate);
+    if (cmd[2])
+    {
+        printf("sent:             %u bulk frames, %u lost, %u sent again\n",
+               bulk.sent, bulk.lost, bulk.sent - count);
+        if (link_answered)
+            printf("link:             %u bulk frames seen lost\n", link_lost);
+        else
+            printf("link:             not answered\n");
+    }
+    else
+        printf("dropped:          %u samples, %u frames\n",
+               sim_stats.overruns, sim_stats.frames_lost);
+    printf("stored:           %u bytes wrong, %u sounds in the TOC\n",
+           errors, numSound);
+    if (crc_parts)
+        printf("crc:              answered while storing\n");
+    free(sound);
+    free(frames);
+    if (eraseFlag)
+        printf("erase:            started while storing\n");
+    return (errors || !done || crc_parts || crc_at || eraseFlag ||
+            erase_at || (cmd[2] && (!link_answered || link_lost > bulk.lost))) ?
+        1 : 0;
+}
@@ -0,0 +1,310 @@
+/*
+ * TUXAUDIO - Firmware for the 'audio' CPU of tuxdroid
+ * Copyright (C) 2007 C2ME S.A. <tuxdroid@c2me.be>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* $Id$ */
+
+/** \file rf_bench.c
+    \brief Trace-replay benchmark of the speaker pipeline.
+
+    RF frames carrying speaker data are replayed through communication_task()
+    and the audio fifo is drained by the real sampling interrupt. The frames
+    are either read from a trace file or generated with a given sample rate,
+    clock offset, jitter and loss pattern.
+
+    The trace file has one frame per line: the TXE time in microseconds
+    followed by an optional config byte (CFG_AUDIO_MK by default). Lines
+    starting with '#' are ignored.
+
+    A summary with the underrun and overrun counts, the fifo fill statistics
+    and the range of OCR0A is printed at the end. The fifo length and OCR0A
+    can also be logged over time in CSV.
+
+    The rate controller is rated by its convergence time, the last time the
+    fifo length averaged over CONV_WINDOW ms was more than CONV_BAND samples
+    away from its steady state, and by the variance of the fifo length in the
+    steady state, taken as the second half of the stream.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <avr/io.h>
+
+#include "sim.h"
+#include "../common/defines.h"
+#include "../audio_fifo.h"
+
+/** Moving average window for the convergence time, in ms. */
+#define CONV_WINDOW 50
+/** Distance to the steady state fifo length considered as converged. */
+#define CONV_BAND 8.0
+
+static void usage(void)
+{
+    fprintf(stderr,
+            "usage: rf_bench [options]\n"
+            "  -t FILE   replay the frames of a trace file\n"
+            "  -d SEC    duration of the generated stream (10)\n"
+            "  -r HZ     sample rate of the generated stream (16000)\n"
+            "  -a        generate compressed (ADPCM) frames\n"
+            "  -p PPM    clock offset of the dongle (0)\n"
+            "  -j US     peak frame jitter (0)\n"
+            "  -l PCT    frame loss probability (0)\n"
+            "  -b N      frames lost in a row on each loss (1)\n"
+            "  -s SEED   random seed (1)\n"
+            "  -c CYC    cycles taken by one main loop iteration (400)\n"
+            "  -o FILE   log the fifo length and OCR0A in CSV\n"
+            "  -i MS     logging interval (1)\n");
+    exit(1);
+}
+
+/*
+ * Read the frames of a trace file.
+ */
+static struct sim_frame *read_trace(char const *name, uint32_t *count)
+{
+    FILE *f = fopen(name, "r");
+    struct sim_frame *frames = NULL;
+    uint32_t n = 0, size = 0;
+    char line[128];
+
+    if (!f)
+    {
+        perror(name);
+        exit(1);
+    }
+    while (fgets(line, sizeof line, f))
+    {
+        double us;
+        unsigned config = CFG_AUDIO_MK;
+
+        if (line[0] == '#' || sscanf(line, "%lf %i", &us, &config) < 1)
+            continue;
+        if (n == size)
+        {
+            size = size ? size * 2 : 1024;
+            frames = realloc(frames, size * sizeof *frames);
+        }
+        frames[n].at = (uint64_t)(us * SIM_CYCLES_PER_US);
+        frames[n].config = config;
+        n++;
+    }
+    fclose(f);
+    *count = n;
+    return frames;
+}
+
+/*
+ * Generate a stream of audio frames.
+ */
+static struct sim_frame *generate(double duration, double rate, double ppm,
+                                  double jitter, double loss, unsigned burst,
+                                  uint8_t config, uint32_t *count)
+{
+    unsigned samples = (config & CFG_ADPCM_MK) ?
+        AUDIO_SPK_ADPCM_SAMPLES : AUDIO_SPK_SIZE;
+    double period = samples * 1e6 / (rate * (1 + ppm * 1e-6));
+    uint32_t total = duration * 1e6 / period;
+    struct sim_frame *frames = malloc(total * sizeof *frames);
+    uint32_t i, n = 0;
+    unsigned lost = 0;
+    double last = 0;
+
+    for (i = 0; i < total; i++)
+    {
+        double us = (i + 1) * period;
+
+        if (lost)
+        {
+            lost--;
+            continue;
+        }
+        if (loss > 0 && rand() < loss / 100 * RAND_MAX)
+        {
+            lost = burst - 1;
+            continue;
+        }
+        if (jitter > 0)
+            us += jitter * (2.0 * rand() / RAND_MAX - 1);
+        if (us < last)
+            us = last;
+        last = us;
+        frames[n].at = (uint64_t)(us * SIM_CYCLES_PER_US);
+        frames[n].config = config;
+        n++;
+    }
+    *count = n;
+    return frames;
+}
+
+/*
+ * Print the convergence time and the steady state of the fifo length and
+ * OCR0A sampled each ms.
+ */
+static void convergence(uint8_t const *fill, uint8_t const *ocr, uint32_t ms)
+{
+    double mean = 0, var = 0, ocr_mean = 0, ocr_var = 0, sum = 0;
+    uint32_t i, half = ms / 2, conv = 0;
+
+    if (ms < 2 * CONV_WINDOW)
+        return;
+    for (i = half; i < ms; i++)
+    {
+        mean += fill[i];
+        var += fill[i] * fill[i];
+        ocr_mean += ocr[i];
+        ocr_var += ocr[i] * ocr[i];
+    }
+    mean /= ms - half;
+    var = var / (ms - half) - mean * mean;
+    ocr_mean /= ms - half;
+    ocr_var = ocr_var / (ms - half) - ocr_mean * ocr_mean;
+
+    for (i = 0; i < ms; i++)
+    {
+        sum += fill[i];
+        if (i >= CONV_WINDOW)
+            sum -= fill[i - CONV_WINDOW];
+        if (i >= CONV_WINDOW - 1 &&
+            fabs(sum / CONV_WINDOW - mean) > CONV_BAND)
+            conv = i + 1;
+    }
+
+    printf("convergence:      %u ms\n", conv);
+    printf("steady fifo:      mean %.1f, variance %.1f\n", mean,
+           var > 0 ? var : 0);
+    printf("steady OCR0A:     mean %.3f, stddev %.3f\n", ocr_mean,
+           sqrt(ocr_var > 0 ? ocr_var : 0));
+}
+
+int main(int argc, char *argv[])
+{
+    char const *trace = NULL, *csv = NULL;
+    double duration = 10, rate = 16000, ppm = 0, jitter = 0, loss = 0;
+    unsigned burst = 1, seed = 1, loop = 400, interval = 1;
+    struct sim_frame *frames;
+    uint8_t config = CFG_AUDIO_MK;
+    uint32_t count;
+    uint64_t end, next_log = 0, next_ms = 0;
+    uint8_t *fill_ms, *ocr_ms;
+    uint32_t ms = 0, stream_ms;
+    FILE *log = NULL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "t:d:r:ap:j:l:b:s:c:o:i:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 't': trace = optarg; break;
+        case 'd': duration = atof(optarg); break;
+        case 'r': rate = atof(optarg); break;
+        case 'a': config |= CFG_ADPCM_MK; break;
+        case 'p': ppm = atof(optarg); break;
+        case 'j': jitter = atof(optarg); break;
+        case 'l': loss = atof(optarg); break;
+        case 'b': burst = atoi(optarg); break;
+        case 's': seed = atoi(optarg); break;
+        case 'c': loop = atoi(optarg); break;
+        case 'o': csv = optarg; break;
+        case 'i': interval = atoi(optarg); break;
+        default: usage();
+        }
+    }
+    if (!burst || !loop || !interval)
+        usage();
+
+    srand(seed);
+    if (trace)
+        frames = read_trace(trace, &count);
+    else
+        frames = generate(duration, rate, ppm, jitter, loss, burst, config,
+                          &count);
+    if (!count)
+    {
+        fprintf(stderr, "No frames to replay.\n");
+        return 1;
+    }
+    end = frames[count - 1].at + 1000 * SIM_CYCLES_PER_US;
+    stream_ms = frames[count - 1].at / (1000 * SIM_CYCLES_PER_US);
+    fill_ms = malloc(stream_ms + 1);
+    ocr_ms = malloc(stream_ms + 1);
+
+    if (csv)
+    {
+        log = fopen(csv, "w");
+        if (!log)
+        {
+            perror(csv);
+            return 1;
+        }
+        fprintf(log, "time_ms,fifo,ocr0a,underruns,overruns\n");
+    }
+
+    sim_flash_init();
+    sim_init();
+    sim_rf_load(frames, count);
+
+    while (sim_cycles < end)
+    {
+        sim_main_loop(loop);
+        if (sim_rf_done())
+            sim_stats.streaming = false;
+        if (ms < stream_ms && sim_cycles >= next_ms)
+        {
+            fill_ms[ms] = AudioFifoLength();
+            ocr_ms[ms++] = OCR0A;
+            next_ms += 1000 * SIM_CYCLES_PER_US;
+        }
+        if (log && sim_cycles >= next_log)
+        {
+            fprintf(log, "%.3f,%u,%u,%u,%u\n",
+                    sim_cycles / (1000.0 * SIM_CYCLES_PER_US),
+                    AudioFifoLength(), OCR0A, sim_stats.underruns,
+                    sim_stats.overruns);
+            next_log += interval * 1000 * SIM_CYCLES_PER_US;
+        }
+    }
+    if (log)
+        fclose(log);
+
+    double n = sim_stats.spk_ticks ? sim_stats.spk_ticks : 1;
+    double mean = sim_stats.fill_sum / n;
+    double var = sim_stats.fill_sq_sum / n - mean * mean;
+
+    printf("frames:           %u\n", sim_stats.frames);
+    printf("frames lost:      %u\n", sim_stats.frames_lost);
+    printf("audio frames:     %u\n", sim_stats.audio_frames);
+    printf("speaker samples:  %u\n", sim_stats.spk_ticks);
+    printf("underruns:        %u samples in %u events\n",
+           sim_stats.underruns, sim_stats.underrun_events);
+    printf("overruns:         %u samples\n", sim_stats.overruns);
+    printf("fifo fill:        min %u, max %u, mean %.1f, stddev %.1f\n",
+           sim_stats.fill_min, sim_stats.fill_max, mean,
+           sqrt(var > 0 ? var : 0));
+    printf("OCR0A:            min %u, max %u, final %u, %u changes\n",
+           sim_stats.ocr_min, sim_stats.ocr_max, OCR0A,
+           sim_stats.ocr_changes);
+    convergence(fill_ms, ocr_ms, ms);
+    free(fill_ms);
+    free(ocr_ms);
+    free(frames);
+    return 0;
+}
@@ -0,0 +1,666 @@
+/*
+ * TUXAUDIO - Firmware for the 'audio' CPU of tuxdroid
+ * Copyright (C) 2007 C2ME S.A. <tuxdroid@c2me.be>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* $Id$ */
+
+#include <string.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#include "sim.h"
+#include "../common/defines.h"
+#include "../hardware.h"
+#include "../init.h"
+#include "../varis.h"
+#include "../i2c.h"
+#include "../misc.h"
+#include "../flash.h"
+#include "../AT26F004.h"
+#include "../compact.h"
+#include "../checksum.h"
+#include "../communication.h"
+#include "../audio_fifo.h"
+#include "../micro_fifo.h"
+
+/*
+ * Registers
+ */
+static volatile uint8_t portb;
+volatile uint8_t PORTC, PORTD;
+volatile uint8_t DDRB, DDRC, DDRD;
+volatile uint8_t PINB, PINC, PIND;
+volatile uint8_t SREG, CLKPR, PRR;
+volatile uint8_t GPIOR0;
+volatile uint8_t TCCR0A, TCCR0B, OCR0A, OCR0B, TIMSK0, TIFR0;
+volatile uint8_t TCCR2A, TCCR2B, TIMSK2, TIFR2;
+volatile uint8_t SPCR, SPSR, SPDR;
+volatile uint8_t ADCH, ADCL, ADCSRA, ADMUX;
+volatile uint8_t EICRA, EIMSK, EIFR;
+volatile uint8_t PCICR, PCIFR, PCMSK1;
+volatile uint8_t TWCR;
+
+/** Set each time PORTB is seen with the flash deselected. Cleared by the
+ * flash model when it starts a new transaction. */
+bool sim_flash_cs_released;
+uint32_t sim_eeprom_writes;
+
+/*
+ * Each access to PORTB goes through here so the value left by the previous
+ * write can be checked before the firmware reads or modifies it. That's
+ * enough to catch every flash chip select release.
+ */
+volatile uint8_t *sim_portb(void)
+{
+    if (portb & FLASH_CS_PIN)
+        sim_flash_cs_released = true;
+    return &portb;
+}
+
+/*
+ * Interrupt vectors and firmware entry points that are not exported by a
+ * header.
+ */
+void TIMER0_OVF_vect(void);
+void __vector_audio_sampling(void);
+void INT0_vect(void);
+void INT1_vect(void);
+void SPI_STC_vect(void);
+void TIMER2_OVF_vect(void);
+void config_init(void);
+
+uint64_t sim_cycles;
+struct sim_stats sim_stats;
+void (*sim_rf_cmd)(uint8_t const *cmd);
+bool (*sim_rf_fill)(uint8_t *frame);
+void (*sim_rf_out)(uint8_t const *frame);
+bool sim_rf_pack;
+bool sim_rf_window;
+uint8_t sim_rf_delay = 1;
+void (*sim_core_cmd)(uint8_t const *cmd);
+bool (*sim_core_status)(uint8_t *cmd);
+
+static uint64_t next_overflow;
+static uint8_t last_ocr;
+
+/* Timer 2 overflow, clocked at F_CPU / 1024 */
+#define TIMER2_CYCLES (256UL * 1024)
+static uint64_t next_tick;
+
+/* Byte exchanged with the flash under the SPI interrupt */
+static bool spi_running;
+static uint64_t spi_next;
+
+/* RF frames */
+static struct sim_frame const *rf_frames;
+static uint32_t rf_count, rf_next;
+static uint8_t rf_in[SPI_SIZE], rf_out[SPI_SIZE];
+static uint8_t rf_byte;
+static uint64_t rf_next_byte;
+static uint8_t rf_sample;
+/* Set from TXE until the last byte of the frame has been exchanged. */
+static bool rf_busy;
+/* Set when a complete frame has been clocked in and not processed yet. */
+static bool rf_pending;
+static uint8_t rf_pending_config;
+/* Ack bit sent back for the commands received from tuxaudio. */
+static bool rf_cmd_ack;
+/* Frames received from tuxaudio, taken by the dongle sim_rf_delay frames
+ * later, and the next one to take. */
+static uint8_t rf_seen[SIM_RF_DELAY_MAX][SPI_SIZE];
+static bool rf_seen_ok[SIM_RF_DELAY_MAX];
+static uint32_t rf_seen_next;
+/* Commands queued by the dongle, the group being sent and its data bit. */
+static uint8_t rf_queue[SIM_RF_QUEUE][CMD_SIZE];
+static uint32_t rf_queue_in, rf_queue_out;
+static uint8_t rf_group;
+static bool rf_cmd_data;
+/* Window of commands: the next one expected from tuxaudio, the number of the
+ * oldest one not acked, the ones sent from it and the next one to send. */
+static uint8_t rf_win_in, rf_win_base, rf_win_sent, rf_win_pos;
+
+/* I2C bus busy until then, and the receive callback of the firmware. */
+static uint64_t i2c_busy_until;
+static void (*i2c_rx)(struct i2c_msg *msg);
+
+/*
+ * I2C driver stubs. Every transfer is acked and keeps the bus busy for
+ * SIM_I2C_CMD_CYCLES. The commands are given to sim_core_cmd and
+ * sim_core_status stands in for tuxcore, nothing is received without it.
+ */
+void i2c_init(void)
+{
+}
+
+int8_t i2c_send_bytes(struct i2c_msg *msg)
+{
+    msg->state = I2C_ACK;
+    i2c_busy_until = sim_cycles + SIM_I2C_CMD_CYCLES;
+    if (sim_core_cmd)
+        sim_core_cmd(msg->buf);
+    return 0;
+}
+
+uint8_t i2c_read_bytes(struct i2c_msg *msg)
+{
+    msg->state = I2C_ACK;
+    if (!sim_core_status)
+        return 0;
+    i2c_busy_until = sim_cycles + SIM_I2C_CMD_CYCLES;
+    if (!sim_core_status(msg->buf))
+        msg->buf[0] = 0;
+    /* The command is only parsed once the bus is free again. */
+    if (i2c_rx)
+        i2c_rx(msg);
+    return 0;
+}
+
+enum i2c_state i2c_get_status(void)
+{
+    return (sim_cycles < i2c_busy_until) ? I2C_BUSY : I2C_IDLE;
+}
+
+void i2c_master_receive_handler(void (*i2cMasterRx_func) (struct i2c_msg *msg))
+{
+    i2c_rx = i2cMasterRx_func;
+}
+
+/*
+ * The version information comes from generated sources which are not built
+ * on the host.
+ */
+void send_info(void)
+{
+}
+
+/**
+ * \brief Reset the simulated CPU and initialize the firmware the same way
+ * main() does.
+ */
+void sim_init(void)
+{
+    memset(&sim_stats, 0, sizeof sim_stats);
+    sim_stats.fill_min = 0xFF;
+    sim_stats.ocr_min = 0xFF;
+    sim_cycles = 0;
+    portb = 0;
+    /* The RF is online. */
+    PINB = RF_ONLINE_MK;
+
+    init_avr();
+    AudioFifoClear();
+    MicroFifoClear();
+    config_init();
+#if (OPT_FLASH_DETECT)
+    flash_detect();
+#endif
+    communication_init();
+    EIMSK = (_BV(INT1) | _BV(INT0));
+    sei();
+
+    last_ocr = OCR0A;
+    next_overflow = OCR0A + 1;
+    next_tick = TIMER2_CYCLES;
+    rf_frames = NULL;
+    rf_count = rf_next = 0;
+    rf_pending = false;
+    rf_busy = false;
+    rf_cmd_ack = false;
+    memset(rf_seen_ok, 0, sizeof rf_seen_ok);
+    rf_seen_next = 0;
+    rf_queue_in = rf_queue_out = 0;
+    rf_group = 0;
+    rf_cmd_data = false;
+    sim_rf_window = false;
+    i2c_busy_until = 0;
+    spi_running = false;
+}
+
+/**
+ * \brief Set the list of RF frames to send, sorted by time.
+ */
+void sim_rf_load(struct sim_frame const *frames, uint32_t count)
+{
+    rf_frames = frames;
+    rf_count = count;
+    rf_next = 0;
+}
+
+/**
+ * \brief Return true when all RF frames have been processed.
+ */
+bool sim_rf_done(void)
+{
+    return rf_next >= rf_count && !rf_busy && !rf_pending;
+}
+
+/*
+ * Timer 0 overflow. The real ISR is written in assembly, it toggles bit 0 of
+ * GPIOR0 to divide the 32kHz PWM by 2 and jumps to the sampling vector, so
+ * this is done here.
+ */
+static void timer0_overflow(void)
+{
+    static bool underrun;
+    uint8_t length;
+
+    if (!(TIMSK0 & 0x01))
+        return;
+
+    TIMER0_OVF_vect();
+    GPIOR0 ^= 0x01;
+    if (GPIOR0 & 0x01)
+        return;
+
+    length = AudioFifoLength();
+    if (sim_stats.streaming)
+    {
+        sim_stats.spk_ticks++;
+        sim_stats.fill_sum += length;
+        sim_stats.fill_sq_sum += length * length;
+        if (length < sim_stats.fill_min)
+            sim_stats.fill_min = length;
+        if (length > sim_stats.fill_max)
+            sim_stats.fill_max = length;
+        if (!length)
+        {
+            if (!underrun)
+                sim_stats.underrun_events++;
+            sim_stats.underruns++;
+        }
+    }
+    underrun = !length;
+    __vector_audio_sampling();
+}
+
+/**
+ * \brief Queue a command to send to tuxaudio.
+ * \return False if the queue of the dongle is full.
+ */
+bool sim_rf_send(uint8_t const *cmd)
+{
+    if (rf_queue_in - rf_queue_out == SIM_RF_QUEUE)
+        return false;
+    memcpy(rf_queue[rf_queue_in++ % SIM_RF_QUEUE], cmd, CMD_SIZE);
+    return true;
+}
+
+/**
+ * \brief Return the number of commands the dongle has still to send or to
+ * get acked.
+ */
+uint32_t sim_rf_queued(void)
+{
+    return rf_queue_in - rf_queue_out;
+}
+
+/*
+ * The dongle takes the ack of its commands and the commands of a frame of
+ * tuxaudio numbered in the window.
+ */
+static void rf_take_window(uint8_t const *frame)
+{
+    uint8_t idx = frame[SPI_IDX_OFFSET];
+    uint8_t acked = (idx - rf_win_base) & CMD_SEQ_MK;
+    uint8_t count = 1;
+    uint8_t i;
+
+    if (acked <= rf_win_sent)
+    {
+        rf_queue_out += acked;
+        rf_win_base = idx & CMD_SEQ_MK;
+        rf_win_sent -= acked;
+        rf_win_pos = (rf_win_pos > acked) ? rf_win_pos - acked : 0;
+    }
+    if (!(frame[SPI_CONFIG_OFFSET] & CFG_DATA_MK))
+        return;
+    if (sim_rf_pack && frame[CMD_PACK_OUT_OFFSET] <= CMD_PACK_OUT_MAX)
+        count += frame[CMD_PACK_OUT_OFFSET];
+    for (i = (rf_win_in - (idx >> CMD_SEQ_SHIFT)) & CMD_SEQ_MK; i < count;
+         i++)
+    {
+        if (sim_rf_cmd)
+            sim_rf_cmd(i ? &frame[CMD_PACK_OUT_OFFSET + 1 +
+                                  (i - 1) * CMD_SIZE] :
+                       &frame[SPI_DATA_OFFSET]);
+        rf_win_in = (rf_win_in + 1) & CMD_SEQ_MK;
+    }
+}
+
+/*
+ * The dongle takes the ack of its own commands and the commands of a frame
+ * of tuxaudio.
+ */
+static void rf_take(uint8_t const *frame)
+{
+    uint8_t config = frame[SPI_CONFIG_OFFSET];
+    uint8_t i;
+
+    if (sim_rf_window)
+    {
+        rf_take_window(frame);
+        return;
+    }
+    if (rf_group && !(config & CFG_ACK_MK) == !rf_cmd_data)
+    {
+        /* tuxaudio switched to the window with the frame which acks it,
+         * tell it the frames of the dongle did as well. */
+        if (rf_queue[rf_queue_out % SIM_RF_QUEUE][0] == WINDOWED_CMDS_CMD)
+        {
+            sim_rf_window = true;
+            rf_cmd_ack = !rf_cmd_ack;
+            rf_win_in = rf_win_base = rf_win_sent = rf_win_pos = 0;
+        }
+        rf_queue_out += rf_group;
+        rf_group = 0;
+        if (sim_rf_window)
+        {
+            rf_take_window(frame);
+            return;
+        }
+    }
+    /* A new group of commands is flagged by toggling the data bit, it's
+     * acked by the next frame. */
+    if (!(config & CFG_DATA_MK) != !rf_cmd_ack)
+    {
+        rf_cmd_ack = !rf_cmd_ack;
+        if (sim_rf_cmd)
+        {
+            sim_rf_cmd(&frame[SPI_DATA_OFFSET]);
+            for (i = 0; sim_rf_pack && i < frame[CMD_PACK_OUT_OFFSET] &&
+                     i < CMD_PACK_OUT_MAX; i++)
+                sim_rf_cmd(&frame[CMD_PACK_OUT_OFFSET + 1 + i * CMD_SIZE]);
+        }
+    }
+}
+
+/*
+ * The dongle puts its next group of commands in a frame, several commands
+ * are only flagged in frames without audio.
+ */
+static void rf_give(uint8_t *frame)
+{
+    bool audio = frame[SPI_CONFIG_OFFSET] & (CFG_AUDIO_MK | CFG_BULK_MK);
+    uint8_t i;
+
+    if (sim_rf_window)
+    {
+        uint32_t count = rf_queue_in - rf_queue_out;
+        uint8_t max = (sim_rf_pack && !audio) ? 1 + CMD_PACK_IN_MAX : 1;
+
+        /* New commands first, then the ones not acked from the oldest. */
+        if (count > CMD_WINDOW)
+            count = CMD_WINDOW;
+        if (rf_win_pos >= count)
+            rf_win_pos = 0;
+        count -= rf_win_pos;
+        if (count > max)
+            count = max;
+        frame[SPI_IDX_OFFSET] =
+            (((rf_win_base + rf_win_pos) & CMD_SEQ_MK) << CMD_SEQ_SHIFT) |
+            rf_win_in;
+        if (!count)
+            return;
+        frame[SPI_CONFIG_OFFSET] |= CFG_DATA_MK;
+        for (i = 0; i < count; i++)
+            memcpy(i ? &frame[CMD_PACK_IN_OFFSET + 1 + (i - 1) * CMD_SIZE] :
+                   &frame[SPI_DATA_OFFSET],
+                   rf_queue[(rf_queue_out + rf_win_pos + i) % SIM_RF_QUEUE],
+                   CMD_SIZE);
+        if (max > 1)
+            frame[CMD_PACK_IN_OFFSET] = count - 1;
+        rf_win_pos += count;
+        if (rf_win_pos > rf_win_sent)
+            rf_win_sent = rf_win_pos;
+        return;
+    }
+    if (!rf_group && rf_queue_in != rf_queue_out)
+    {
+        rf_group = 1;
+        if (sim_rf_pack && !audio)
+            while (rf_group < 1 + CMD_PACK_IN_MAX &&
+                   rf_queue_out + rf_group != rf_queue_in)
+                rf_group++;
+        rf_cmd_data = !rf_cmd_data;
+    }
+    if (!rf_group || (rf_group > 1 && audio))
+    {
+        /* Nothing new, the data bit of the previous group. */
+        if (rf_group ? !rf_cmd_data : rf_cmd_data)
+            frame[SPI_CONFIG_OFFSET] |= CFG_DATA_MK;
+        return;
+    }
+    if (rf_cmd_data)
+        frame[SPI_CONFIG_OFFSET] |= CFG_DATA_MK;
+    memcpy(&frame[SPI_DATA_OFFSET], rf_queue[rf_queue_out % SIM_RF_QUEUE],
+           CMD_SIZE);
+    if (sim_rf_pack && !audio)
+    {
+        frame[CMD_PACK_IN_OFFSET] = rf_group - 1;
+        for (i = 1; i < rf_group; i++)
+            memcpy(&frame[CMD_PACK_IN_OFFSET + 1 + (i - 1) * CMD_SIZE],
+                   rf_queue[(rf_queue_out + i) % SIM_RF_QUEUE], CMD_SIZE);
+    }
+}
+
+/*
+ * TXE from the RF, a new frame is ready to be exchanged.
+ */
+static void rf_txe_event(void)
+{
+    struct sim_frame const *frame = &rf_frames[rf_next++];
+    uint8_t i;
+
+    /* Frames of tuxaudio the dongle has got by now. */
+    while (rf_seen_next + sim_rf_delay < rf_next)
+    {
+        if (rf_seen_ok[rf_seen_next % SIM_RF_DELAY_MAX])
+            rf_take(rf_seen[rf_seen_next % SIM_RF_DELAY_MAX]);
+        rf_seen_ok[rf_seen_next % SIM_RF_DELAY_MAX] = false;
+        rf_seen_next++;
+    }
+
+    memset(rf_in, 0, sizeof rf_in);
+    rf_in[SPI_IDX_OFFSET] = (uint8_t)rf_next;
+    /* The RF checked the CRC of the radio frame. */
+    rf_in[SPI_CONFIG_OFFSET] = frame->config | CFG_CRCOK_MK;
+    if (rf_cmd_ack)
+        rf_in[SPI_CONFIG_OFFSET] |= CFG_ACK_MK;
+    if (frame->config & CFG_ADPCM_MK)
+    {
+        /* Alternate steps up and down around the mid level. */
+        rf_in[SPI_AUDIO_OFFSET] = 0x80;
+        for (i = AUDIO_ADPCM_HDR_SIZE; i < AUDIO_SPK_SIZE; i++)
+            rf_in[SPI_AUDIO_OFFSET + i] = 0x84;
+    }
+    else if (frame->config & CFG_AUDIO_MK)
+        for (i = 0; i < AUDIO_SPK_SIZE; i++)
+            rf_in[SPI_AUDIO_OFFSET + i] = rf_sample++;
+    rf_give(rf_in);
+    if (sim_rf_fill && !sim_rf_fill(rf_in))
+        return;
+    rf_byte = 0;
+    rf_busy = true;
+    /* The firmware restarts the SPI exchange before looking at the previous
+     * frame if it didn't have time to process it. */
+    if (rf_pending)
+        sim_stats.frames_lost++;
+    rf_pending = false;
+    INT1_vect();
+}
+
+/*
+ * SPIACK from the RF, the next byte of the frame has been exchanged.
+ */
+static void rf_ack_event(void)
+{
+    rf_out[rf_byte] = SPDR;
+    SPDR = rf_in[rf_byte];
+    SPSR |= 0x80;
+    INT0_vect();
+    if (++rf_byte == SPI_SIZE)
+    {
+        rf_busy = false;
+        rf_pending = true;
+        rf_pending_config = rf_in[SPI_CONFIG_OFFSET];
+        sim_stats.frames++;
+        if (sim_rf_out)
+            sim_rf_out(rf_out);
+        memcpy(rf_seen[(rf_next - 1) % SIM_RF_DELAY_MAX], rf_out, SPI_SIZE);
+        rf_seen_ok[(rf_next - 1) % SIM_RF_DELAY_MAX] = true;
+    }
+}
+
+/**
+ * \brief Let the CPU run for a given number of cycles, firing the interrupts
+ * which are due in that time.
+ */
+void sim_advance(uint32_t cycles)
+{
+    uint64_t end = sim_cycles + cycles;
+
+    while (1)
+    {
+        uint64_t next = end;
+        /* The RF acks a byte once it has been clocked by the SPI master,
+         * which only happens while the RF is selected. */
+        bool rf_ack = rf_busy && !(PORTB & RF_CS_MK);
+        /* The dongle waits for the current exchange before sending the next
+         * frame. */
+        bool rf_due = !rf_busy && rf_next < rf_count;
+
+        /* A byte is clocked each time the SPI interrupt is enabled. */
+        if (!(SPCR & _BV(SPIE)))
+            spi_running = false;
+        else if (!spi_running)
+        {
+            spi_running = true;
+            spi_next = sim_cycles + SIM_SPI_BYTE_CYCLES;
+        }
+
+        if (next_overflow < next)
+            next = next_overflow;
+        if (next_tick < next)
+            next = next_tick;
+        if (rf_due && rf_frames[rf_next].at < next)
+            next = rf_frames[rf_next].at;
+        if (rf_ack && rf_next_byte < next)
+            next = rf_next_byte;
+        if (spi_running && spi_next < next)
+            next = spi_next;
+        if (next > sim_cycles)
+            sim_cycles = next;
+
+        if (sim_cycles >= next_overflow)
+        {
+            timer0_overflow();
+            /* Fast PWM with TOP = OCR0A and no prescaler */
+            next_overflow += OCR0A + 1;
+            if (OCR0A != last_ocr)
+            {
+                last_ocr = OCR0A;
+                sim_stats.ocr_changes++;
+            }
+            if (OCR0A < sim_stats.ocr_min)
+                sim_stats.ocr_min = OCR0A;
+            if (OCR0A > sim_stats.ocr_max)
+                sim_stats.ocr_max = OCR0A;
+        }
+        else if (sim_cycles >= next_tick)
+        {
+            if (TIMSK2 & _BV(TOIE2))
+                TIMER2_OVF_vect();
+            next_tick += TIMER2_CYCLES;
+        }
+        else if (rf_due && sim_cycles >= rf_frames[rf_next].at)
+        {
+            rf_txe_event();
+            rf_next_byte = sim_cycles + SIM_RF_BYTE_CYCLES;
+        }
+        else if (rf_ack && sim_cycles >= rf_next_byte)
+        {
+            rf_ack_event();
+            rf_next_byte = sim_cycles + SIM_RF_BYTE_CYCLES;
+        }
+        else if (spi_running && sim_cycles >= spi_next)
+        {
+            SPDR = sim_flash_xfer(SPDR);
+            spi_running = false;
+            SPI_STC_vect();
+        }
+        else if (sim_cycles >= end)
+            break;
+    }
+}
+
+/**
+ * \brief Run one iteration of the tuxaudio main loop followed by a given
+ * number of cycles to account for the time the loop takes.
+ *
+ * Only the audio, flash and RF tasks are run, the sensors and sleep handling
+ * of main() are left out.
+ */
+void sim_main_loop(uint32_t cycles)
+{
+    uint8_t in_idx = AudioInIdx;
+    uint8_t samples = 0;
+
+    if (!rf_txe)
+    {
+        if (programmingFlash)
+            programming();
+        if (flashPlay)
+            playSound();
+        if (eraseFlag)
+            erase();
+#if (OPT_FLASH_IMAGE)
+        if (imageFlag)
+            image();
+#endif
+        if (compactFlag)
+            compact();
+#if (OPT_FLASH_CRC)
+        if (checksumFlag)
+            checksum();
+#endif
+    }
+
+    if (rf_pending)
+    {
+        if (rf_pending_config & CFG_AUDIO_MK)
+            samples = (rf_pending_config & CFG_ADPCM_MK) ?
+                AUDIO_SPK_ADPCM_SAMPLES : AUDIO_SPK_SIZE;
+        in_idx = AudioInIdx;
+    }
+    communication_task();
+    /* The frame has been processed when rf_txe is released. */
+    if (rf_pending && !rf_txe)
+    {
+        rf_pending = false;
+        if (samples)
+        {
+            uint8_t stored = AudioInIdx - in_idx;
+
+            sim_stats.audio_frames++;
+            sim_stats.streaming = true;
+            sim_stats.overruns += samples - stored;
+        }
+    }
+
+    sim_advance(cycles);
+}
@@ -0,0 +1,168 @@
+/*
+ * TUXAUDIO - Firmware for the 'audio' CPU of tuxdroid
+ * Copyright (C) 2007 C2ME S.A. <tuxdroid@c2me.be>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* $Id$ */
+
+/** \file sim.h
+    \brief Host simulation of the tuxaudio CPU.
+
+    The firmware sources are compiled unmodified for the host against the
+    register stubs of this folder. This module stands in for the hardware
+    around them: it counts CPU cycles, fires timer 0 and the RF interrupts at
+    the right time, clocks the RF SPI frames in and out, and collects the
+    audio statistics.
+
+    The main program of a simulation loads RF frames with sim_rf_load() and
+    then repeatedly calls sim_main_loop() until sim_cycles reaches the end of
+    the run.
+*/
+
+#ifndef _SIM_H_
+#define _SIM_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/** CPU cycles in one microsecond. */
+#define SIM_CYCLES_PER_US   (F_CPU / 1000000UL)
+/** Cycles needed by the RF to clock one byte of the SPI frame. */
+#define SIM_RF_BYTE_CYCLES  64
+/** Cycles taken by spiSend(), 8 bits at 2MHz plus the polling loop. */
+#define SIM_SPI_BYTE_CYCLES 40
+/** Cycles taken by spiSend() with SPI2X set, 8 bits at 4MHz. */
+#define SIM_SPI2X_BYTE_CYCLES 24
+/** Cycles of an I2C message of one command with tuxcore, 5 bytes at
+ * 100kHz. */
+#define SIM_I2C_CMD_CYCLES 3600
+/** Longest delay of the dongle, see sim_rf_delay. */
+#define SIM_RF_DELAY_MAX 32
+/** Commands the dongle can hold, see sim_rf_send(). */
+#define SIM_RF_QUEUE 64
+
+/** RF frame sent by the dongle. */
+struct sim_frame
+{
+    /** Time of the TXE signal, in CPU cycles. */
+    uint64_t at;
+    /** Config byte of the frame, CFG_AUDIO_MK if it carries speaker data. */
+    uint8_t config;
+};
+
+/** Counters collected during a simulation. */
+struct sim_stats
+{
+    /** Set between the first and the last audio frame received. Underruns
+     * are only counted while streaming. */
+    bool streaming;
+    /** RF frames clocked in. */
+    uint32_t frames;
+    /** RF frames overwritten by the next one before being processed. */
+    uint32_t frames_lost;
+    /** RF frames which carried speaker data. */
+    uint32_t audio_frames;
+    /** Speaker samples output by the sampling interrupt while streaming. */
+    uint32_t spk_ticks;
+    /** Speaker samples missed because the fifo was empty. */
+    uint32_t underruns;
+    /** Number of times the fifo ran empty. */
+    uint32_t underrun_events;
+    /** Speaker samples dropped because the fifo was full. */
+    uint32_t overruns;
+    /** Sum and sum of squares of the fifo length, sampled on each speaker
+     * sample, to compute the mean and variance. */
+    uint64_t fill_sum;
+    uint64_t fill_sq_sum;
+    uint8_t fill_min;
+    uint8_t fill_max;
+    /** Range of the timer 0 TOP value and number of updates. */
+    uint8_t ocr_min;
+    uint8_t ocr_max;
+    uint32_t ocr_changes;
+};
+
+/** Counters of the flash model. */
+struct sim_flash_stats
+{
+    /** Bytes exchanged with the flash. */
+    uint32_t bytes;
+    /** Transactions, one per chip select. */
+    uint32_t transactions;
+    /** Bytes programmed and 4kB blocks erased. */
+    uint32_t programmed;
+    uint32_t erased_blocks;
+};
+
+/** Size of the simulated AT26F004. */
+#define SIM_FLASH_SIZE 0x80000UL
+/** Largest part that can be simulated. */
+#define SIM_FLASH_MAX 0x400000UL
+
+/** Serial flash modelled, see sim_flash_set_part(). */
+struct sim_flash_part
+{
+    char const *name;
+    /** JEDEC ID returned by READ_MANUFACT. */
+    uint8_t id[3];
+    uint32_t size;
+    /** Set if the part has the sequential program mode. */
+    bool sequential;
+};
+
+extern uint64_t sim_cycles;
+extern struct sim_stats sim_stats;
+extern uint8_t sim_flash[SIM_FLASH_MAX];
+extern struct sim_flash_part sim_flash_part;
+extern struct sim_flash_stats sim_flash_stats;
+/** Called with each command sent by tuxaudio to the RF, if set. */
+extern void (*sim_rf_cmd)(uint8_t const *cmd);
+/** Called with each frame before it's sent to tuxaudio, if set. It can
+ * change the frame or return false to lose it. */
+extern bool (*sim_rf_fill)(uint8_t *frame);
+/** Called with each frame received from tuxaudio, if set. */
+extern void (*sim_rf_out)(uint8_t const *frame);
+/** Set if the dongle sends and receives groups of commands, see
+ * PACKED_CMDS_CMD. */
+extern bool sim_rf_pack;
+/** Set by the dongle once WINDOWED_CMDS_CMD is acked, it then numbers the
+ * commands. */
+extern bool sim_rf_window;
+/** Frames built by the dongle after a frame of tuxaudio before it takes its
+ * commands and acks, 1 to take them in the next frame. */
+extern uint8_t sim_rf_delay;
+/** Called with each command sent to tuxcore by I2C, if set. */
+extern void (*sim_core_cmd)(uint8_t const *cmd);
+/** Called each time tuxaudio reads a command from tuxcore by I2C, if set.
+ * Returns false if tuxcore has nothing to send. */
+extern bool (*sim_core_status)(uint8_t *cmd);
+extern bool sim_flash_cs_released;
+/** Bytes written to the EEPROM. */
+extern uint32_t sim_eeprom_writes;
+
+void sim_init(void);
+void sim_rf_load(struct sim_frame const *frames, uint32_t count);
+bool sim_rf_done(void);
+bool sim_rf_send(uint8_t const *cmd);
+uint32_t sim_rf_queued(void);
+void sim_advance(uint32_t cycles);
+void sim_main_loop(uint32_t cycles);
+void sim_flash_init(void);
+bool sim_flash_set_part(char const *name);
+uint8_t sim_flash_xfer(uint8_t data);
+
+#endif /* _SIM_H_ */
@@ -0,0 +1,297 @@
+/*
+ * TUXAUDIO - Firmware for the 'audio' CPU of tuxdroid
+ * Copyright (C) 2007 C2ME S.A. <tuxdroid@c2me.be>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* $Id$ */
+
+#include <avr/io.h>
+#include <avr/eeprom.h>
+#include "varis.h"
+#include "hardware.h"
+#include "spi.h"
+#include "AT26F004.h"
+#include "flash.h"
+#include "toc.h"
+#include "communication.h"
+#include "common/api.h"
+
+#if (OPT_TOC_MIRROR)
+/** Number of sounds in the mirror. */
+static uint16_t toc_ee_count EEMEM = TOC_UNKNOWN;
+/** Start address of the first sound then stop address of sounds 1 to
+ * TOC_EE_SOUNDS, as stored in the flash. */
+static uint8_t toc_ee[TOC_EE_SOUNDS + 1][3] EEMEM;
+#endif
+
+/** Entry 0 of an empty flash. */
+static uint8_t const toc_first_entry[3] = {0x00, 0x04, 0x00};
+
+#if (OPT_SOUND_DELETE)
+/** Address of the TOC read from the flash, moved while it's rewritten. */
+static uint32_t toc_base;
+#else
+#define toc_base 0
+#endif
+
+/**
+ * \ingroup toc
+   \brief Select the flash and start reading the TOC at entry n.
+ */
+static void toc_read(uint16_t n)
+{
+    uint32_t address = toc_base + TOC_FIRST + 3 * n;
+
+    flash_select();
+    spiSend(READ_ARRAY_LOW_F);
+    spiSend(address >> 16);
+    spiSend(address >> 8);
+    spiSend(address & 0xFF);
+}
+
+/**
+ * \ingroup toc
+   \brief Return the last 4kB block used by a sound given its stop address.
+ */
+static uint16_t toc_block(uint8_t const *entry)
+{
+    return ((uint16_t)(entry[0] & TOC_ADDR_MK) << 4) + (entry[1] >> 4);
+}
+
+#if (OPT_TOC_MIRROR)
+/**
+ * \ingroup toc
+   \brief Write the entry n to the EEPROM if it changed.
+
+   The mirror is invalidated before the first byte is changed so a reset in
+   the middle of the update triggers a scan.
+ */
+static void toc_store(uint16_t n, uint8_t const *entry)
+{
+    uint8_t i;
+
+    for (i = 0; i < 3; i++)
+    {
+        if (eeprom_read_byte(&toc_ee[n][i]) != entry[i])
+        {
+            if (eeprom_read_word(&toc_ee_count) != TOC_UNKNOWN)
+                eeprom_write_word(&toc_ee_count, TOC_UNKNOWN);
+            eeprom_write_byte(&toc_ee[n][i], entry[i]);
+        }
+    }
+}
+#else
+#define toc_store(n, entry)
+#endif
+
+/**
+ * \ingroup toc
+   \brief Read the whole TOC and update the mirror.
+
+   numSound and last_block are set accordingly. An empty flash (0xFF at the
+   first entry) has no sound.
+
+   The entries which aren't mirrored are followed by erased ones, the last
+   one is found by bisection to keep the scan as short as with an AT26F004.
+   The flash is read with a doubled SPI clock as the RF frames wait for the
+   scan, it's set back to 2MHz before returning.
+ */
+void toc_scan(void)
+{
+    uint8_t entry[3];
+    uint8_t last[3];
+    uint16_t n = 0;
+#if (OPT_FLASH_DETECT)
+    uint16_t hi, mid;
+#endif
+    uint8_t i;
+
+    SPSR |= _BV(SPI2X);
+    toc_read(0);
+    for (i = 0; i < 3; i++)
+        last[i] = spiSend(NOP);
+    if (last[0] == 0xFF)
+    {
+        for (i = 0; i < 3; i++)
+            last[i] = toc_first_entry[i];
+    }
+    else
+    {
+        while (n < TOC_EE_SOUNDS)
+        {
+            for (i = 0; i < 3; i++)
+                entry[i] = spiSend(NOP);
+            if (entry[0] == 0xFF)
+                break;
+            /* Entry 0 moves when the first sound is deleted. */
+            if (n == 0)
+                toc_store(0, last);
+            n++;
+            toc_store(n, entry);
+            for (i = 0; i < 3; i++)
+                last[i] = entry[i];
+        }
+    }
+    flash_unselect();
+
+#if (OPT_FLASH_DETECT)
+    if (n == TOC_EE_SOUNDS)
+    {
+        /* Entry hi is known to be erased, the TOC ends before the first
+         * sound. */
+        hi = TOC_MAX_SOUNDS + 1;
+        while (hi - n > 1)
+        {
+            mid = (n + hi) / 2;
+            toc_read(mid);
+            for (i = 0; i < 3; i++)
+                entry[i] = spiSend(NOP);
+            flash_unselect();
+            if (entry[0] == 0xFF)
+                hi = mid;
+            else
+            {
+                n = mid;
+                for (i = 0; i < 3; i++)
+                    last[i] = entry[i];
+            }
+        }
+    }
+#endif
+    SPSR &= ~_BV(SPI2X);
+
+#if (OPT_TOC_MIRROR)
+    if (eeprom_read_word(&toc_ee_count) != n)
+        eeprom_write_word(&toc_ee_count, n);
+#endif
+    numSound = n;
+    last_block = toc_block(last);
+}
+
+#if (OPT_TOC_MIRROR)
+/**
+ * \ingroup toc
+   \brief Load the TOC from the EEPROM mirror at boot.
+
+   The mirror is used if its last entry matches the flash and is the last one
+   of the flash, otherwise the TOC is scanned. With more sounds than the
+   mirror holds, the count is checked against the last entry of the flash.
+ */
+void toc_load(void)
+{
+    uint16_t n = eeprom_read_word(&toc_ee_count);
+    uint16_t m = n;
+    uint8_t flash[4];
+    uint8_t entry[3];
+    uint8_t i;
+
+    if (n <= TOC_MAX_SOUNDS)
+    {
+        if (m > TOC_EE_SOUNDS)
+            m = TOC_EE_SOUNDS;
+        toc_read(m);
+        for (i = 0; i < 4; i++)
+            flash[i] = spiSend(NOP);
+        flash_unselect();
+
+        eeprom_read_block(entry, &toc_ee[m], 3);
+        if ((flash[0] == entry[0]) && (flash[1] == entry[1]) &&
+            (flash[2] == entry[2]) && (m < n || flash[3] == 0xFF ||
+                                       n == TOC_MAX_SOUNDS))
+        {
+            if (m < n)
+            {
+                toc_read(n);
+                for (i = 0; i < 4; i++)
+                    flash[i] = spiSend(NOP);
+                flash_unselect();
+                for (i = 0; i < 3; i++)
+                    entry[i] = flash[i];
+            }
+            if ((entry[0] != 0xFF) &&
+                ((flash[3] == 0xFF) || (n == TOC_MAX_SOUNDS)))
+            {
+                numSound = n;
+                last_block = toc_block(entry);
+                return;
+            }
+        }
+    }
+    toc_scan();
+}
+#endif
+
+/**
+ * \ingroup toc
+   \brief Copy the entry n of the TOC, the stop address of sound n or the
+   start address of the first sound if n is null.
+
+   The first sound starts at 0x000400 unless it has been deleted, the next
+   one then starts at its 4kB block.
+
+   n shouldn't be higher than numSound. The entries which aren't mirrored are
+   read from the flash, which shouldn't be selected nor programmed
+   sequentially.
+ */
+void toc_entry(uint16_t n, uint8_t *entry)
+{
+    uint8_t i;
+
+    if (n == 0 && numSound == 0)
+        for (i = 0; i < 3; i++)
+            entry[i] = toc_first_entry[i];
+#if (OPT_TOC_MIRROR)
+    else if (!OPT_FLASH_DETECT || n <= TOC_EE_SOUNDS)
+        eeprom_read_block(entry, &toc_ee[n], 3);
+#endif
+    else
+    {
+        /* An erase may be running. */
+        wait_ready();
+        toc_read(n);
+        for (i = 0; i < 3; i++)
+            entry[i] = spiSend(NOP);
+        flash_unselect();
+    }
+}
+
+#if (OPT_SOUND_DELETE)
+/**
+ * \ingroup toc
+   \brief Read the entries which aren't mirrored from a copy of block 0.
+
+   compact() saves the TOC before erasing block 0. The address is set back to
+   0 once the TOC is written again.
+ */
+void toc_move(uint32_t base)
+{
+    toc_base = base;
+}
+#endif
+
+/**
+ * \ingroup toc
+   \brief Send the number of sounds and the last block with SOUND_VAR_CMD.
+
+   The third parameter holds bits 8 and 9 of the number of sounds in its low
+   nibble and of the last block in its high nibble.
+ */
+void toc_send(void)
+{
+    queue_rf_cmd_p(SOUND_VAR_CMD, numSound, last_block,
+                   (numSound >> 8) | ((last_block >> 8) << 4));
+}
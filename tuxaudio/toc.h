@@ -0,0 +1,93 @@
+/*
+ * TUXAUDIO - Firmware for the 'audio' CPU of tuxdroid
+ * Copyright (C) 2007 C2ME S.A. <tuxdroid@c2me.be>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* $Id$ */
+
+/** \defgroup toc Table of contents of the flash
+    \ingroup toc
+
+    Index of the sounds stored in the flash, mirrored in the EEPROM.
+
+    The TOC at the beginning of the flash is read sequentially in a single
+    transaction at boot and after each store or erase, and the stop address of
+    every sound is copied to the EEPROM with the number of sounds. Only the
+    bytes that changed are written.
+
+    On the next boot, the last entry of the mirror and the first byte of the
+    following one are checked against the flash in one transaction. If they
+    match, the scan is skipped. Playing a sound then only needs the
+    transaction that reads its samples.
+
+    The first sound starts at 0x000400, after the TOC, unless it has been
+    deleted. Entry 0 then holds the start of the next sound, on a 4kB block.
+
+    The ATmega88 doesn't have enough RAM to hold the index, only the number of
+    sounds and the last block are kept there in numSound and last_block.
+
+    The EEPROM only holds the entries of the first TOC_EE_SOUNDS sounds. A
+    larger flash can hold more sounds, up to the end of the TOC at 0x000400;
+    their entries are read from the flash when needed. The mirror is then
+    checked at boot against its last entry, then the last entry of the flash
+    is checked. Only with OPT_FLASH_DETECT, see features.h.
+
+    The mirror is only built with OPT_TOC_MIRROR. The TOC is otherwise
+    scanned at boot and every entry is read from the flash.
+*/
+
+/** \file toc.h
+    \ingroup toc
+*/
+/** \file toc.c
+    \ingroup toc
+*/
+
+#ifndef TOC_H
+#define TOC_H
+
+#include <stdint.h>
+#include "features.h"
+
+/** Address of the first entry in the flash, the first byte holds 0xFE. */
+#define TOC_FIRST       0x01
+/** End of the TOC, where the first sound starts in an empty flash. */
+#define TOC_END         0x400
+/** Sounds mirrored in the EEPROM, as many as an AT26F004 can hold. */
+#define TOC_EE_SOUNDS   128
+#if (OPT_FLASH_DETECT)
+/** Entries fitting before the first sound, entry 0 included. */
+#define TOC_MAX_SOUNDS  ((TOC_END - TOC_FIRST) / 3 - 1)
+#else
+/** Each sound starts on a 4kB block of the AT26F004. */
+#define TOC_MAX_SOUNDS  TOC_EE_SOUNDS
+#endif
+/** Sound count of the mirror when it has to be rebuilt. */
+#define TOC_UNKNOWN     0xFFFF
+
+#if (OPT_TOC_MIRROR)
+extern void toc_load(void);
+#else
+/* The TOC is scanned at boot. */
+#define toc_load() toc_scan()
+#endif
+extern void toc_scan(void);
+extern void toc_entry(uint16_t n, uint8_t *entry);
+extern void toc_move(uint32_t base);
+extern void toc_send(void);
+
+#endif /* TOC_H */
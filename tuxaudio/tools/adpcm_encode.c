@@ -0,0 +1,65 @@
+/*
+ * TUXAUDIO - Firmware for the 'audio' CPU of tuxdroid
+ * Copyright (C) 2007 C2ME S.A. <tuxdroid@c2me.be>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* $Id$ */
+
+/** \file adpcm_encode.c
+    \brief IMA-ADPCM encoder for the sounds of the flash.
+
+    Encodes a sound file (see wav.c) to the headerless 4-bit format decoded
+    by adpcm.c, see encode.c.
+
+    The output can be streamed to tux after a STORE_SOUND_CMD with the codec
+    parameter set to ADPCM.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "wav.h"
+#include "encode.h"
+
+int main(int argc, char *argv[])
+{
+    uint8_t *samples, *data;
+    size_t count, size;
+    FILE *out;
+
+    if (argc != 3)
+    {
+        fprintf(stderr, "usage: adpcm_encode INPUT OUTPUT\n");
+        return 1;
+    }
+    samples = wav_load(argv[1], &count);
+    if (!samples)
+        return 1;
+    out = fopen(argv[2], "wb");
+    if (!out)
+    {
+        perror(argv[2]);
+        return 1;
+    }
+
+    data = adpcm_encode_sound(samples, count, &size);
+    fwrite(data, 1, size, out);
+    fclose(out);
+    free(data);
+    free(samples);
+    return 0;
+}
@@ -0,0 +1,205 @@
+/*
+ * TUXAUDIO - Firmware for the 'audio' CPU of tuxdroid
+ * Copyright (C) 2007 C2ME S.A. <tuxdroid@c2me.be>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* $Id$ */
+
+/** \file bank_sync.c
+    \brief Finds the blocks of a flash image which differ from the flash.
+
+    The image built by tools/flash_image is split in the block 0, which holds
+    the TOC, and the blocks of each sound, by up to 64 blocks. Without CRCS,
+    the CRC_RANGE_CMD to send for each part is printed with the CRC-32 of the
+    part in the image, and the CRC_SOUND_CMD of each sound with its CRC.
+
+    CRCS is a text file with the CRCs returned by STATUS_FLASH_CRC_CMD for
+    those CRC_RANGE_CMD, in the same order, one per line in hexadecimal or
+    "none" for CRC_NONE. The blocks of the parts which differ are printed;
+    only those have to be written with WRITE_BLOCK_CMD, block 0 last so the
+    TOC is read again once the sounds are there.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../AT26F004.h"
+#include "../flash.h"
+#include "../toc.h"
+
+/** Blocks sent in a CRC_RANGE_CMD. */
+#define RANGE_BLOCKS 64
+
+static uint8_t flash[IMAGE_BLOCKS * IMAGE_BLOCK_SIZE];
+
+/** Parts of the image compared with the flash. */
+static struct part
+{
+    /** Sound of the blocks, 0 for the TOC. */
+    unsigned sound;
+    unsigned first, count;
+    uint32_t crc;
+} parts[2 * TOC_MAX_SOUNDS];
+
+/*
+ * CRC-32 of zlib, as computed by checksum() in the firmware.
+ */
+static uint32_t crc32(uint8_t const *p, uint32_t len)
+{
+    uint32_t crc = 0xFFFFFFFF;
+    int bit;
+
+    while (len--)
+    {
+        crc ^= *p++;
+        for (bit = 0; bit < 8; bit++)
+            crc = (crc >> 1) ^ ((crc & 1) ? 0xEDB88320 : 0);
+    }
+    return ~crc;
+}
+
+/*
+ * Address of a TOC entry, without the codec flags.
+ */
+static uint32_t toc_address(unsigned n)
+{
+    uint8_t const *entry = flash + TOC_FIRST + 3 * n;
+
+    return ((uint32_t)(entry[0] & TOC_ADDR_MK) << 16) | entry[1] << 8 |
+        entry[2];
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned sounds, count = 0, blocks, written = 0, toc = 0, n, i;
+    uint32_t size, start, end;
+    FILE *f;
+
+    if (argc < 2 || argc > 3)
+    {
+        fprintf(stderr, "usage: bank_sync IMAGE [CRCS]\n");
+        return 1;
+    }
+    f = fopen(argv[1], "rb");
+    if (!f)
+    {
+        perror(argv[1]);
+        return 1;
+    }
+    size = fread(flash, 1, sizeof(flash), f);
+    fclose(f);
+    if (size < TOC_END || flash[0] != 0xFE)
+    {
+        fprintf(stderr, "%s: not a flash image\n", argv[1]);
+        return 1;
+    }
+    memset(flash + size, 0xFF, sizeof(flash) - size);
+    blocks = (size + IMAGE_BLOCK_SIZE - 1) / IMAGE_BLOCK_SIZE;
+
+    /* The TOC ends with an erased entry. */
+    for (sounds = 0; sounds < TOC_MAX_SOUNDS; sounds++)
+        if (flash[TOC_FIRST + 3 * (sounds + 1)] == 0xFF)
+            break;
+
+    parts[count].sound = 0;
+    parts[count].first = 0;
+    parts[count++].count = 1;
+    for (n = 1; n <= sounds; n++)
+    {
+        /* The start of the first sound is compared with the TOC. */
+        start = (n == 1) ? IMAGE_BLOCK_SIZE : ((toc_address(n - 1) >> 12) + 1)
+            << 12;
+        end = toc_address(n);
+        if (end > size)
+        {
+            fprintf(stderr, "%s: sound %u ends after the image\n", argv[1],
+                    n);
+            return 1;
+        }
+        for (; start < end; start += RANGE_BLOCKS * IMAGE_BLOCK_SIZE)
+        {
+            parts[count].sound = n;
+            parts[count].first = start >> 12;
+            parts[count++].count = (end - start > RANGE_BLOCKS *
+                                    IMAGE_BLOCK_SIZE) ? RANGE_BLOCKS :
+                ((end - start - 1) >> 12) + 1;
+        }
+    }
+    for (i = 0; i < count; i++)
+        parts[i].crc = crc32(flash + parts[i].first * IMAGE_BLOCK_SIZE,
+                             parts[i].count * IMAGE_BLOCK_SIZE);
+
+    if (argc == 2)
+    {
+        for (i = 0; i < count; i++)
+        {
+            if (parts[i].sound)
+                printf("sound %3u: ", parts[i].sound);
+            else
+                printf("toc:       ");
+            printf("blocks %3u-%3u, CRC_RANGE_CMD 0x%02x 0x%02x, "
+                   "crc 0x%08x\n", parts[i].first,
+                   parts[i].first + parts[i].count - 1, parts[i].first & 0xFF,
+                   ((parts[i].first >> 2) & SOUND_HI_MK) |
+                   (parts[i].count - 1), parts[i].crc);
+        }
+        for (n = 1; n <= sounds; n++)
+        {
+            start = (n == 1) ? toc_address(0) :
+                ((toc_address(n - 1) >> 12) + 1) << 12;
+            printf("sound %3u: CRC_SOUND_CMD 0x%02x 0x%02x, crc 0x%08x\n",
+                   n, n & 0xFF, (n >> 2) & SOUND_HI_MK,
+                   crc32(flash + start, toc_address(n) - start));
+        }
+        return 0;
+    }
+
+    f = fopen(argv[2], "r");
+    if (!f)
+    {
+        perror(argv[2]);
+        return 1;
+    }
+    /* Block 0 is written last. */
+    for (i = 0; i < count; i++)
+    {
+        char word[16];
+        unsigned long crc;
+
+        if (fscanf(f, "%15s", word) != 1)
+        {
+            fprintf(stderr, "%s: %u CRCs for %u parts\n", argv[2], i, count);
+            return 1;
+        }
+        crc = strtoul(word, NULL, 16);
+        if (!strcmp(word, "none") || crc != parts[i].crc)
+        {
+            if (!parts[i].sound)
+                toc = 1;
+            else
+                printf("sound %3u: write blocks %u-%u\n", parts[i].sound,
+                       parts[i].first, parts[i].first + parts[i].count - 1);
+            written += parts[i].count;
+        }
+    }
+    fclose(f);
+    if (toc)
+        printf("toc:       write block 0\n");
+    printf("%u of %u blocks to write\n", written, blocks);
+    return 0;
+}
@@ -0,0 +1,91 @@
+/*
+ * TUXAUDIO - Firmware for the 'audio' CPU of tuxdroid
+ * Copyright (C) 2007 C2ME S.A. <tuxdroid@c2me.be>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* $Id$ */
+
+/* $Id$ */
+
+/** \file encode.c
+    \brief IMA-ADPCM encoding of the sounds for the host tools.
+
+    Sounds are encoded to the headerless 4-bit format decoded by adpcm.c, 2
+    codes per byte with the low nibble first. The firmware decoder is used to
+    follow the state so both sides can't drift apart. For each sample, the
+    code giving the closest decoded value is chosen.
+*/
+
+#include <stdlib.h>
+
+#include "encode.h"
+#include "../adpcm.h"
+
+/*
+ * Return the code which best approaches the sample and update the state.
+ */
+static uint8_t encode(struct adpcm_state *state, uint8_t sample)
+{
+    int32_t target = (sample - 0x80) << 8;
+    struct adpcm_state best_state = *state;
+    int32_t best_error = INT32_MAX;
+    uint8_t code, best = 0;
+
+    for (code = 0; code < 16; code++)
+    {
+        struct adpcm_state s = *state;
+        int32_t error;
+
+        adpcm_decode(&s, code);
+        error = abs(s.predictor - target);
+        if (error < best_error)
+        {
+            best_error = error;
+            best = code;
+            best_state = s;
+        }
+    }
+    *state = best_state;
+    return best;
+}
+
+/**
+ * \brief Encode a sound.
+ * \param samples Samples in the flash format, see wav_load().
+ * \param count Number of samples.
+ * \param size Number of bytes returned.
+ * \return Encoded sound, to be freed by the caller.
+ */
+uint8_t *adpcm_encode_sound(uint8_t const *samples, size_t count,
+                            size_t *size)
+{
+    struct adpcm_state state;
+    uint8_t *out = malloc(count / 2 + 1);
+    size_t i;
+
+    adpcm_init(&state);
+    for (i = 0; i < count; i += 2)
+    {
+        uint8_t byte = encode(&state, samples[i]);
+        /* An odd sample count is padded with a null code. */
+        if (i + 1 < count)
+            byte |= encode(&state, samples[i + 1]) << 4;
+        out[i / 2] = byte;
+    }
+    *size = (count + 1) / 2;
+    return out;
+}
@@ -0,0 +1,223 @@
+/*
+ * TUXAUDIO - Firmware for the 'audio' CPU of tuxdroid
+ * Copyright (C) 2007 C2ME S.A. <tuxdroid@c2me.be>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* $Id$ */
+
+/* $Id$ */
+
+/** \file flash_image.c
+    \brief Builds a complete image of the sound flash.
+
+    The sounds are laid out as programming() would store them one after the
+    other: the TOC at 0x000001, the first sound at 0x000400 and each next
+    sound at the first 4kB block following the previous one. The image ends
+    with the last block used and the unused bytes are left erased (0xFF).
+
+    Each sound is stored raw unless it follows the -a option, -r switches back
+    to raw for the next ones. The CRC of each block is printed as it will be
+    returned by STATUS_FLASH_BLOCK_CMD once written with WRITE_BLOCK_CMD.
+
+    The sounds following -k keep the sample rate of their file, from 2 to
+    32kHz, and -l LOOPS:START:END loops the next sound between 2 samples.
+    These sounds are stored with a header, see HDR_VERSION in flash.h.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <util/crc16.h>
+
+#include "wav.h"
+#include "encode.h"
+#include "../AT26F004.h"
+#include "../flash.h"
+#include "../toc.h"
+
+/** Size of the flash. */
+#define FLASH_SIZE (((uint32_t)TOP_A2 << 16 | TOP_A1 << 8 | TOP_A0) + 1)
+
+static uint8_t flash[FLASH_SIZE];
+
+/*
+ * Write a TOC entry.
+ */
+static void toc_set(unsigned n, uint32_t address, uint8_t flags)
+{
+    uint8_t *entry = flash + TOC_FIRST + 3 * n;
+
+    entry[0] = (address >> 16) | flags;
+    entry[1] = address >> 8;
+    entry[2] = address;
+}
+
+/*
+ * Write a 3 bytes value of a sound header.
+ */
+static void hdr_set(uint8_t *p, uint32_t value)
+{
+    p[0] = value >> 16;
+    p[1] = value >> 8;
+    p[2] = value;
+}
+
+/*
+ * Write the header of a sound.
+ */
+static void header(uint8_t *hdr, int adpcm, unsigned rate, size_t count,
+                   unsigned loops, unsigned long loop_start,
+                   unsigned long loop_end)
+{
+    memset(hdr, 0, SOUND_HDR_SIZE);
+    hdr[HDR_VERSION] = SOUND_HDR_VERSION;
+    hdr[HDR_SIZE] = SOUND_HDR_SIZE;
+    hdr[HDR_CODEC] = adpcm ? CODEC_ADPCM : CODEC_RAW_8K;
+    hdr[HDR_LOOPS] = loops;
+    hdr[HDR_RATE] = rate >> 8;
+    hdr[HDR_RATE + 1] = rate;
+    hdr_set(hdr + HDR_LENGTH, count);
+    hdr_set(hdr + HDR_LOOP_START, loop_start);
+    hdr_set(hdr + HDR_LOOP_END, loop_end);
+}
+
+int main(int argc, char *argv[])
+{
+    uint32_t start = 0x000400, stop = start, end;
+    unsigned sounds = 0, block, loops = 0;
+    unsigned long loop_start = 0, loop_end = 0;
+    int adpcm = 0, keep = 0, i;
+    FILE *out;
+
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: flash_image OUTPUT "
+                "[-a|-r] [-k] [-l LOOPS:START:END] FILE...\n"
+                "  LOOPS: times the loop is repeated, %u forever\n",
+                SOUND_LOOP_FOREVER);
+        return 1;
+    }
+    memset(flash, 0xFF, sizeof(flash));
+    flash[0] = 0xFE;
+    toc_set(0, start, 0);
+
+    for (i = 2; i < argc; i++)
+    {
+        uint8_t *samples, *data, hdr[SOUND_HDR_SIZE];
+        size_t count, size, hdr_size = 0;
+        unsigned rate = WAV_RATE;
+
+        if (!strcmp(argv[i], "-a") || !strcmp(argv[i], "-r"))
+        {
+            adpcm = argv[i][1] == 'a';
+            continue;
+        }
+        if (!strcmp(argv[i], "-k"))
+        {
+            keep = 1;
+            continue;
+        }
+        if (!strcmp(argv[i], "-l") && i + 1 < argc)
+        {
+            if (sscanf(argv[++i], "%u:%lu:%lu", &loops, &loop_start,
+                       &loop_end) != 3 || !loops ||
+                loops > SOUND_LOOP_FOREVER || loop_start >= loop_end)
+            {
+                fprintf(stderr, "bad loop: %s\n", argv[i]);
+                return 1;
+            }
+            continue;
+        }
+        if (sounds == TOC_MAX_SOUNDS)
+        {
+            fprintf(stderr, "%s: too many sounds\n", argv[i]);
+            return 1;
+        }
+        samples = wav_load_rate(argv[i], &count, keep ? &rate : NULL);
+        if (!samples)
+            return 1;
+        if (loop_end > count)
+        {
+            fprintf(stderr, "%s: the loop ends after the sound\n", argv[i]);
+            return 1;
+        }
+        if (loops || rate != WAV_RATE)
+        {
+            header(hdr, adpcm, rate, count, loops, loop_start, loop_end);
+            hdr_size = SOUND_HDR_SIZE;
+        }
+        if (adpcm)
+        {
+            data = adpcm_encode_sound(samples, count, &size);
+            free(samples);
+        }
+        else
+        {
+            data = samples;
+            size = count;
+        }
+        /* Sounds start at the next 4kB block. */
+        if (sounds)
+            start = ((stop >> 12) + 1) << 12;
+        if (!size || start + hdr_size + size > FLASH_SIZE - 1)
+        {
+            fprintf(stderr, "%s: %s\n", argv[i],
+                    size ? "the flash is full" : "empty sound");
+            return 1;
+        }
+        memcpy(flash + start, hdr, hdr_size);
+        memcpy(flash + start + hdr_size, data, size);
+        free(data);
+        stop = start + hdr_size + size;
+        sounds++;
+        if (hdr_size)
+            toc_set(sounds, stop, TOC_HEADER_MK);
+        else
+            toc_set(sounds, stop, adpcm ? TOC_ADPCM_MK : 0);
+        printf("sound %3u: 0x%06x - 0x%06x %s %s", sounds, start, stop,
+               adpcm ? "adpcm" : "raw  ", argv[i]);
+        if (hdr_size)
+            printf(" (%uHz, loop %lu-%lu x%u)", rate, loop_start, loop_end,
+                   loops);
+        printf("\n");
+        loops = 0;
+        loop_start = loop_end = 0;
+    }
+
+    end = ((stop - 1) | (IMAGE_BLOCK_SIZE - 1)) + 1;
+    out = fopen(argv[1], "wb");
+    if (!out)
+    {
+        perror(argv[1]);
+        return 1;
+    }
+    fwrite(flash, 1, end, out);
+    fclose(out);
+
+    printf("%u sounds, %u blocks\n", sounds, end / IMAGE_BLOCK_SIZE);
+    for (block = 0; block < end / IMAGE_BLOCK_SIZE; block++)
+    {
+        uint8_t const *p = flash + block * IMAGE_BLOCK_SIZE;
+        uint16_t crc = 0xFFFF;
+        unsigned j;
+
+        for (j = 0; j < IMAGE_BLOCK_SIZE; j++)
+            crc = _crc_ccitt_update(crc, p[j]);
+        printf("block %3u: crc 0x%04x\n", block, crc);
+    }
+    return 0;
+}
@@ -0,0 +1,177 @@
+/*
+ * TUXAUDIO - Firmware for the 'audio' CPU of tuxdroid
+ * Copyright (C) 2007 C2ME S.A. <tuxdroid@c2me.be>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* $Id$ */
+
+/** \file wav.c
+    \brief Sound file loading for the host tools.
+
+    Sounds are returned as unsigned 8-bit samples at 8kHz, the format of the
+    flash. WAV files should be mono PCM, 8 or 16-bit, at 8 or 16kHz. Any
+    other file is taken as raw samples already in the flash format.
+
+    wav_load_rate() keeps the rate of the file instead, for the sounds
+    stored with a header. Any rate from PLAY_RATE_MIN to PLAY_RATE_MAX is
+    then accepted.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "wav.h"
+#include "../flash.h"
+
+static uint32_t le32(uint8_t const *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint16_t le16(uint8_t const *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+/*
+ * Convert the data chunk of a WAV file.
+ */
+static uint8_t *convert(uint8_t const *fmt, uint8_t const *data, size_t size,
+                        char const *name, size_t *count, unsigned *keep)
+{
+    uint16_t format = le16(fmt), channels = le16(fmt + 2);
+    uint32_t rate = le32(fmt + 4);
+    uint16_t bits = le16(fmt + 14);
+    unsigned width = bits / 8, step;
+    size_t i, n;
+    uint8_t *out;
+
+    if (format != 1 || channels != 1 || (bits != 8 && bits != 16))
+    {
+        fprintf(stderr, "%s: only mono 8 or 16-bit PCM is supported\n", name);
+        return NULL;
+    }
+    if (keep)
+    {
+        if (rate < PLAY_RATE_MIN || rate > PLAY_RATE_MAX)
+        {
+            fprintf(stderr, "%s: sample rate should be from %d to %dHz\n",
+                    name, PLAY_RATE_MIN, PLAY_RATE_MAX);
+            return NULL;
+        }
+        *keep = rate;
+        step = 1;
+    }
+    else if (rate != WAV_RATE && rate != 2 * WAV_RATE)
+    {
+        fprintf(stderr, "%s: sample rate should be 8 or 16kHz\n", name);
+        return NULL;
+    }
+    else
+        step = rate / WAV_RATE;
+    n = size / width / step;
+    out = malloc(n ? n : 1);
+    for (i = 0; i < n; i++)
+    {
+        unsigned j;
+        int sum = 0;
+
+        /* Average the samples when dropping the rate. */
+        for (j = 0; j < step; j++)
+        {
+            uint8_t const *p = data + (i * step + j) * width;
+            if (width == 1)
+                sum += *p;
+            else
+                sum += ((int16_t)le16(p) >> 8) + 0x80;
+        }
+        out[i] = sum / step;
+    }
+    *count = n;
+    return out;
+}
+
+/**
+ * \brief Load a sound file.
+ * \param name File name.
+ * \param count Number of samples returned.
+ * \return Samples, to be freed by the caller, or NULL on error.
+ */
+uint8_t *wav_load(char const *name, size_t *count)
+{
+    return wav_load_rate(name, count, NULL);
+}
+
+/**
+ * \brief Load a sound file at its own sample rate.
+ * \param name File name.
+ * \param count Number of samples returned.
+ * \param rate Sample rate of the file, WAV_RATE for raw samples. If NULL,
+ * the sound is converted to WAV_RATE like by wav_load().
+ * \return Samples, to be freed by the caller, or NULL on error.
+ */
+uint8_t *wav_load_rate(char const *name, size_t *count, unsigned *rate)
+{
+    FILE *f = fopen(name, "rb");
+    uint8_t *buf = NULL, *out = NULL;
+    uint8_t const *fmt = NULL;
+    size_t size = 0, len;
+
+    if (!f)
+    {
+        perror(name);
+        return NULL;
+    }
+    do
+    {
+        buf = realloc(buf, size + 65536);
+        len = fread(buf + size, 1, 65536, f);
+        size += len;
+    } while (len);
+    fclose(f);
+
+    if (size < 12 || memcmp(buf, "RIFF", 4) || memcmp(buf + 8, "WAVE", 4))
+    {
+        /* Raw samples */
+        if (rate)
+            *rate = WAV_RATE;
+        *count = size;
+        return buf;
+    }
+
+    len = 12;
+    while (len + 8 <= size)
+    {
+        uint32_t chunk = le32(buf + len + 4);
+
+        if (chunk > size - len - 8)
+            chunk = size - len - 8;
+        if (!memcmp(buf + len, "fmt ", 4) && chunk >= 16)
+            fmt = buf + len + 8;
+        else if (!memcmp(buf + len, "data", 4) && fmt)
+        {
+            out = convert(fmt, buf + len + 8, chunk, name, count, rate);
+            break;
+        }
+        len += 8 + chunk + (chunk & 1);
+    }
+    if (!out && !fmt)
+        fprintf(stderr, "%s: invalid WAV file\n", name);
+    free(buf);
+    return out;
+}
@@ -0,0 +1,39 @@
+/*
+ * TUXAUDIO - Firmware for the 'audio' CPU of tuxdroid
+ * Copyright (C) 2007 C2ME S.A. <tuxdroid@c2me.be>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* $Id$ */
+
+/** \file wav.h
+    \brief Sound file loading for the host tools.
+*/
+
+#ifndef WAV_H
+#define WAV_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/** Sample rate of the sounds stored in the flash. */
+#define WAV_RATE 8000
+
+extern uint8_t *wav_load(char const *name, size_t *count);
+extern uint8_t *wav_load_rate(char const *name, size_t *count,
+                              unsigned *rate);
+
+#endif
@@ -21,51 +21,52 @@
 
 #include <avr/io.h>
 #include "fifo.h"
+#include "features.h"
 
-// PWM Variable
+// PWM Variable, counts the calls of the sampling ISR
 unsigned char sampling_pwm = 0x04;
 
 /* Set when sleep should be entered. */
 uint8_t sleep_f = 0;
 
+/* Incremented by the timer 2 overflow, every 32.8ms. */
+volatile uint8_t main_tick = 0;
+
 // SPI Variable
-volatile unsigned char spi_enable = 1;
-typedef enum
-{ HEADERS, GET_SOUND_FIFO, PUT_COMMAND, DUMMY } STM_SPI_MASTER_SLAVE_TYPE;
-volatile STM_SPI_MASTER_SLAVE_TYPE spi_slave;
-typedef enum
-{ HEADERM, PUT_SOUND_FIFO, READ_COMMAND } STM_SPI_SLAVE_MASTER_TYPE;
-volatile STM_SPI_SLAVE_MASTER_TYPE spi_master;
-volatile unsigned char spi_headerb;
-volatile unsigned char spi_master_config;
-volatile unsigned char spi_count;
-volatile unsigned char spi_lenght_data;
-volatile unsigned char spi_ready = 0;
 volatile uint8_t rf_txe = 0;
-volatile uint8_t spi_commandTX[5];
-unsigned char spi_commandRX[5];
-unsigned char commandRX = 0;
-uint8_t rf_data_sent_ack;
 
 
 // Flash programming
 uint8_t eraseFlag = 0;
+#if (OPT_FLASH_IMAGE)
+uint8_t imageFlag = 0;
+uint8_t image_block;
+#endif
+#if (OPT_SOUND_DELETE)
+uint8_t compactFlag = 0;
+uint16_t delete_sound;
+#endif
+#if (OPT_FLASH_CRC)
+uint8_t checksumFlag = 0;
+uint16_t checksum_first;
+uint8_t checksum_blocks;
+#endif
 volatile unsigned char programmingFlash = 0;
-volatile uint8_t numSound;
+volatile uint16_t numSound;
+uint8_t store_codec = 0;
+#if (OPT_BULK)
+uint8_t store_bulk = 0;
+#endif
 
 // Flash Variables
 volatile unsigned char flashPlay = 0;
 volatile unsigned char ad[6];
 volatile unsigned char audioLevel;
-uint8_t soundToPlay;
-
-unsigned char audio_level, battery_level;
-
-volatile unsigned char spiCommandFlasg = 0;
+uint16_t soundToPlay;
 
 uint16_t frame_without_sound = 0;
 uint8_t sound_played = 0;
-uint8_t last_block = 0;
+uint16_t last_block = 0;
 
 // General flags
 uint8_t write_toc = 0;
@@ -23,59 +23,62 @@
 #define VARIS_H
 
 #include "fifo.h"
+#include "features.h"
 
 // PWM Variable
 extern unsigned char sampling_pwm;
 
 extern uint8_t sleep_f;
 
+extern volatile uint8_t main_tick;
+
 // SPI Variable
-extern volatile unsigned char spi_enable;
-typedef enum
-{ HEADERS, GET_SOUND_FIFO, PUT_COMMAND, DUMMY } STM_SPI_MASTER_SLAVE_TYPE;
-extern volatile STM_SPI_MASTER_SLAVE_TYPE spi_slave;
-typedef enum
-{ HEADERM, PUT_SOUND_FIFO, READ_COMMAND } STM_SPI_SLAVE_MASTER_TYPE;
-extern volatile STM_SPI_SLAVE_MASTER_TYPE spi_master;
-extern volatile unsigned char spi_headerb;
-extern volatile unsigned char spi_master_config;
-extern volatile unsigned char spi_count;
-extern volatile unsigned char spi_lenght_data;
-extern volatile unsigned char spi_ready;
 extern volatile uint8_t rf_txe;
-extern uint8_t spi_commandTX[5];
-extern unsigned char spi_commandRX[5];
-extern unsigned char commandRX;
-extern uint8_t rf_data_sent_ack;
-
-#define RF_DATA_SENT_FREE       0x00
-#define RF_DATA_SENT_BUSY       0x01
-#define RF_DATA_SENT_ACKED      0x02
-#define RF_DATA_SENT_NACKED     0x03
-#define RF_DATA_SENT_DROPPED    0x80
 
 
 // Flash programming
 
 extern uint8_t eraseFlag;
+#if (OPT_FLASH_IMAGE)
+extern uint8_t imageFlag;
+extern uint8_t image_block;
+#else
+#define imageFlag 0
+#endif
+#if (OPT_SOUND_DELETE)
+extern uint8_t compactFlag;
+extern uint16_t delete_sound;
+#else
+/* Never set, the tests of the flag go away. */
+#define compactFlag 0
+#endif
+#if (OPT_FLASH_CRC)
+extern uint8_t checksumFlag;
+extern uint16_t checksum_first;
+extern uint8_t checksum_blocks;
+#else
+#define checksumFlag 0
+#endif
 extern volatile unsigned char programmingFlash;
-extern volatile uint8_t numSound;
+extern volatile uint16_t numSound;
+extern uint8_t store_codec;
+#if (OPT_BULK)
+extern uint8_t store_bulk;
+#else
+#define store_bulk 0
+#endif
 
 // Flash Variables
 extern volatile unsigned char flashPlay;
 extern volatile unsigned char ad[6];
 extern volatile unsigned char audioLevel;
-extern uint8_t soundToPlay;
-
-extern unsigned char audio_level, battery_level;
+extern uint16_t soundToPlay;
 
 extern volatile unsigned char testAudio;
 
-extern volatile unsigned char spiCommandFlasg;
-
 extern uint16_t frame_without_sound;
 extern uint8_t sound_played;
-extern uint8_t last_block;
+extern uint16_t last_block;
 
 // General flags
 extern uint8_t write_toc;
@@ -188,7 +188,10 @@
  * Return the sound flash information.
  *
  * Parameters:
- *   - 1 - number of sounds stored in the flash.
+ *   - 1 - number of sounds stored in the flash, bits 0 to 7.
+ *   - 2 - last 4kB block used, bits 0 to 7.
+ *   - 3 - bits 8 and 9 of the number of sounds in bits 0 and 1, bits 8 and 9
+ *   of the last block in bits 4 and 5.
  */
 #define SOUND_VAR_CMD 0xCB
 
@@ -281,6 +284,237 @@
 
 /*! @} */
 
+/** \name Microphone
+ *  @{ */
+
+/**
+ * Set the voice activity detection of the microphone.
+ *
+ * When the activity measured on the microphone samples of a frame stays below
+ * the threshold for longer than the hangover, the frames are sent without
+ * audio (CFG_AUDIO_MK cleared) until the activity rises again. The activity
+ * is the mean absolute difference between consecutive samples.
+ *
+ * Parameters:
+ *   - 1 - Activity threshold, 0 disables the detection.
+ *   - 2 - Hangover, in frames of 17 samples (about 2ms).
+ *
+ * Only built with OPT_MIC_VAD, see features.h of tuxaudio.
+ */
+#define MIC_VAD_CMD 0x93
+
+/*! @} */
+
+/** \name Speaker
+ *  @{ */
+
+/**
+ * Request the state of the speaker rate controller, answered by
+ * STATUS_AUDIO_RATE_CMD. Only built with OPT_RATE_REQ, see features.h of
+ * tuxaudio.
+ */
+#define AUDIO_RATE_REQ_CMD 0x07
+
+/**
+ * Return the state of the speaker rate controller.
+ *
+ * The sampling rate of the speaker follows the rate of the audio frames
+ * received from the RF by adjusting the TOP of the sampling timer so that the
+ * audio fifo stays at a target level.
+ *
+ * Parameters:
+ *   - 1 - Length of the audio fifo when the last frame was received.
+ *   - 2 - TOP of the sampling timer, the sampling rate is 4MHz/(TOP+1).
+ *   - 3 - Integral term of the controller divided by 256, signed.
+ */
+#define STATUS_AUDIO_RATE_CMD 0xCF
+
+/**
+ * Set the gains of the speaker mixer.
+ *
+ * A sound played from the flash while a stream is received from the RF is
+ * mixed with it instead of being dropped. The gains apply to both sources
+ * when they're played alone too, 128 is a gain of 1.
+ *
+ * Parameters:
+ *   - 1 - Gain of the RF stream.
+ *   - 2 - Gain of the flash sounds.
+ *
+ * Only built with OPT_MIXER, see features.h of tuxaudio. The stream is
+ * otherwise dropped while a sound is played.
+ */
+#define MIXER_GAIN_CMD 0x94
+
+/*! @} */
+
+/** \name Flash image
+ *  A complete image of the sound flash, built by tools/flash_image, is
+ *  written one 4kB block at a time.
+ *  @{ */
+
+/**
+ * Write a 4kB block of the sound flash.
+ *
+ * The block is erased, then its 4096 bytes are sent in bulk frames starting
+ * at BULK_FIRST_IDX, see CFG_BULK_MK in defines.h. The last frame is padded.
+ * The block is read back once written and its CRC is returned by
+ * STATUS_FLASH_BLOCK_CMD. The TOC is read again once block 0 is written.
+ *
+ * Parameters:
+ *   - 1 - Block number, from 0 to 127.
+ *
+ * Only built with OPT_FLASH_IMAGE, see features.h of tuxaudio.
+ */
+#define WRITE_BLOCK_CMD 0x55
+
+/**
+ * Return the CRC of a block read back from the flash after
+ * WRITE_BLOCK_CMD.
+ *
+ * The CRC is the CRC-CCITT of avr-libc (_crc_ccitt_update, reflected
+ * polynomial 0x8408) starting at 0xFFFF. The block should be written again
+ * if it doesn't match the CRC of the image.
+ *
+ * Parameters:
+ *   - 1 - Block number.
+ *   - 2 - CRC high byte.
+ *   - 3 - CRC low byte.
+ */
+#define STATUS_FLASH_BLOCK_CMD 0xC6
+
+/**
+ * Compute the CRC of a stored sound.
+ *
+ * The bytes of the sound are read back from the flash in the background,
+ * from its header if it has one to its last byte. The CRC is returned by
+ * STATUS_FLASH_CRC_CMD, CRC_NONE if the sound doesn't exist. The sound
+ * being played is stopped. The command is dropped while the flash is
+ * written, erased or compacted, and those commands are dropped until the CRC
+ * is returned.
+ *
+ * Parameters:
+ *   - 1 - Sound number.
+ *   - 2 - Bits 8 and 9 of the sound number in bits 6 and 7.
+ */
+#define CRC_SOUND_CMD 0x57
+
+/**
+ * Compute the CRC of 4kB blocks of the flash.
+ *
+ * Same as CRC_SOUND_CMD over up to 64 blocks, the blocks of a sound built by
+ * tools/flash_image can be compared with its image before writing them
+ * again with WRITE_BLOCK_CMD, see tools/bank_sync. CRC_NONE is returned if
+ * the blocks go past the end of the flash.
+ *
+ * Parameters:
+ *   - 1 - First block.
+ *   - 2 - Number of blocks minus 1 in bits 0 to 5, bits 8 and 9 of the
+ *         first block in bits 6 and 7.
+ *
+ * Both CRC commands are only built with OPT_FLASH_CRC, see features.h of
+ * tuxaudio.
+ */
+#define CRC_RANGE_CMD 0x58
+
+/**
+ * Return the CRC computed after CRC_SOUND_CMD or CRC_RANGE_CMD.
+ *
+ * The CRC is the CRC-32 of zlib (reflected polynomial 0xEDB88320, starting
+ * at 0xFFFFFFFF and inverted at the end). It is sent in 2 commands, the high
+ * half first.
+ *
+ * Parameters:
+ *   - 1 - CRC_HIGH, CRC_LOW or CRC_NONE.
+ *   - 2 - High byte of the half.
+ *   - 3 - Low byte of the half.
+ */
+#define STATUS_FLASH_CRC_CMD 0xD5
+#define CRC_HIGH 0      /**< Bits 16 to 31 of the CRC */
+#define CRC_LOW 1       /**< Bits 0 to 15 of the CRC */
+#define CRC_NONE 2      /**< Nothing to compute, no CRC follows */
+
+/*! @} */
+
+/** \name RF frames
+ *  Format of the RF SPI frames exchanged with tuxaudio, see defines.h.
+ *  @{ */
+
+/**
+ * Pack several commands in each RF frame.
+ *
+ * The commands are then sent and acked by groups, see CMD_PACK_IN_OFFSET in
+ * defines.h. The command is sent back by tuxaudio with the state set and the
+ * largest groups it takes and sends; an older firmware, or one built without
+ * OPT_CMD_PACK, doesn't answer and keeps one command per frame.
+ *
+ * Parameters:
+ *   - 1 - 1 to pack the commands, 0 to send one per frame.
+ *   - 2 - In the answer, the most commands of a group sent to tuxaudio.
+ *   - 3 - In the answer, the most commands of a group sent by tuxaudio.
+ */
+#define PACKED_CMDS_CMD 0x59
+
+/**
+ * Number the commands of the RF frames and ack them with a window.
+ *
+ * Up to CMD_WINDOW commands can then be sent before the first one is acked,
+ * see CMD_SEQ_MK in defines.h. tuxaudio acks this command with the
+ * alternating bit and switches right away, the dongle switches when it gets
+ * the ack. tuxaudio goes back to the alternating bit when the RF goes
+ * offline. An older firmware, or one built without OPT_CMD_WINDOW, doesn't
+ * answer.
+ *
+ * Parameters:
+ *   - 1 - In the answer, the size of the window.
+ */
+#define WINDOWED_CMDS_CMD 0x5A
+
+/**
+ * Request the statistics of the RF link, answered by STATUS_LINK_CMD.
+ *
+ * Only built with OPT_LINK_STATS, see features.h of tuxaudio.
+ */
+#define LINK_STATS_REQ_CMD 0x0A
+
+/**
+ * Return a counter of the RF link.
+ *
+ * The counters are sent one after the other, from LINK_FRAMES to
+ * LINK_URGENT_DROPPED, as room is made for them behind the routine status.
+ * LINK_LOST isn't sent while the commands are numbered in the window.
+ * They are 16-bit and wrap, so the differences between 2 requests should be
+ * used.
+ *
+ * Parameters:
+ *   - 1 - Counter, see below.
+ *   - 2 - High byte of the counter.
+ *   - 3 - Low byte of the counter.
+ */
+#define STATUS_LINK_CMD 0xD6
+/** Frames received from the RF. */
+#define LINK_FRAMES 0
+/** Frames missing in the index of the frames received, and bulk frames missing
+ * in theirs. The frames aren't numbered in the window. */
+#define LINK_LOST 1
+/** Frames received twice in a row, with the same index. */
+#define LINK_REPEATED 2
+/** Frames received without CFG_CRCOK_MK. */
+#define LINK_CRC_ERRORS 3
+/** Speaker frames which found the audio fifo empty while streaming. */
+#define LINK_UNDERRUNS 4
+/** Commands sent again to the RF after their ack failed to arrive, in as many
+ * frames as the previous ack took. */
+#define LINK_CMDS_RESENT 5
+/** Routine status dropped as their stack to the RF was full, and the other
+ * commands too in a tuxaudio built without OPT_CMD_URGENT. */
+#define LINK_DROPPED 6
+/** Other commands to the RF dropped as their stack was full. */
+#define LINK_URGENT_DROPPED 7
+/** Number of counters. */
+#define LINK_COUNTERS 8
+
+/*! @} */
+
 /** \name Movement commands
  *  Theses commands are used to move Tux.
  * @{ */
@@ -307,6 +541,24 @@
 #define MOTORS_CONFIG_CMD 0x81
 /*! @} */
 
+/** \name Status reporting
+ *  @{ */
+
+/**
+ * Set the heartbeat of the status of tuxcore.
+ *
+ * The ports, sensors and position status are only sent when they change, the
+ * changes during a tick being sent in one status, and all of them are sent
+ * again at each heartbeat. Only the position switches and the buttons are
+ * watched in STATUS_PORTS_CMD, the other pins are refreshed by the heartbeat.
+ * All the status are also sent right after this command.
+ *
+ * Parameters:
+ *   - 1 - Heartbeat in 100ms ticks, 0 to send all the status at each tick.
+ */
+#define HEARTBEAT_CMD 0x42
+/*! @} */
+
 
 /*! @} */
 
@@ -320,6 +572,17 @@ typedef enum audiorec_status
     ERASING_LAST_SOUND,
     FLASH_FULL,
     NO_SOUND,
+    PROG_RATE, /* Throughput in bytes/s, high and low bytes in parameters 2
+                  and 3. Sent about each second while programming and once
+                  with the average for the sound at the end. Only built
+                  with OPT_PROG_RATE, see features.h of tuxaudio. */
+    COMPACTING, /* Blocks left to move after DELETE_SOUND_CMD in parameter
+                   2. */
+    ERASING, /* Blocks left to erase after ERASE_FLASH_CMD in parameter 2,
+                all of them during a chip erase, and seconds elapsed in
+                parameter 3. Sent at the start and about each second. */
+    UNKNOWN_CODEC, /* STORE_SOUND_CMD dropped as its codec, in parameter 2,
+                      isn't known. */
 } audiorec_status_t;
 
 #endif /* _API_H_ */
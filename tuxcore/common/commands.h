@@ -97,15 +97,59 @@
  * Audio commands can't have 3 parameters, see the above note for details
  */
 #define PLAY_SOUND_CMD 0x90        /* play a sound from the flash sound bank */
+/* 1st parameter: sound number, 0 stops the sound being played */
+/* 2nd parameter: attenuation of the sound in 6dB steps, applied to the
+ *                flash gain of MIXER_GAIN_CMD, in bits 0 to 3. Bits 6 and 7
+ *                hold bits 8 and 9 of the sound number. */
+/* A sound with a header can loop forever until it's stopped. */
+#define QUEUE_SOUND_CMD 0x95       /* play a sound after the current one */
 /* 1st parameter: sound number */
-/* 2nd parameter: sound volume */
+/* 2nd parameter: attenuation of the sound and bits 8 and 9 of the sound
+ *                number, as for PLAY_SOUND_CMD */
+/* Up to 8 sounds are queued and played without gap, the command plays the
+ * sound right away if none is playing. PLAY_SOUND_CMD with sound 0 stops the
+ * sound and clears the queue. The queue is only built with OPT_SOUND_QUEUE,
+ * see features.h of tuxaudio. */
+#define SKIP_SOUND_CMD 0x08        /* go on with the next queued sound */
+#define CLEAR_QUEUE_CMD 0x09       /* drop the queued sounds */
 #define STORE_SOUND_CMD 0x52
+/* 1st parameter: codec of the sound sent
+ *                0 for 8-bit samples at 16kHz, stored at 8kHz
+ *                1 for 4-bit IMA-ADPCM at 8kHz, stored as is, only
+ *                  built with OPT_SOUND_ADPCM
+ *                2 for 8-bit samples at 8kHz, stored as is
+ *                3 for a sound starting with a header, stored as is, see
+ *                  HDR_VERSION in tuxaudio/flash.h, only built with
+ *                  OPT_SOUND_HEADER
+ *                Other codecs are answered with UNKNOWN_CODEC of
+ *                STATUS_FLASH_PROG_CMD and nothing is stored.
+ * 2nd parameter: 1 to send the sound in bulk frames instead of speaker audio,
+ *                see CFG_BULK_MK in defines.h. Codec 0 is then stored as 2.
+ *                Only built with OPT_BULK, UNKNOWN_CODEC is answered
+ *                otherwise.
+ * The sound can be sent faster than its sample rate as long as the flash
+ * keeps up, see PROG_RATE of STATUS_FLASH_PROG_CMD. */
 
 #define CONFIRM_STORAGE_CMD 0x53
 /* 1st parameter: 1 to write the sound
  *                0 to not write the sound*/
 
 #define ERASE_FLASH_CMD 0x54
+/* 1st parameter: 0 to erase the whole chip
+ *                1 to only erase the blocks up to the last sound, only
+ *                  built with OPT_ERASE_USED, the chip is erased otherwise
+ * The erase goes on in the background, ERASING of STATUS_FLASH_PROG_CMD
+ * gives its progress. SOUND_VAR_CMD is sent once done. It's dropped while a
+ * sound or a block is stored, a sound deleted or a CRC computed, and
+ * STORE_SOUND_CMD is dropped until the erase is done. */
+
+#define DELETE_SOUND_CMD 0x56
+/* 1st parameter: sound number
+ * 2nd parameter: bits 8 and 9 of the sound number in bits 6 and 7
+ * The next sounds are moved down in the background and take the following
+ * numbers, COMPACTING of STATUS_FLASH_PROG_CMD gives the blocks left to
+ * move. SOUND_VAR_CMD is sent once done.
+ * Only built with OPT_SOUND_DELETE, see features.h of tuxaudio. */
 
 #define MUTE_CMD            0x92        /* mute/unmute the audio amplifier */
 /* 1st parameter: mute state 0:unmute 1:mute */
@@ -198,8 +242,9 @@
 
 /* send the programming state from the audio CPU */
 #define STATUS_FLASH_PROG_CMD       0xCD
-/* 1st parameter: The current state (see flash.h)
+/* 1st parameter: The current state (see audiorec_status_t in api.h)
  * 2nd parameter: The size of the last sound (1 = 4kB)
+ * 2nd and 3rd parameters: The throughput in bytes/s for PROG_RATE
  */
 
 #define STATUS_LIGHT_CMD            0xC2
@@ -100,21 +100,27 @@ typedef struct
 {
     uint8_t ir_feedback;        /* flashes the leds when an ir code is received */
     uint8_t led_off_when_closed_eyes;   /* turns off the leds when the eyes are closed */
+    uint8_t status_heartbeat;   /* the status are sent when they change and all of them each status_heartbeat 100ms ticks, 0 to send all of them at each tick */
 }
 tuxcore_config_t;
 
 typedef struct
 {
     uint8_t automute;           /* mutes the speaker when no sounds are played and unmute it when sound arrives, you can't use the line in in this mode as the insertion of a plug is not detected so the speaker won't be unmuted */
+    uint8_t vad_threshold;      /* microphone activity level under which the frames are sent without audio, 0 to always send the audio */
+    uint8_t vad_hangover;       /* number of frames still sent with audio after the activity dropped */
 }
 tuxaudio_config_t;
 
 /* Default configurations */
 #define TUXCORE_CONFIG  { \
     .ir_feedback = 1, \
-    .led_off_when_closed_eyes = 1}
+    .led_off_when_closed_eyes = 1, \
+    .status_heartbeat = 10}
 
 #define TUXAUDIO_CONFIG { \
-    .automute = 0}
+    .automute = 0, \
+    .vad_threshold = 0, \
+    .vad_hangover = 100}
 
 #endif /* _CONFIG_H_ */
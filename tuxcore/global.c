@@ -36,6 +36,9 @@ uint8_t remote_mode = 0;
  * General global registers
  */
 uint8_t updateStatusFlag, commandProcessFlag, pingCnt;
+/** 100ms ticks left until all the status are sent again, 0 to send them at
+ * the next update. */
+uint8_t heartbeatCnt;
 uint8_t ir_delay, ir_flg, ir_oldvalue, alt_mode, ir_send_flg, tux_ir_id,
     last_tux_seen = 0xFF;
 
@@ -197,6 +197,7 @@ extern uint8_t remote_mode; /* normal mode */
  * General global registers
  */
 extern uint8_t updateStatusFlag, commandProcessFlag, pingCnt;
+extern uint8_t heartbeatCnt;
 extern uint8_t ir_delay, ir_flg, ir_oldvalue, alt_mode, ir_send_flg, tux_ir_id,
     last_tux_seen;
 
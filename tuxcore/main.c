@@ -51,6 +51,7 @@ http://svn.tuxisalive.com/firmware/tuxcore/trunk
 #include "standalone.h"
 #include "parser.h"
 #include "config.h"
+#include "hardware.h"
 #include "debug.h"
 
 /*
@@ -77,6 +78,28 @@ static uint8_t t4ms_cnt;
 static uint8_t t100ms_cnt;
 /*! @} */
 
+/**
+ * \name Status reporting
+ * The ports, sensors and position status are sent when they change, and all
+ * of them each tux_config.status_heartbeat 100ms ticks.
+ *  @{ */
+/** Number of status only sent when they change. */
+#define STATUS_WATCHED 4
+/** Content of the watched status as last sent, compared with the new one. */
+static uint8_t status_last[STATUS_WATCHED][3];
+/** Bits of the watched status which tell a change. The pins of the ports
+ * driven by tuxcore or toggling all the time (motors, LEDs, I2C, IR) are only
+ * refreshed by the heartbeat. */
+static uint8_t const status_mask[STATUS_WATCHED][3] PROGMEM = {
+    {0xFF, 0xFF, 0xFF},
+    {SW_HD_MK | PSW_MOUTH_MK | EXIO_MK, PSW_FLIPPERS_MK,
+     PSW_SPIN_MK | PSW_EYES_MK},
+    {0xFF, 0xFF, 0xFF},
+    {0xFF, 0xFF, 0xFF}};
+/** Set when all the watched status are sent in this update. */
+static bool status_all;
+/*! @} */
+
 static void initIO(void);
 static void updateStatus(void);
 static void sleep(void);
@@ -156,6 +179,9 @@ int main(void)
      */
     for (;;)
     {
+        /* Status updates requested between two ticks are coalesced. */
+        bool status_tick = t4ms_flag;
+
         if (t4ms_flag)
         {
             t4ms_flag = false;
@@ -179,6 +205,8 @@ int main(void)
         {
             t100ms_flag = false;
             updateStatusFlag = 1;
+            if (heartbeatCnt)
+                heartbeatCnt--;
             if (event_timer)
             {
                 event_timer--;
@@ -189,7 +217,7 @@ int main(void)
          * Communication: updating status, receiving and sending commands
          */
         /* We don't send status when entering or leaving sleep mode. */
-        if (updateStatusFlag)
+        if (updateStatusFlag && status_tick)
         {
             updateStatusFlag = 0;
             if (!cond_flags.sleep)
@@ -253,15 +281,57 @@ static void closeIO(void)
     turnIrOff();
 }
 
+/**
+ * \brief Queue a watched status if it changed since it was last sent.
+ * \param n Index of the status in status_last.
+ * \param status Status command and its parameters.
+ *
+ * The status is also sent if status_all is set. It's kept as sent only once
+ * it has been queued so it's tried again at the next update if the stack is
+ * full.
+ */
+static void queueStatus(uint8_t n, uint8_t *status)
+{
+    uint8_t i;
+    bool changed = status_all;
+
+    for (i = 0; i < 3; i++)
+        if ((status[i + 1] ^ status_last[n][i])
+            & pgm_read_byte(&status_mask[n][i]))
+            changed = true;
+    if (changed && queue_cmd(status))
+        for (i = 0; i < 3; i++)
+            status_last[n][i] = status[i + 1];
+}
+
 static void updateStatus(void)
 {
-    queue_cmd_p(STATUS_SENSORS1_CMD, gStatus.sw, gStatus.audio_play,
-               gStatus.audio_status);
-    queue_cmd_p(STATUS_PORTS_CMD, PINB, PINC, PIND);
-    queue_cmd_p(STATUS_POSITION1_CMD, eyes_move_counter, mouth_move_counter,
-               flippers_move_counter);
-    queue_cmd_p(STATUS_POSITION2_CMD, spin_move_counter, gStatus.pos, 
-                gStatus.mot);
+    uint8_t status[CMD_SIZE];
+
+    status_all = !heartbeatCnt;
+    if (status_all)
+        heartbeatCnt = tux_config.status_heartbeat;
+
+    status[0] = STATUS_SENSORS1_CMD;
+    status[1] = gStatus.sw;
+    status[2] = gStatus.audio_play;
+    status[3] = gStatus.audio_status;
+    queueStatus(0, status);
+    status[0] = STATUS_PORTS_CMD;
+    status[1] = PINB;
+    status[2] = PINC;
+    status[3] = PIND;
+    queueStatus(1, status);
+    status[0] = STATUS_POSITION1_CMD;
+    status[1] = eyes_move_counter;
+    status[2] = mouth_move_counter;
+    status[3] = flippers_move_counter;
+    queueStatus(2, status);
+    status[0] = STATUS_POSITION2_CMD;
+    status[1] = spin_move_counter;
+    status[2] = gStatus.pos;
+    status[3] = gStatus.mot;
+    queueStatus(3, status);
     if (led_f)
     {
         led_f = false;
@@ -344,6 +414,8 @@ static void sleep(void)
     communication_init();
     irGetRC5();
     gStatus.pos = status_bak;
+    /* Send all the status again once awake. */
+    heartbeatCnt = 0;
 
     /* Wait 200ms for the pull-up to rise before next standalone behavior
      * otherwise position switches signals are wrong */
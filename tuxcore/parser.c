@@ -29,6 +29,7 @@
 #include "motors.h"
 #include "ir.h"
 #include "led.h"
+#include "config.h"
 #include "version.h"
 
 /**
@@ -61,6 +62,8 @@ void parse_cmd(uint8_t cmd[CMD_SIZE])
         {
             cond_flags.rf_conn = 1;
             cond_flags.rf_disconn = 0;
+            /* The computer doesn't know any status yet. */
+            heartbeatCnt = 0;
         }
         if (!(cmd[1] & STATUS_RF_MK) && (gStatus.sw & GSTATUS_RF_MK))
         {
@@ -79,7 +82,8 @@ void parse_cmd(uint8_t cmd[CMD_SIZE])
         return;
     }
     /* Sound */
-    else if (cmd[0] == PLAY_SOUND_CMD)
+    else if (cmd[0] == PLAY_SOUND_CMD || cmd[0] == QUEUE_SOUND_CMD ||
+             cmd[0] == SKIP_SOUND_CMD || cmd[0] == CLEAR_QUEUE_CMD)
     {
         /* Forward the cmd to the audio CPU. */
         queue_cmd(cmd);
@@ -91,6 +95,14 @@ void parse_cmd(uint8_t cmd[CMD_SIZE])
         queue_cmd(cmd);
         return;
     }
+    /* Status reporting */
+    else if (cmd[0] == HEARTBEAT_CMD)
+    {
+        tux_config.status_heartbeat = cmd[1];
+        heartbeatCnt = 0;
+        updateStatusFlag = 1;
+        return;
+    }
     /* Sleep mode */
     else if (cmd[0] == SLEEP_CMD)
     {